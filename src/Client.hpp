@@ -8,9 +8,13 @@
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <fstream>
 #include "Renderer/SDL/Window.hpp"
 #include "Renderer/Renderer.hpp"
+#include "Renderer/DynamicResolution.hpp"
 #include "GameState/GameObject.hpp"
+#include "Physics/SphereBVArray.hpp"
 #include "readwriterqueue/readerwriterqueue.h"
 #include "Networking/ConnectionManager.hpp"
 
@@ -20,8 +24,13 @@
 class Client {
 public:
     //settings
-    static const int WIDTH = 800;
+    static const int WIDTH = 800; //Starting window size
     static const int HEIGHT = 800;
+    static constexpr double TARGET_FRAME_MS = 1000.0 / 60.0; //Render resolution is lowered to hold this frame time
+    static constexpr float MIN_RENDER_SCALE = 0.4f; //Lowest render resolution relative to the window
+    static constexpr bool STATS_OVERLAY = false; //Draw the render stats over every frame
+    static constexpr const char* STATS_LOG_FILE = "render_stats.csv"; //Render stats of a frame are written here every STATS_LOG_MS. Empty to not log.
+    static constexpr double STATS_LOG_MS = 1000.0;
 private:
 
     Window window{WIDTH,HEIGHT,"Client"}; // Poll events and display the frame buffer.(Write Rendering thread & Read Update thread)
@@ -29,15 +38,31 @@ private:
     // & Write Update thread)
 
     ResourceManager resource_manager{}; //Manage read only shared resources.(Read Rendering thread & Mutex Write Update thread)
-    std::mutex resource_mutex; //Sometimes update thread needs to add new resources
+    std::mutex resource_mutex; //Sometimes update thread needs to add new resources. Held by the rendering thread while frames are in flight.
+    std::atomic<bool> resources_requested = false; //Update thread is waiting for resource_mutex, rendering thread should drain its pipeline.
 
-    //Visible object double buffers.(Update thread -> Render thread)
+    //Render proxies of the visible objects, double buffered with a pending frame in between.(Update thread -> Render thread)
     std::mutex visibility_buffer_mutex;
-    std::array<std::unique_ptr<GameObject>,MAX_VISIBLE_OBJECTS> render_buffer{nullptr}; //Contains copies of objects for rendering.(Write Render thread)
-    std::array<GameObject*,MAX_VISIBLE_OBJECTS> update_buffer{nullptr}; //Contains pointers to object cache for updating objects.(Write Update thread & Read mutex Render thread)
-
-    FrameBuffer frame_buffer{WIDTH,HEIGHT,{0,0,0,0}}; //Main frame buffer.(Write Rendering thread)
-    Renderer renderer {WIDTH,HEIGHT}; //Main rendering engine.(Write Rendering thread)
+    std::array<GameObject*,MAX_VISIBLE_OBJECTS> update_buffer{nullptr}; //Contains pointers to object cache for updating objects.(Write Update thread)
+    RenderProxyArena update_frame{}; //Recorded after every update.(Write Update thread)
+    RenderProxyArena pending_frame{}; //Newest recorded frame, not yet picked up.(Mutex Update thread -> Render thread)
+    bool pending_frame_ready = false; //If pending_frame is newer than render_frame.(Mutex Update thread -> Render thread)
+    RenderProxyArena render_frame{}; //Frame being queued for rendering.(Write Render thread)
+
+    //Frame pipeline: the draw list of frame N+2 is built while frame N+1 is rasterized and frame N is presented
+    //Finished frames are written straight into locked window textures, so each frame is only written once
+    std::array<PixelSpan,2> frame_targets{}; //Locked window textures.(Present thread -> Rendering thread)
+    std::array<bool,2> target_ready{false,false}; //If a target is locked and waiting for a frame.(Mutex Present thread -> Rendering thread)
+    std::array<FrameBuffer,2> fallback_frames{FrameBuffer{WIDTH,HEIGHT,{0,0,0,0}},FrameBuffer{WIDTH,HEIGHT,{0,0,0,0}}}; //Written instead if a texture could not be locked.(Write Rendering thread)
+    Renderer renderer {WIDTH,HEIGHT}; //Main rendering engine, double buffers its draw lists.(Write Rendering thread)
+    DynamicResolution resolution{TARGET_FRAME_MS,MIN_RENDER_SCALE}; //Picks the render resolution.(Write Rendering thread)
+    std::ofstream stats_log{}; //Periodic render stats, see STATS_LOG_FILE.(Write Rendering thread)
+    std::mutex present_mutex;
+    std::condition_variable present_condition; //Signals a change of presented_frame, requested_target, or target_ready
+    int presented_frame = -1; //Target waiting to be presented, -1 if none.(Mutex Rendering thread -> Present thread)
+    int requested_target = -1; //Target to lock for the frame being rendered, -1 if none.(Mutex Rendering thread -> Present thread)
+    glm::ivec2 requested_size{WIDTH,HEIGHT}; //Resolution of the requested target.(Mutex Rendering thread -> Present thread)
+    std::atomic<float> aspect_ratio = (float)WIDTH / HEIGHT; //Aspect ratio of the window, sent to the server for culling.(Write Rendering thread & Read Network thread)
 
     std::unordered_map<uint16_t , std::unique_ptr<GameObject>> object_cache{}; //Contains instantiated objects.(Write Update thread)
     Services services{};  //Allows game objects to communicate.(Write Update thread)
@@ -49,10 +74,12 @@ private:
     moodycamel::ReaderWriterQueue<ConnectionManager::RawData> incoming_state_updates{}; //New state updates.(Network thread -> Update thread)
     moodycamel::ReaderWriterQueue<ClientEvents> outgoing_events{}; //New input events.(Update thread -> Network thread)
 
-    std::thread render_thread, network_thead; //Main thread is update thread.
+    std::thread render_thread, present_thread, network_thead; //Main thread is update thread.
 
     //belongs to render thread
     Camera global_camera{90,{0,0,-1},1}; //todo allow aspect ratio to change and update server values
+    SphereBVArray render_bounds{}; //Bounds of the objects in the render frame, culled together
+    std::vector<uint8_t> render_visibility{}; //Frustum culling bitmask of the bounds
 
     /**
      * Manage incoming server messages
@@ -69,6 +96,21 @@ private:
         }
     }
 
+    /**
+     * Set the camera used for culling on the server
+     * @param camera_aspect_ratio Aspect ratio of the window
+     */
+    void sendCamera(float camera_aspect_ratio){
+        ConnectionManager::RawData camera_data;
+        MessageTypeMetaData type_meta_data{CAMERA_CHANGE};
+        addStructToPacket(camera_data, type_meta_data);
+        CameraChange camera_change{camera_aspect_ratio,glm::radians(90.0f)};
+        addStructToPacket(camera_data, camera_change);
+        if(!network.writeTCP(camera_data)){
+            std::cerr << "Server camera set failed \n";
+        };
+    }
+
     /**
      * Wait for incoming state and send out events
      */
@@ -84,18 +126,13 @@ private:
                 //todo retry
             };
         }
-        {   //set camera on server
-            ConnectionManager::RawData camera_data;
-            MessageTypeMetaData type_meta_data{CAMERA_CHANGE};
-            addStructToPacket(camera_data, type_meta_data);
-            CameraChange camera_change{90,1};
-            addStructToPacket(camera_data, camera_change);
-            if(!network.writeTCP(camera_data)){
-                std::cerr << "Server camera set failed \n";
-            };
-
-        }
+        float server_aspect_ratio = aspect_ratio;
+        sendCamera(server_aspect_ratio); //set camera on server
         while(running){
+            if(aspect_ratio != server_aspect_ratio){ //Window was resized
+                server_aspect_ratio = aspect_ratio;
+                sendCamera(server_aspect_ratio);
+            }
 
             //Gather messages
             if(!network.processIncoming([this](bool TCP, const ConnectionManager::RawData& packet_data,ConnectionManager& manager){
@@ -120,44 +157,186 @@ private:
     }
 
     /**
-     * Copy data and render it from the visibility buffer.
+     * Take the newest render proxies and queue them for rendering.
+     * @details The renderer double buffers draw lists, so this can run while the last frame is still rasterizing.
+     * If the update thread has not recorded a new frame, the last one is queued again.
+     * Resource mutex must be held.
+     */
+    void queueFrame(){
+        {
+            std::lock_guard guard(visibility_buffer_mutex);
+            if(pending_frame_ready){
+                std::swap(pending_frame,render_frame);
+                pending_frame_ready = false;
+            }
+        }
+        //set camera
+        glm::ivec2 window_size = window.getSize();
+        float window_aspect_ratio = (float)window_size.x / (float)std::max(window_size.y,1);
+        if(window_aspect_ratio != aspect_ratio){
+            aspect_ratio = window_aspect_ratio;
+            global_camera.updateAspectRatio(window_aspect_ratio);
+        }
+        glm::vec3 new_position, new_look_at;
+        if(render_frame.getCamera(new_position,new_look_at)){
+            global_camera.setPosition(new_position);
+            global_camera.setLookAt(new_look_at);
+        }
+        renderer.setCamera(global_camera);
+
+        //Cull all objects at once
+        render_bounds.clear();
+        for (size_t i = 0; i < render_frame.getObjectCount(); ++i) {
+            render_bounds.push(render_frame.getObject(i).bounds);
+        }
+        render_bounds.inFrustum(global_camera, render_visibility);
+
+        //Queue draw calls
+        for (size_t i = 0; i < render_frame.getObjectCount(); ++i) {
+            if(SphereBVArray::isVisible(render_visibility, i)){
+                render_frame.submit(i,renderer,resource_manager);
+            }
+        }
+    }
+
+    /**
+     * Finish the frame being rasterized into a window texture and hand it to the present thread
+     * @param frame Target to write to, requested when the frame was started
+     */
+    void finishFrame(int frame){
+        {
+            std::unique_lock lock(present_mutex);
+            present_condition.wait(lock,[this,frame](){return target_ready[frame] || !running;});
+            if(!target_ready[frame]){ //Shutting down
+                lock.unlock();
+                renderer.finishRender(fallback_frames[frame]);
+                return;
+            }
+        }
+        renderer.finishRender(frame_targets[frame]);
+        {
+            std::unique_lock lock(present_mutex);
+            present_condition.wait(lock,[this](){return presented_frame == -1 || !running;}); //Last frame has been picked up
+            target_ready[frame] = false;
+            presented_frame = frame;
+        }
+        present_condition.notify_all();
+    }
+
+    /**
+     * Start rasterizing the queued frame and ask the present thread for a target to finish it into
+     * @param frame Target to request
+     */
+    void startFrame(int frame){
+        renderer.startRender();
+        {
+            std::lock_guard lock(present_mutex);
+            requested_target = frame;
+            requested_size = {renderer.getWidth(),renderer.getHeight()};
+        }
+        present_condition.notify_all();
+    }
+
+    /**
+     * Change the render resolution if the window was resized or the frame time is off target
+     * @param frame_ms Time since the last frame finished
+     * @warning No frame may be rendering.
+     */
+    void updateResolution(double frame_ms){
+        resolution.addFrameTime(frame_ms);
+        glm::ivec2 size = resolution.getRenderSize(window.getSize());
+        if(size.x == renderer.getWidth() && size.y == renderer.getHeight()) return;
+        renderer.resize(size.x,size.y);
+        for (FrameBuffer& fallback_frame : fallback_frames) {
+            fallback_frame = FrameBuffer{size.x,size.y,{0,0,0,0}};
+        }
+    }
+
+    /**
+     * Write the stats of the last finished frame to the stats log, if it is time to
+     * @param now Time the frame was finished
+     * @param start Time rendering started, to give each line a timestamp
+     * @param last_log Time of the last logged line, updated if a line is written
+     */
+    void logStats(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point& last_log){
+        if(!stats_log.is_open() || std::chrono::duration<double,std::milli>(now - last_log).count() < STATS_LOG_MS) return;
+        last_log = now;
+        stats_log << std::chrono::duration<double>(now - start).count() << "," << renderer.getWidth() << "," << renderer.getHeight() << "," << renderer.getStats().toCSV() << std::endl; //Flushed, so the log survives a crash
+    }
+
+    /**
+     * Pipeline rendering: queue a frame while the previous one rasterizes and the one before is presented.
      */
     void renderThread(){
+        std::unique_lock resource_lock(resource_mutex); //Resources should not be edited while in use by renderer.
+        int frame = 0; //Target of the next frame to finish
+        auto last_frame = std::chrono::steady_clock::now();
+        auto render_start = last_frame, last_log = last_frame;
+        bool last_frame_reused = false; //If nothing changed in the last finished frame
         while(running) {
-            { //copy data
-                std::lock_guard guard(visibility_buffer_mutex);
-                for (uint32_t i = 0; i < MAX_VISIBLE_OBJECTS; ++i) {
-                    render_buffer[i] = update_buffer[i] == nullptr ? nullptr : update_buffer[i]->copy();
+            if(resources_requested){ //Drain the pipeline so the update thread can add resources
+                if(renderer.isRendering()){
+                    finishFrame(frame);
+                    frame = 1 - frame;
                 }
+                resource_lock.unlock();
+                while(resources_requested && running) std::this_thread::yield();
+                resource_lock.lock();
+                last_frame = std::chrono::steady_clock::now(); //Do not count the wait as frame time
             }
-            {
-                //set camera
-                glm::vec3 new_position = {2,2,2}; //differ default values to avoid nans
-                glm::vec3 new_look_at = {0,0,0};
-                for (uint32_t i = 0; i < MAX_VISIBLE_OBJECTS; ++i) {
-                    if (render_buffer[i] != nullptr) {
-                        if(render_buffer[i]->updateCamera(new_position,new_look_at)){
-                            global_camera.setPosition(new_position);
-                            global_camera.setLookAt(new_look_at);
-                            break;
-                        }
-                    }
+            if(last_frame_reused){ //Wait out the frame instead of spinning on identical frames
+                std::this_thread::sleep_until(last_frame + std::chrono::duration<double,std::milli>(TARGET_FRAME_MS));
+            }
+            queueFrame(); //Overlaps with rasterization of the previous frame
+            if(renderer.isRendering()){
+                finishFrame(frame);
+                frame = 1 - frame;
+                auto now = std::chrono::steady_clock::now();
+                last_frame_reused = renderer.getStats().dirty_tiles == 0;
+                logStats(now, render_start, last_log);
+                if(!last_frame_reused){ //A reused frame says nothing about the render cost
+                    updateResolution(std::chrono::duration<double,std::milli>(now - last_frame).count()); //Time between finished frames, the pipeline throughput
                 }
-                renderer.setCamera(global_camera);
-
-                std::lock_guard guard(resource_mutex); //Resources should not be edited while in use by renderer.
-                //Queue draw calls
-                for (uint32_t i = 0; i < MAX_VISIBLE_OBJECTS; ++i) {
-                    if (render_buffer[i] != nullptr) {
-                        if(render_buffer[i]->getBounds().inFrustum(global_camera)){
-                            render_buffer[i]->render(renderer,resource_manager);
-                        }
-                    }
+                last_frame = now;
+            }
+            startFrame(frame);
+        }
+        if(renderer.isRendering()){
+            renderer.finishRender(fallback_frames[frame]);
+        }
+    }
+
+    /**
+     * Display finished frames, and lock window textures for the rendering thread to write frames into.
+     * @details Owns the window textures, so SDL rendering calls stay on one thread.
+     * One target can be written by the rendering thread while the other is presented.
+     */
+    void presentThread(){
+        while(true) {
+            std::unique_lock lock(present_mutex);
+            present_condition.wait(lock,[this](){return presented_frame != -1 || requested_target != -1 || !running;});
+            if(!running) return;
+            if(requested_target != -1){ //Its last frame was already presented, since this thread does one thing at a time
+                int frame = requested_target;
+                glm::ivec2 size = requested_size;
+                requested_target = -1;
+                lock.unlock();
+                PixelSpan target = window.lockFrame(frame,size.x,size.y);
+                if(target.pixels == nullptr){
+                    target = fallback_frames[frame].getPixelSpan(); //Keep the pipeline going, the frame is just not shown
                 }
-                //Render the image (Still holds pointers to resources)
-                renderer.getResult(frame_buffer);
+                lock.lock();
+                frame_targets[frame] = target;
+                target_ready[frame] = true;
+                lock.unlock();
+                present_condition.notify_all();
+                continue;
             }
-            window.drawFrameBuffer(frame_buffer);
+            int frame = presented_frame;
+            presented_frame = -1;
+            lock.unlock();
+            present_condition.notify_all();
+            window.presentFrame(frame); //Rendering thread is already rasterizing the next frame
         }
     }
 
@@ -171,9 +350,20 @@ public:
     explicit Client(const ConnectionManager::Address& server_address) :network(server_address,8081) {
         //Setup window
         window.setMouseRelative();
+        renderer.setTemporalReuse(true); //Idle frames, like spectating or menus, then cost almost nothing
+        renderer.setStatsOverlay(STATS_OVERLAY);
+        if(STATS_LOG_FILE[0] != '\0'){
+            stats_log.open(STATS_LOG_FILE);
+            if(stats_log){
+                stats_log << "seconds,width,height," << RenderStats::getCSVHeader() << "\n";
+            }else{
+                std::cerr << "Render stats log could not be opened \n";
+            }
+        }
         //Start threads
         network_thead = std::thread(&Client::networkThread, this);
         render_thread = std::thread(&Client::renderThread, this);
+        present_thread = std::thread(&Client::presentThread, this);
 
         //Update thread
 
@@ -196,22 +386,21 @@ public:
                 auto meta_data = extractStructFromPacket<NewObjectMetaData>(new_object_data,sizeof(MessageTypeMetaData));
                 object_cache[meta_data.object_id] = GameObject::instantiateGameObject(meta_data.type_id,new_object_data,sizeof(MessageTypeMetaData) + sizeof(NewObjectMetaData));
                 {
+                    resources_requested = true; //Rendering thread holds the mutex while frames are in flight
                     std::lock_guard guard(resource_mutex);
                     object_cache[meta_data.object_id]->loadResourcesClient(resource_manager, meta_data.is_associated);
+                    resources_requested = false;
                 }
                 object_cache[meta_data.object_id]->registerServices(services);
             }
 
             //update state
-            {
-                std::lock_guard guard(visibility_buffer_mutex);
-                ConnectionManager::RawData new_state;
-                while (incoming_state_updates.try_dequeue(new_state)) {
-                    auto meta_data = extractStructFromPacket<StateMetaData>(new_state, 0);
-                    if (object_cache.find(meta_data.object_id) == object_cache.end()) continue; //Not instantiated yet
-                    object_cache[meta_data.object_id]->deserialize(new_state, sizeof(StateMetaData));
-                    update_buffer[meta_data.buffer_location] = object_cache[meta_data.object_id].get();
-                }
+            ConnectionManager::RawData new_state;
+            while (incoming_state_updates.try_dequeue(new_state)) {
+                auto meta_data = extractStructFromPacket<StateMetaData>(new_state, 0);
+                if (object_cache.find(meta_data.object_id) == object_cache.end()) continue; //Not instantiated yet
+                object_cache[meta_data.object_id]->deserialize(new_state, sizeof(StateMetaData));
+                update_buffer[meta_data.buffer_location] = object_cache[meta_data.object_id].get();
             }
 
             //todo delete server deleted objects
@@ -219,10 +408,30 @@ public:
             //predict
             for (auto &i: update_buffer) {
                 if (i != nullptr) {
-                    std::lock_guard guard(visibility_buffer_mutex);
                     i->predict(delta_time, event, services, resource_manager);
                 }
             }
+
+            //Record render proxies and hand them to the render thread, which never touches the objects themselves
+            update_frame.clear();
+            glm::vec3 camera_position = {2,2,2}; //differ default values to avoid nans
+            glm::vec3 camera_look_at = {0,0,0};
+            for (GameObject* object : update_buffer) {
+                if(object != nullptr && object->updateCamera(camera_position,camera_look_at)){
+                    update_frame.setCamera(camera_position,camera_look_at);
+                    break;
+                }
+            }
+            for (GameObject* object : update_buffer) {
+                if(object == nullptr) continue;
+                update_frame.beginObject(object->getBounds());
+                object->render(update_frame);
+            }
+            {
+                std::lock_guard guard(visibility_buffer_mutex);
+                std::swap(update_frame,pending_frame);
+                pending_frame_ready = true;
+            }
         }
     }
 
@@ -232,8 +441,13 @@ public:
     void stop(){
         if(running){
             running = false;
+            {
+                std::lock_guard lock(present_mutex);
+            }
+            present_condition.notify_all(); //Wake up threads waiting on a frame
             network_thead.join();
             render_thread.join();
+            present_thread.join();
         }
     }
 
@@ -76,9 +76,9 @@ public:
         //nothing
     }
 
-    void render(Renderer& renderer, const ResourceManager& manager) const override {
+    void render(RenderProxyArena& frame) const override {
 
-         //       renderer.queueDraw(manager.readMesh(mesh),glm::translate(glm::orientation(direction,{0,0,1}),position),manager.readTexture(texture));
+         //       frame.queueDraw(mesh,glm::translate(glm::orientation(direction,{0,0,1}),position),texture);
 
     }
     //todo object initialization is somewhat of a network race condition. Add on server such that it gets through.
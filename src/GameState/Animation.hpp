@@ -0,0 +1,331 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANIMATION_SSE
+#endif
+
+/**
+ * Local transforms of every bone of a skeleton
+ * @details Stored as one array per channel, padded to a multiple of four bones, so poses can be sampled and blended four bones at a time.
+ * Padding bones hold the identity transform.
+ */
+struct LocalPose {
+    enum Channel {
+        TRANSLATION_X, TRANSLATION_Y, TRANSLATION_Z,
+        ROTATION_X, ROTATION_Y, ROTATION_Z, ROTATION_W, //Unit quaternion
+        SCALE_X, SCALE_Y, SCALE_Z,
+        CHANNEL_COUNT
+    };
+
+    int bone_count = 0;
+    int stride = 0; //Bones per channel, including padding
+    std::vector<float> channels{}; //CHANNEL_COUNT arrays of stride floats
+
+    /**
+     * Get the padded number of bones per channel
+     * @param bone_count Bones in the skeleton
+     */
+    static int getStride(int bone_count) {
+        return (bone_count + 3) / 4 * 4;
+    }
+
+    /**
+     * Make room for a skeleton, setting every bone to the identity transform if the size changed
+     * @param new_bone_count Bones in the skeleton
+     */
+    void resize(int new_bone_count) {
+        if(new_bone_count == bone_count && !channels.empty()) return;
+        bone_count = new_bone_count;
+        stride = getStride(bone_count);
+        channels.assign((size_t)CHANNEL_COUNT * stride, 0.0f);
+        std::fill_n(getChannel(ROTATION_W), stride, 1.0f);
+        std::fill_n(getChannel(SCALE_X), stride * 3, 1.0f); //Scale channels are next to each other
+    }
+
+    /**
+     * Get the values of a channel for every bone
+     */
+    [[nodiscard]] float* getChannel(Channel channel) {
+        return channels.data() + (size_t)channel * stride;
+    }
+
+    /**
+     * Get the values of a channel for every bone
+     */
+    [[nodiscard]] const float* getChannel(Channel channel) const {
+        return channels.data() + (size_t)channel * stride;
+    }
+
+    /**
+     * Set the local transform of a bone
+     * @param bone Bone index
+     * @param translation,rotation,scale Transform. Rotation must be normalized.
+     */
+    void setBone(int bone, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+        float values[CHANNEL_COUNT] = {translation.x, translation.y, translation.z, rotation.x, rotation.y, rotation.z, rotation.w, scale.x, scale.y, scale.z};
+        for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+            channels[(size_t)channel * stride + bone] = values[channel];
+        }
+    }
+
+    /**
+     * Get the rotation of a bone
+     * @param bone Bone index
+     */
+    [[nodiscard]] glm::quat getRotation(int bone) const {
+        return glm::quat{getChannel(ROTATION_W)[bone], getChannel(ROTATION_X)[bone], getChannel(ROTATION_Y)[bone], getChannel(ROTATION_Z)[bone]};
+    }
+
+    /**
+     * Get the local transform of a bone as a matrix
+     * @param bone Bone index
+     * @return Translation * rotation * scale
+     */
+    [[nodiscard]] glm::mat4 getTransform(int bone) const {
+        glm::mat4 transform = glm::mat4_cast(getRotation(bone));
+        transform[0] *= getChannel(SCALE_X)[bone];
+        transform[1] *= getChannel(SCALE_Y)[bone];
+        transform[2] *= getChannel(SCALE_Z)[bone];
+        transform[3] = glm::vec4(getChannel(TRANSLATION_X)[bone], getChannel(TRANSLATION_Y)[bone], getChannel(TRANSLATION_Z)[bone], 1.0f);
+        return transform;
+    }
+};
+
+/**
+ * Keyframed local transforms of every bone of a skeleton
+ * @details Tracks are resampled to a fixed frame rate when imported, so sampling never searches for keys.
+ * Each frame is stored like a LocalPose, one array per channel.
+ */
+struct AnimationClip {
+    std::string name;
+    float duration = 0; //Seconds
+    float frame_rate = 30; //Keyframes per second
+    int frame_count = 0;
+    LocalPose layout{}; //Bone count and stride of every frame
+    std::vector<float> keys{}; //frame_count frames of LocalPose::CHANNEL_COUNT * stride floats
+
+    /**
+     * Create a clip with every key set to the identity transform
+     * @param name Name of the clip
+     * @param duration Length in seconds
+     * @param frame_rate Keyframes per second
+     * @param bone_count Bones in the skeleton
+     */
+    AnimationClip(const std::string& name, float duration, float frame_rate, int bone_count) : name(name), duration(duration), frame_rate(frame_rate) {
+        frame_count = std::max(2, (int)std::ceil(duration * frame_rate) + 1);
+        layout.resize(bone_count);
+        keys.reserve(layout.channels.size() * frame_count);
+        for (int frame = 0; frame < frame_count; ++frame) {
+            keys.insert(keys.end(), layout.channels.begin(), layout.channels.end());
+        }
+    }
+
+    AnimationClip() = default;
+
+    /**
+     * Get the time of a frame
+     * @param frame Frame index
+     * @return Seconds from the start of the clip
+     */
+    [[nodiscard]] float getFrameTime(int frame) const {
+        return std::min((float)frame / frame_rate, duration);
+    }
+
+    /**
+     * Get the keys of a frame, laid out like LocalPose::channels
+     */
+    [[nodiscard]] const float* getFrame(int frame) const {
+        return keys.data() + (size_t)frame * layout.channels.size();
+    }
+
+    /**
+     * Set the key of a bone
+     * @param frame Frame index. Set frames in order, so each rotation can be flipped to the same hemisphere as the last frame.
+     * @param bone Bone index
+     * @param translation,rotation,scale Local transform of the bone
+     */
+    void setKey(int frame, int bone, const glm::vec3& translation, glm::quat rotation, const glm::vec3& scale) {
+        rotation = glm::normalize(rotation);
+        if(frame > 0){ //q and -q are the same rotation, but only one of them interpolates the short way
+            const float* last = getFrame(frame - 1);
+            int stride = layout.stride;
+            float dot = last[LocalPose::ROTATION_X * stride + bone] * rotation.x + last[LocalPose::ROTATION_Y * stride + bone] * rotation.y +
+                    last[LocalPose::ROTATION_Z * stride + bone] * rotation.z + last[LocalPose::ROTATION_W * stride + bone] * rotation.w;
+            if(dot < 0) rotation = -rotation;
+        }
+        float values[LocalPose::CHANNEL_COUNT] = {translation.x, translation.y, translation.z, rotation.x, rotation.y, rotation.z, rotation.w, scale.x, scale.y, scale.z};
+        float* keys_of_frame = keys.data() + (size_t)frame * layout.channels.size();
+        for (int channel = 0; channel < LocalPose::CHANNEL_COUNT; ++channel) {
+            keys_of_frame[(size_t)channel * layout.stride + bone] = values[channel];
+        }
+    }
+};
+
+/**
+ * Linearly interpolate two arrays
+ * @param a,b Arrays to interpolate. Count must be a multiple of four.
+ * @param weight 0 for a, 1 for b
+ * @param count Number of floats
+ * @param output Where to write. May be a or b.
+ */
+inline void lerpChannels(const float* a, const float* b, float weight, size_t count, float* output) {
+    assert(count % 4 == 0);
+#ifdef ANIMATION_SSE
+    __m128 weights = _mm_set1_ps(weight);
+    for (size_t i = 0; i < count; i += 4) {
+        __m128 start = _mm_loadu_ps(a + i);
+        _mm_storeu_ps(output + i, _mm_add_ps(start, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b + i), start), weights)));
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        output[i] = a[i] + (b[i] - a[i]) * weight;
+    }
+#endif
+}
+
+/**
+ * Normalize the rotations of a pose, after interpolating them
+ * @param pose Pose to normalize, every rotation must be nonzero
+ */
+inline void normalizeRotations(LocalPose& pose) {
+    float* x = pose.getChannel(LocalPose::ROTATION_X);
+    float* y = pose.getChannel(LocalPose::ROTATION_Y);
+    float* z = pose.getChannel(LocalPose::ROTATION_Z);
+    float* w = pose.getChannel(LocalPose::ROTATION_W);
+#ifdef ANIMATION_SSE
+    for (int i = 0; i < pose.stride; i += 4) {
+        __m128 rx = _mm_loadu_ps(x + i), ry = _mm_loadu_ps(y + i), rz = _mm_loadu_ps(z + i), rw = _mm_loadu_ps(w + i);
+        __m128 length_squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)), _mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(rw, rw)));
+        __m128 inverse_length = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length_squared));
+        _mm_storeu_ps(x + i, _mm_mul_ps(rx, inverse_length));
+        _mm_storeu_ps(y + i, _mm_mul_ps(ry, inverse_length));
+        _mm_storeu_ps(z + i, _mm_mul_ps(rz, inverse_length));
+        _mm_storeu_ps(w + i, _mm_mul_ps(rw, inverse_length));
+    }
+#else
+    for (int i = 0; i < pose.stride; ++i) {
+        float inverse_length = 1.0f / sqrtf(x[i]*x[i] + y[i]*y[i] + z[i]*z[i] + w[i]*w[i]);
+        x[i] *= inverse_length;
+        y[i] *= inverse_length;
+        z[i] *= inverse_length;
+        w[i] *= inverse_length;
+    }
+#endif
+}
+
+/**
+ * Sample a clip
+ * @param clip Clip to sample
+ * @param time Seconds from the start of the clip
+ * @param loop Wrap time around the end of the clip, else clamp to the last frame
+ * @param output Local transforms at the time. Resized to the clip's skeleton.
+ * @details Interpolates the two closest frames, normalized linear interpolation for the rotations.
+ */
+inline void sampleClip(const AnimationClip& clip, float time, bool loop, LocalPose& output) {
+    output.resize(clip.layout.bone_count);
+    if(loop && clip.duration > 0){
+        time = std::fmod(time, clip.duration);
+        if(time < 0) time += clip.duration;
+    }
+    float frame = std::clamp(time * clip.frame_rate, 0.0f, (float)(clip.frame_count - 1));
+    int first = std::min((int)frame, clip.frame_count - 2);
+    lerpChannels(clip.getFrame(first), clip.getFrame(first + 1), frame - (float)first, output.channels.size(), output.channels.data());
+    normalizeRotations(output);
+}
+
+/**
+ * Blend two poses of the same skeleton
+ * @param a,b Poses to blend
+ * @param weight 0 for a, 1 for b
+ * @param output Blended pose. May be a or b.
+ * @details Rotations of b are flipped into the hemisphere of a first, so every bone blends the short way around.
+ */
+inline void blendPoses(const LocalPose& a, const LocalPose& b, float weight, LocalPose& output) {
+    assert(a.bone_count == b.bone_count);
+    output.resize(a.bone_count);
+    int stride = a.stride;
+    //Translation is before the rotation, scale after it
+    lerpChannels(a.getChannel(LocalPose::TRANSLATION_X), b.getChannel(LocalPose::TRANSLATION_X), weight, (size_t)stride * 3, output.getChannel(LocalPose::TRANSLATION_X));
+    lerpChannels(a.getChannel(LocalPose::SCALE_X), b.getChannel(LocalPose::SCALE_X), weight, (size_t)stride * 3, output.getChannel(LocalPose::SCALE_X));
+    const float* a_rotation[4] = {a.getChannel(LocalPose::ROTATION_X), a.getChannel(LocalPose::ROTATION_Y), a.getChannel(LocalPose::ROTATION_Z), a.getChannel(LocalPose::ROTATION_W)};
+    const float* b_rotation[4] = {b.getChannel(LocalPose::ROTATION_X), b.getChannel(LocalPose::ROTATION_Y), b.getChannel(LocalPose::ROTATION_Z), b.getChannel(LocalPose::ROTATION_W)};
+    float* output_rotation[4] = {output.getChannel(LocalPose::ROTATION_X), output.getChannel(LocalPose::ROTATION_Y), output.getChannel(LocalPose::ROTATION_Z), output.getChannel(LocalPose::ROTATION_W)};
+#ifdef ANIMATION_SSE
+    __m128 weights = _mm_set1_ps(weight);
+    for (int i = 0; i < stride; i += 4) {
+        __m128 start[4], end[4];
+        __m128 dot = _mm_setzero_ps();
+        for (int c = 0; c < 4; ++c) {
+            start[c] = _mm_loadu_ps(a_rotation[c] + i);
+            end[c] = _mm_loadu_ps(b_rotation[c] + i);
+            dot = _mm_add_ps(dot, _mm_mul_ps(start[c], end[c]));
+        }
+        __m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f)); //Sign bit where the dot product is negative
+        for (int c = 0; c < 4; ++c) {
+            __m128 flipped = _mm_xor_ps(end[c], flip);
+            _mm_storeu_ps(output_rotation[c] + i, _mm_add_ps(start[c], _mm_mul_ps(_mm_sub_ps(flipped, start[c]), weights)));
+        }
+    }
+#else
+    for (int i = 0; i < stride; ++i) {
+        float dot = 0;
+        for (int c = 0; c < 4; ++c) dot += a_rotation[c][i] * b_rotation[c][i];
+        float sign = dot < 0 ? -1.0f : 1.0f;
+        for (int c = 0; c < 4; ++c) {
+            output_rotation[c][i] = a_rotation[c][i] + (b_rotation[c][i] * sign - a_rotation[c][i]) * weight;
+        }
+    }
+#endif
+    normalizeRotations(output);
+}
+
+/**
+ * Bone hierarchy of a skinned mesh, flattened so every parent comes before its children
+ * @details Global transforms are then a single pass over the bones, without recursion or child lists.
+ */
+struct Skeleton {
+    std::vector<int> parents{}; //Parent of each bone, always a lower index. -1 for roots.
+    std::vector<int> mesh_bones{}; //Index of each bone in the skinned mesh bone palette
+    std::vector<glm::mat4> inverse_bind{}; //Mesh space to bone space in the bind pose
+    glm::mat4 root_transform = glm::identity<glm::mat4>(); //Parent transform of the roots, such as the armature
+    LocalPose bind_pose{}; //Local transforms the mesh was modeled in
+
+    /**
+     * Get the number of bones
+     */
+    [[nodiscard]] int getBoneCount() const {
+        return (int)parents.size();
+    }
+
+    /**
+     * Compute the global transforms of a pose
+     * @param pose Local transforms of the bones
+     * @param global_transforms Output transform of each bone relative to the mesh, in skeleton order. Must fit getBoneCount().
+     */
+    void computeGlobalTransforms(const LocalPose& pose, glm::mat4* global_transforms) const {
+        assert(pose.bone_count == getBoneCount());
+        for (int i = 0; i < getBoneCount(); ++i) {
+            global_transforms[i] = (parents[i] < 0 ? root_transform : global_transforms[parents[i]]) * pose.getTransform(i); //Parent is already done
+        }
+    }
+
+    /**
+     * Compute the bone palette to deform a skinned mesh with
+     * @param global_transforms Global transforms from computeGlobalTransforms()
+     * @param palette Output matrix of each mesh bone, see Renderer::queueSkinnedDraw(). Must fit getBoneCount().
+     */
+    void computeSkinningMatrices(const glm::mat4* global_transforms, glm::mat4* palette) const {
+        for (int i = 0; i < getBoneCount(); ++i) {
+            palette[mesh_bones[i]] = global_transforms[i] * inverse_bind[i];
+        }
+    }
+};
@@ -320,22 +320,20 @@ public:
         return false;
     }
 
-    void render(Renderer &renderer, const ResourceManager &resource_manager) const override {
+    void render(RenderProxyArena& frame) const override {
         for (int i = 0; i < 4; ++i) {
+            glm::mat4 wheel_transform = body_transform * glm::translate(glm::identity<glm::mat4>(), wheels[i].local_position) * glm::rotate(glm::identity<glm::mat4>(),wheels[i].angle, upward)  *  glm::rotate(glm::identity<glm::mat4>(), wheels[i].spin , side);
             if(wheels[i].flip){
-                renderer.queueDraw(resource_manager.readMesh(mesh_wheel),body_transform * glm::translate(glm::identity<glm::mat4>(), wheels[i].local_position)  * glm::rotate(glm::identity<glm::mat4>(),wheels[i].angle, upward) * glm::rotate(glm::identity<glm::mat4>(), wheels[i].spin , side) * glm::scale(glm::identity<glm::mat4>(), {-1, 1, 1}), resource_manager.readTexture(test_texture));
-            }else{
-                renderer.queueDraw(resource_manager.readMesh(mesh_wheel), body_transform * glm::translate(glm::identity<glm::mat4>(), wheels[i].local_position) * glm::rotate(glm::identity<glm::mat4>(),wheels[i].angle, upward)  *  glm::rotate(glm::identity<glm::mat4>(), wheels[i].spin , side) , resource_manager.readTexture(test_texture));
+                wheel_transform = wheel_transform * glm::scale(glm::identity<glm::mat4>(), {-1, 1, 1});
             }
-
+            frame.queueDraw(mesh_wheel, wheel_transform, test_texture); //Batched into one instanced draw call by the renderer
         }
-        renderer.queueDraw(resource_manager.readMesh(mesh_main), body_transform, resource_manager.readTexture(test_texture));
+        frame.queueDraw(mesh_main, body_transform, test_texture);
     }
 
     SphereBV getBounds() const override {
         //todo server culling
         //todo indices and map culling, also clean up physics mesh
-        //todo partial transparency with blending buffer
         //todo cube maps
         return SphereBV{shared_state.position,2.0f};
     }
@@ -17,21 +17,27 @@ class GameMap : public GameObjectImpl<GameMap,MapArgs,MapState>{
     uint16_t mesh;
     uint16_t physics_mesh;
     uint16_t texture;
+    uint16_t visibility;
+    uint16_t lightmap;
 public:
     void loadResourcesClient(ResourceManager &manager, bool associated) override {
-        mesh = manager.getMesh("vehicle_game/map.obj",ResourceManager::OBJ);
+        mesh = manager.getMesh("vehicle_game/map.obj",ResourceManager::OBJ,false); //Drawn with its visible set, so always at full detail
         physics_mesh =  manager.getPhysicsMesh(mesh);
         texture = manager.getTexture("vehicle_game/map_texture.png");
+        visibility = manager.getVisibility("vehicle_game/map.pvs",mesh);
+        lightmap = manager.getLightmap("vehicle_game/map.lightmap",mesh); //Baked with OVEN
 
     }
 
     void loadResourcesServer(ResourceManager &manager) override {
-        mesh = manager.getMesh("vehicle_game/map.obj",ResourceManager::OBJ);
+        mesh = manager.getMesh("vehicle_game/map.obj",ResourceManager::OBJ,false); //Drawn with its visible set, so always at full detail
         physics_mesh =  manager.getPhysicsMesh(mesh);
+        visibility = manager.getVisibility("vehicle_game/map.pvs",mesh);
     }
 
     void registerServices(Services &services) override {
        services.map_service.registerMap(physics_mesh);
+       services.map_service.registerVisibility(visibility);
     }
 
     void deRegisterServices(Services &services) override {
@@ -47,8 +53,8 @@ public:
     }
 
 
-    void render(Renderer& renderer, const ResourceManager& manager) const override {
-            renderer.queueDraw(manager.readMesh(mesh),glm::identity<glm::mat4>(),manager.readTexture(texture));
+    void render(RenderProxyArena& frame) const override {
+            frame.queueDraw(mesh,glm::identity<glm::mat4>(),texture,visibility,lightmap);
     }
 
     bool updateCamera(glm::vec3 &position, glm::vec3 &look_at) const override{
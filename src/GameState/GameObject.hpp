@@ -7,6 +7,7 @@
 #include <memory>
 #include <typeindex>
 #include "../Renderer/Renderer.hpp"
+#include "RenderProxy.hpp"
 #include "../Physics/SphereBV.hpp"
 #include "../Services/Services.hpp"
 #include "../Loaders/ResourceManager.hpp"
@@ -139,12 +140,12 @@ public:
     virtual void updateServices(Services& services) const = 0;
 
     /**
-     * Use this to render your object every frame using queueDraw() or queueDrawSkinned().
-     * @warning No game state should be changed here. This is read-only,for thread safety reasons.
-     * @param renderer The renderer to render your meshes with.
-     * @param resource_manager Use this to access meshes and textures.
+     * Use this to render your object every frame using queueDraw() or queueSkinnedDraw().
+     * @details Runs on the update thread. The packets are replayed on the render thread, so only resource ids and transforms are recorded.
+     * @warning No game state should be changed here. This is read-only.
+     * @param frame The arena to record your draw calls in. The object has already been begun with its bounds.
      */
-    virtual void render( Renderer& renderer, const ResourceManager& resource_manager) const = 0;
+    virtual void render(RenderProxyArena& frame) const = 0;
 
     /**
      * Get bounding-sphere of this object for ray casting and culling.
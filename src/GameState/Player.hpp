@@ -153,11 +153,11 @@ public:
         //nothing
     }
 
-    void render(Renderer& renderer, const ResourceManager& manager) const override {
+    void render(RenderProxyArena& frame) const override {
             if(main_player){
-                renderer.setCamera(camera);
+                frame.setCamera(camera.getPosition(),camera.getLookAt());
             }else{
-                renderer.queueDraw(manager.readMesh(mesh),glm::translate(glm::identity<glm::mat4>(),position)* glm::rotate(glm::orientation(glm::vec3 {direction.x,direction.y,direction.z},{0,1,0}), 3.1415f/2.0f, {0,0,-1}),manager.readTexture(texture));
+                frame.queueDraw(mesh,glm::translate(glm::identity<glm::mat4>(),position)* glm::rotate(glm::orientation(glm::vec3 {direction.x,direction.y,direction.z},{0,1,0}), 3.1415f/2.0f, {0,0,-1}),texture);
             }
     }
   
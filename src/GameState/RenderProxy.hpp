@@ -0,0 +1,179 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <glm/glm.hpp>
+#include "../Renderer/Renderer.hpp"
+#include "../Physics/SphereBV.hpp"
+#include "../Loaders/ResourceManager.hpp"
+
+/**
+ * A single draw call of a game object, stored by resource id
+ */
+struct RenderPacket {
+    enum Type : uint8_t {
+        MESH, //Renderer::queueDraw()
+        SKINNED_MESH, //Renderer::queueSkinnedDraw(), with a bone palette in the arena
+        BLENDED_MESH //Renderer::queueDrawBlended()
+    };
+    Type type;
+    bool has_visibility; //If the mesh has a precomputed visible set
+    bool has_lightmap; //If the mesh has baked lighting
+    ResourceManager::ResourceID mesh;
+    ResourceManager::ResourceID texture;
+    ResourceManager::ResourceID visibility;
+    ResourceManager::ResourceID lightmap;
+    uint32_t bone_offset; //Start of the bone palette in the arena, for skinned meshes
+    glm::mat4 transform;
+};
+
+/**
+ * The render state of one game object for one frame
+ */
+struct RenderProxy {
+    SphereBV bounds; //Used for culling all of the object's packets
+    uint32_t packet_offset; //First packet of the object in the arena
+    uint32_t packet_count;
+};
+
+/**
+ * Draw calls of all visible game objects for one frame, recorded on the update thread and replayed on the render thread
+ * @details Only holds plain data, so handing a frame to the render thread never copies game objects.
+ * Cleared rather than freed between frames, so it stops allocating once it has grown to the size of a frame.
+ */
+class RenderProxyArena {
+private:
+    std::vector<RenderProxy> proxies{};
+    std::vector<RenderPacket> packets{};
+    std::vector<glm::mat4> bones{}; //Bone palettes of skinned packets
+    bool has_camera = false;
+    glm::vec3 camera_position{2,2,2}; //Differ default values to avoid nans
+    glm::vec3 camera_look_at{0,0,0};
+
+    /**
+     * Add a packet to the current object
+     */
+    void addPacket(const RenderPacket& packet){
+        assert(!proxies.empty()); //beginObject() must be called first
+        packets.push_back(packet);
+        proxies.back().packet_count++;
+    }
+
+public:
+
+    /**
+     * Remove everything, keeping the memory
+     */
+    void clear(){
+        proxies.clear();
+        packets.clear();
+        bones.clear();
+        has_camera = false;
+    }
+
+    /**
+     * Start recording a new game object, the packets queued until the next call belong to it
+     * @param bounds Bounding sphere of the object, see GameObject::getBounds()
+     */
+    void beginObject(const SphereBV& bounds){
+        proxies.push_back(RenderProxy{bounds,(uint32_t)packets.size(),0});
+    }
+
+    /**
+     * Set the camera of the frame. Later calls replace earlier ones.
+     * @param position Position of the camera
+     * @param look_at Point the camera looks at
+     */
+    void setCamera(const glm::vec3& position, const glm::vec3& look_at){
+        has_camera = true;
+        camera_position = position;
+        camera_look_at = look_at;
+    }
+
+    /**
+     * Get the camera of the frame
+     * @param position,look_at Output camera. Unchanged if no camera was set.
+     * @return True if a camera was set
+     */
+    bool getCamera(glm::vec3& position, glm::vec3& look_at) const {
+        if(!has_camera) return false;
+        position = camera_position;
+        look_at = camera_look_at;
+        return true;
+    }
+
+    /**
+     * Queue a mesh for the current object
+     * @see Renderer::queueDraw()
+     */
+    void queueDraw(ResourceManager::ResourceID mesh, const glm::mat4& transform, ResourceManager::ResourceID texture){
+        addPacket(RenderPacket{RenderPacket::MESH,false,false,mesh,texture,0,0,0,transform});
+    }
+
+    /**
+     * Queue a mesh with precomputed visibility and baked lighting for the current object
+     * @see Renderer::queueDraw()
+     */
+    void queueDraw(ResourceManager::ResourceID mesh, const glm::mat4& transform, ResourceManager::ResourceID texture, ResourceManager::ResourceID visibility, ResourceManager::ResourceID lightmap){
+        addPacket(RenderPacket{RenderPacket::MESH,true,true,mesh,texture,visibility,lightmap,0,transform});
+    }
+
+    /**
+     * Queue a mesh that is blended by its texture alpha for the current object
+     * @see Renderer::queueDrawBlended()
+     */
+    void queueDrawBlended(ResourceManager::ResourceID mesh, const glm::mat4& transform, ResourceManager::ResourceID texture){
+        addPacket(RenderPacket{RenderPacket::BLENDED_MESH,false,false,mesh,texture,0,0,0,transform});
+    }
+
+    /**
+     * Queue a skinned mesh for the current object
+     * @param palette Pose to deform the mesh with, copied into the arena
+     * @see Renderer::queueSkinnedDraw()
+     */
+    void queueSkinnedDraw(ResourceManager::ResourceID mesh, const glm::mat4& transform, ResourceManager::ResourceID texture, const std::vector<glm::mat4>& palette){
+        addPacket(RenderPacket{RenderPacket::SKINNED_MESH,false,false,mesh,texture,0,0,(uint32_t)bones.size(),transform});
+        bones.insert(bones.end(),palette.begin(),palette.end());
+    }
+
+    /**
+     * Get the number of recorded objects
+     */
+    [[nodiscard]] size_t getObjectCount() const {
+        return proxies.size();
+    }
+
+    /**
+     * Get the render state of a recorded object
+     * @param index Object index, in the order they were begun
+     */
+    [[nodiscard]] const RenderProxy& getObject(size_t index) const {
+        return proxies[index];
+    }
+
+    /**
+     * Queue the draw calls of a recorded object
+     * @param index Object index, in the order they were begun
+     * @param renderer Renderer to queue to
+     * @param manager Manager the resource ids are from
+     */
+    void submit(size_t index, Renderer& renderer, const ResourceManager& manager) const {
+        const RenderProxy& proxy = proxies[index];
+        for (uint32_t i = proxy.packet_offset; i < proxy.packet_offset + proxy.packet_count; ++i) {
+            const RenderPacket& packet = packets[i];
+            switch (packet.type) {
+                case RenderPacket::MESH:
+                    renderer.queueDraw(manager.readMesh(packet.mesh),packet.transform,manager.readTexture(packet.texture),
+                                       packet.has_visibility ? manager.readVisibility(packet.visibility) : nullptr,packet.has_lightmap ? manager.readTexture(packet.lightmap) : nullptr);
+                    break;
+                case RenderPacket::SKINNED_MESH:
+                    renderer.queueSkinnedDraw(manager.readSkinnedMesh(packet.mesh),packet.transform,manager.readTexture(packet.texture),bones.data() + packet.bone_offset);
+                    break;
+                case RenderPacket::BLENDED_MESH:
+                    renderer.queueDrawBlended(manager.readMesh(packet.mesh),packet.transform,manager.readTexture(packet.texture));
+                    break;
+            }
+        }
+    }
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * Write an unsigned integer in little endian byte order
+ * @param file Stream to write to
+ * @param value Value to write
+ * @param bytes Width of the field in the file, 1-8
+ * @details Precomputed files are written field by field, so they do not depend on struct padding or the byte order of the machine.
+ */
+inline void writeUInt(std::ostream& file, uint64_t value, int bytes){
+    char buffer[8];
+    for (int i = 0; i < bytes; ++i) {
+        buffer[i] = (char)((value >> (i * 8)) & 0xFF);
+    }
+    file.write(buffer, bytes);
+}
+
+/**
+ * Read an unsigned integer written by writeUInt()
+ * @param file Stream to read from. Check its state for errors.
+ * @param bytes Width of the field in the file, 1-8
+ * @return Value, or zero if the read failed
+ */
+inline uint64_t readUInt(std::istream& file, int bytes){
+    unsigned char buffer[8] = {};
+    if(!file.read(reinterpret_cast<char*>(buffer), bytes)) return 0;
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value |= (uint64_t)buffer[i] << (i * 8);
+    }
+    return value;
+}
+
+/**
+ * Write a float as its 32-bit pattern in little endian byte order
+ */
+inline void writeFloat(std::ostream& file, float value){
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    writeUInt(file, bits, 4);
+}
+
+/**
+ * Read a float written by writeFloat()
+ * @param file Stream to read from. Check its state for errors.
+ */
+inline float readFloat(std::istream& file){
+    auto bits = (uint32_t)readUInt(file, 4);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * Write an array of unsigned integers in little endian byte order
+ * @tparam T Unsigned integer type, written with its own width
+ * @param file Stream to write to
+ * @param values,count Values to write
+ * @details Converted in one buffer, so large arrays are a single write.
+ */
+template<typename T> void writeUIntArray(std::ostream& file, const T* values, size_t count){
+    std::vector<char> buffer(count * sizeof(T));
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t byte = 0; byte < sizeof(T); ++byte) {
+            buffer[i * sizeof(T) + byte] = (char)(((uint64_t)values[i] >> (byte * 8)) & 0xFF);
+        }
+    }
+    file.write(buffer.data(), (std::streamsize)buffer.size());
+}
+
+/**
+ * Read an array of unsigned integers written by writeUIntArray()
+ * @tparam T Unsigned integer type, read with its own width
+ * @param file Stream to read from. Check its state for errors.
+ * @param values,count Where to read to
+ */
+template<typename T> void readUIntArray(std::istream& file, T* values, size_t count){
+    std::vector<unsigned char> buffer(count * sizeof(T));
+    if(!file.read(reinterpret_cast<char*>(buffer.data()), (std::streamsize)buffer.size())) return;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t value = 0;
+        for (size_t byte = 0; byte < sizeof(T); ++byte) {
+            value |= (uint64_t)buffer[i * sizeof(T) + byte] << (byte * 8);
+        }
+        values[i] = (T)value;
+    }
+}
@@ -8,6 +8,7 @@
 #include "../Renderer/SkinnedMesh.hpp"
 #include "ufbx/ufbx.h"
 #include "../Renderer/Mesh.hpp"
+#include "VertexWelder.hpp"
 #include <algorithm>
 #include <glm/gtc/type_ptr.hpp>
 #include "glm/gtc/quaternion.hpp"
@@ -32,6 +33,92 @@ size_t recurseBones(ufbx_scene* scene, std::vector<Pose::Bone> & animation_data,
 }
 
 
+/**
+ * Keyframes per second animation tracks are resampled to
+ */
+const float ANIMATION_IMPORT_RATE = 30.0f;
+
+/**
+ * Convert a ufbx matrix to glm
+ */
+glm::mat4 toGLM(const ufbx_matrix& matrix){
+    glm::mat4 output = glm::identity<glm::mat4>();
+    for (int c = 0; c < 4; ++c) {
+        output[c] = glm::vec4((float)matrix.cols[c].x, (float)matrix.cols[c].y, (float)matrix.cols[c].z, c == 3 ? 1.0f : 0.0f);
+    }
+    return output;
+}
+
+/**
+ * Flatten the bones of a skinned mesh into a skeleton, and import the animation stacks of the scene
+ * @param scene Scene
+ * @param bones Bones from recurseBones(), in mesh palette order with the root last
+ * @param mesh_node Node of the skinned mesh, vertices are in its geometry space. Nullptr if unknown.
+ * @param output_mesh Mesh to set the skeleton and clips of
+ * @details Each clip is the first layer of an animation stack, resampled to ANIMATION_IMPORT_RATE. The transform above the root bone is not animated.
+ */
+void loadSkeleton(ufbx_scene* scene, const std::vector<Pose::Bone>& bones, const ufbx_node* mesh_node, SkinnedMesh& output_mesh){
+    int bone_count = (int)bones.size();
+    std::vector<const ufbx_node*> nodes(bone_count);
+    std::vector<int> mesh_parents(bone_count, -1);
+    for (int i = 0; i < bone_count; ++i) {
+        nodes[i] = ufbx_as_node(scene->elements[bones[i].element_id]);
+        for (int child : bones[i].children) {
+            mesh_parents[child] = i;
+        }
+    }
+    //Breadth first from the root, so parents come before their children
+    std::vector<int> order{bone_count - 1};
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (int child : bones[order[i]].children) {
+            order.push_back(child);
+        }
+    }
+    std::vector<int> skeleton_index(bone_count);
+    for (int i = 0; i < bone_count; ++i) {
+        skeleton_index[order[i]] = i;
+    }
+
+    Skeleton& skeleton = output_mesh.skeleton;
+    glm::mat4 mesh_to_world = mesh_node != nullptr ? toGLM(mesh_node->geometry_to_world) : glm::identity<glm::mat4>();
+    const ufbx_node* root = nodes[order[0]];
+    skeleton.root_transform = glm::inverse(mesh_to_world) * (root->parent != nullptr ? toGLM(root->parent->node_to_world) : glm::identity<glm::mat4>());
+    skeleton.bind_pose.resize(bone_count);
+    for (int i = 0; i < bone_count; ++i) {
+        const ufbx_transform& local = nodes[order[i]]->local_transform;
+        skeleton.parents.push_back(mesh_parents[order[i]] < 0 ? -1 : skeleton_index[mesh_parents[order[i]]]);
+        skeleton.mesh_bones.push_back(order[i]);
+        skeleton.bind_pose.setBone(i, {local.translation.x, local.translation.y, local.translation.z},
+                                   glm::normalize(glm::quat((float)local.rotation.w, (float)local.rotation.x, (float)local.rotation.y, (float)local.rotation.z)), {local.scale.x, local.scale.y, local.scale.z});
+    }
+    std::vector<glm::mat4> bind_transforms(bone_count);
+    skeleton.computeGlobalTransforms(skeleton.bind_pose, bind_transforms.data());
+    for (int i = 0; i < bone_count; ++i) {
+        glm::mat4 inverse_bind = glm::inverse(bind_transforms[i]); //Bones without vertices
+        for (size_t c = 0; c < scene->skin_clusters.count; ++c) {
+            if(scene->skin_clusters[c]->bone_node == nodes[order[i]]){
+                inverse_bind = toGLM(scene->skin_clusters[c]->geometry_to_bone);
+                break;
+            }
+        }
+        skeleton.inverse_bind.push_back(inverse_bind);
+    }
+
+    for (size_t i = 0; i < scene->anim_stacks.count; ++i) {
+        const ufbx_anim_stack* stack = scene->anim_stacks[i];
+        AnimationClip clip{stack->name.data, (float)(stack->time_end - stack->time_begin), ANIMATION_IMPORT_RATE, bone_count};
+        for (int frame = 0; frame < clip.frame_count; ++frame) {
+            double time = stack->time_begin + clip.getFrameTime(frame);
+            for (int bone = 0; bone < bone_count; ++bone) {
+                ufbx_transform transform = ufbx_evaluate_transform(&stack->anim, nodes[order[bone]], time);
+                clip.setKey(frame, bone, {transform.translation.x, transform.translation.y, transform.translation.z},
+                            glm::quat((float)transform.rotation.w, (float)transform.rotation.x, (float)transform.rotation.y, (float)transform.rotation.z),
+                            {transform.scale.x, transform.scale.y, transform.scale.z});
+            }
+        }
+        output_mesh.clips.push_back(std::move(clip));
+    }
+}
 
 /**
  * Load a FBX file using UFBX
@@ -40,10 +127,11 @@ size_t recurseBones(ufbx_scene* scene, std::vector<Pose::Bone> & animation_data,
  * @param filepath Location of FBX
  * @param texture_id Texture id to assign to mesh
  * Returns empty mesh on failure
- * @return Mesh
+ * @return Indexed mesh. Identical vertices are welded together.
  */
 Mesh loadFBX(const std::string& filepath){
     Mesh output_mesh{};
+    VertexWelder<Vertex> welder;
 
     ufbx_error error;
     ufbx_scene *scene = ufbx_load_file(filepath.c_str(), nullptr, &error);
@@ -63,25 +151,25 @@ Mesh loadFBX(const std::string& filepath){
             ufbx_triangulate_face(tri_indices,indices_count,mesh,face);
             //for each triangle
             for (size_t k = 0; k < indices_count / 3; ++k) {
-                Triangle triangle{};
                 //for each vertex
                 for (int v = 0; v < 3; ++v) {
                     auto index = tri_indices[k*3+v];
-                    triangle.pos[v] = {mesh->vertex_position[index].x, mesh->vertex_position[index].y, mesh->vertex_position[index].z, 1.0};
+                    Vertex vertex{};
+                    vertex.pos = {mesh->vertex_position[index].x, mesh->vertex_position[index].y, mesh->vertex_position[index].z};
                     if(mesh->vertex_normal.exists){
-                        triangle.norm[v] = {mesh->vertex_normal[index].x, mesh->vertex_normal[index].y, mesh->vertex_normal[index].z};
+                        vertex.norm = {mesh->vertex_normal[index].x, mesh->vertex_normal[index].y, mesh->vertex_normal[index].z};
                     }else{
-                        triangle.norm[v] = {0,0,0};
+                        vertex.norm = {0,0,0};
                         //todo auto generate normals
                     }
                     if(mesh->vertex_uv.exists){
-                        triangle.tex[v] = {mesh->vertex_uv[index].x, 1.0-mesh->vertex_uv[index].y}; //flip
+                        vertex.tex = {mesh->vertex_uv[index].x, 1.0-mesh->vertex_uv[index].y}; //flip
                     }else{
-                        std::cout << "UBFX Warning: " << "Missing UVs" << "\n";
-                        triangle.tex[v] = {0,0};
+                        std::cerr << "UBFX Warning: " << "Missing UVs" << "\n";
+                        vertex.tex = {0,0};
                     }
+                    output_mesh.indices.push_back(welder.add(vertex,output_mesh.vertices));
                 }
-                output_mesh.tris.push_back(triangle);
             }
             delete[] tri_indices;
         }
@@ -97,12 +185,13 @@ Mesh loadFBX(const std::string& filepath){
  * Only use this for animated meshes. Make sure that there is one main root node that all other bones are directly or indirectly parented to. If there are multiple roots, some bones may be missing.
  * @param filepath Location of FBX
  * @param texture_id Texture id to assign to mesh
- * @return Skinned mesh with default pose
- * Currently only loads skeleton,animation is not yet supported
+ * @return Indexed skinned mesh with default pose. Identical vertices are welded together.
+ * Also loads the flattened skeleton and the animation clips, see loadSkeleton()
  * Returns empty mesh on failure
  */
 SkinnedMesh loadFBXSkinned(const std::string& filepath){
     SkinnedMesh output_mesh{};
+    VertexWelder<SkinnedVertex> welder;
 
     ufbx_error error;
     ufbx_scene *scene = ufbx_load_file(filepath.c_str(), nullptr, &error);
@@ -120,33 +209,9 @@ SkinnedMesh loadFBXSkinned(const std::string& filepath){
         output_mesh.animations.emplace_back(default_animation);
     }
 
-    //Load animations
-    //todo finish animation loader
-    /*
-    for (int i = 0; i < scene->anim_stacks.count; ++i) {
-        std::vector<Animation::Bone> animation = default_animation; //copy bone layout
-        auto animation_stack = scene->anim_stacks[i];
-        float duration = animation_stack->time_end - animation_stack->time_begin;
-        if(animation_stack->layers.count == 0) continue;
-        auto animation_layer = animation_stack->layers[0];
-        for (int j = 0; j < animation_layer->anim_props.count; ++j) {
-            auto bone_animation = animation_layer->anim_props[j];
-            auto element_id = bone_animation.element->element_id;
-            auto property = bone_animation.prop_name;
-            auto keyframes_x = bone_animation.anim_value->curves[0]->keyframes;
-            auto keyframes_y = bone_animation.anim_value->curves[1]->keyframes;
-            auto keyframes_z = bone_animation.anim_value->curves[2]->keyframes;
-            if(std::string(property.data) == "LclTranslation "){
-                for (int l = 0; l < keyframes_x.count; ++l) {
-                    bone_animation.
-                }
-            }
-        }
-
-
-        output_mesh.animations.emplace_back(duration,animation);
-
-    }*/
+    if(!default_animation.empty()){
+        loadSkeleton(scene, default_animation, scene->meshes.count > 0 && scene->meshes[0]->instances.count > 0 ? scene->meshes[0]->instances[0] : nullptr, output_mesh);
+    }
 
     //Collect mesh data
     for (size_t  i = 0; i < scene->meshes.count; ++i) {
@@ -159,27 +224,27 @@ SkinnedMesh loadFBXSkinned(const std::string& filepath){
             ufbx_triangulate_face(tri_indices,indices_count,mesh,face);
             //for each triangle
             for (size_t k = 0; k < indices_count / 3; ++k) {
-                Triangle triangle{};
-                SkinnedTriangle skinned_triangle{};
                 //for each vertex
                 for (int v = 0; v < 3; ++v) {
                     auto index = tri_indices[k*3+v];
-                    triangle.pos[v] = {mesh->vertex_position[index].x, mesh->vertex_position[index].y, mesh->vertex_position[index].z, 1.0};
+                    SkinnedVertex skinned_vertex{};
+                    Vertex& vertex = skinned_vertex.vertex;
+                    vertex.pos = {mesh->vertex_position[index].x, mesh->vertex_position[index].y, mesh->vertex_position[index].z};
                     if(mesh->vertex_normal.exists){
-                        triangle.norm[v] = {mesh->vertex_normal[index].x, mesh->vertex_normal[index].y, mesh->vertex_normal[index].z};
+                        vertex.norm = {mesh->vertex_normal[index].x, mesh->vertex_normal[index].y, mesh->vertex_normal[index].z};
                     }else{
-                        triangle.norm[v] = {0,0,0};
+                        vertex.norm = {0,0,0};
                     }
                     if(mesh->vertex_uv.exists){
-                        triangle.tex[v] = {mesh->vertex_uv[index].x, 1.0-mesh->vertex_uv[index].y};
+                        vertex.tex = {mesh->vertex_uv[index].x, 1.0-mesh->vertex_uv[index].y};
                     }else{
-                        std::cout << "UBFX Warning: " << "Missing UVs" << "\n";
-                        triangle.tex[v] = {0,0};
+                        std::cerr << "UBFX Warning: " << "Missing UVs" << "\n";
+                        vertex.tex = {0,0};
                     }
 
                     //Reset weights
                     for (int l = 0; l < MAX_BONES_PER_VERTEX; ++l) {
-                        skinned_triangle.bone_ids[v][l] = -1;
+                        skinned_vertex.bone_ids[l] = -1;
                     }
 
 
@@ -190,22 +255,21 @@ SkinnedMesh loadFBXSkinned(const std::string& filepath){
                             auto wieght_index = skin_vertex.weight_begin + h;
                             auto weight = bone->weights[wieght_index];
                             for (int m = 0; m < MAX_BONES_PER_VERTEX; ++m) { //Find open bone or less important bone to replace in the vertex
-                                if(skinned_triangle.bone_ids[v][m] == -1 || skinned_triangle.weights[v][m] < weight.weight){
+                                if(skinned_vertex.bone_ids[m] == -1 || skinned_vertex.weights[m] < weight.weight){
                                     uint32_t element_id = bone->clusters[weight.cluster_index]->bone_node->element_id;
                                     if(std::find_if(default_animation.begin(), default_animation.end(), [&element_id](const Pose::Bone& other_bone){return other_bone.element_id == element_id;}) != default_animation.end()){
-                                        skinned_triangle.bone_ids[v][m] = (int)(std::find_if(default_animation.begin(), default_animation.end(), [&element_id](const Pose::Bone& other_bone){return other_bone.element_id == element_id;}) - default_animation.begin());
+                                        skinned_vertex.bone_ids[m] = (int)(std::find_if(default_animation.begin(), default_animation.end(), [&element_id](const Pose::Bone& other_bone){return other_bone.element_id == element_id;}) - default_animation.begin());
                                     }else{
-                                        skinned_triangle.bone_ids[v][m] = -1;
+                                        skinned_vertex.bone_ids[m] = -1;
                                     }
-                                    skinned_triangle.weights[v][m] = (float)weight.weight;
+                                    skinned_vertex.weights[m] = (float)weight.weight;
                                     break;
                                 }
                             }
                         }
                     }
+                    output_mesh.indices.push_back(welder.add(skinned_vertex,output_mesh.vertices));
                 }
-                skinned_triangle.triangle = triangle;
-                output_mesh.tris.push_back(skinned_triangle);
             }
             delete[] tri_indices;
         }
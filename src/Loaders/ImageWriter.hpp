@@ -0,0 +1,128 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include "../Renderer/FrameBuffer.hpp"
+
+/**
+ * Save the color plane of a frame buffer as a binary PPM image
+ * @throws runtime_error Unable to write file.
+ * @param filepath Location to write to.
+ * @param frame_buffer Image to save.
+ */
+void savePPM(const std::string& filepath, const FrameBuffer& frame_buffer){
+    std::ofstream file(filepath, std::ios::binary);
+    if(!file){
+        throw std::runtime_error("Error saving image: " + filepath);
+    }
+    file << "P6\n" << frame_buffer.getWidth() << " " << frame_buffer.getHeight() << "\n255\n";
+    std::vector<uint8_t> row(frame_buffer.getWidth()*3);
+    for (int y = 0; y < frame_buffer.getHeight(); ++y) {
+        for (int x = 0; x < frame_buffer.getWidth(); ++x) {
+            uint32_t color = frame_buffer.getColor(x,y);
+            row[x*3] = color & 0xFF;
+            row[x*3+1] = (color >> 8) & 0xFF;
+            row[x*3+2] = (color >> 16) & 0xFF;
+        }
+        file.write(reinterpret_cast<const char*>(row.data()),(std::streamsize)row.size());
+    }
+}
+
+/**
+ * Get the CRC-32 used by PNG chunks
+ * @see https://www.w3.org/TR/png/#D-CRCAppendix
+ */
+uint32_t pngCRC(const uint8_t* data, size_t size, uint32_t crc = 0){
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+/**
+ * Save the color plane of a frame buffer as a PNG image
+ * @throws runtime_error Unable to write file.
+ * @param filepath Location to write to.
+ * @param frame_buffer Image to save.
+ * @details Image data is stored without compression, so no deflate implementation is needed. Files are about the size of a PPM.
+ */
+void savePNG(const std::string& filepath, const FrameBuffer& frame_buffer){
+    std::ofstream file(filepath, std::ios::binary);
+    if(!file){
+        throw std::runtime_error("Error saving image: " + filepath);
+    }
+    auto putBigEndian = [](std::vector<uint8_t>& out, uint32_t value){
+        for (int shift = 24; shift >= 0; shift -= 8) out.push_back((value >> shift) & 0xFF);
+    };
+    auto writeChunk = [&](const char* type, const std::vector<uint8_t>& data){
+        std::vector<uint8_t> chunk;
+        putBigEndian(chunk,(uint32_t)data.size());
+        chunk.insert(chunk.end(),type,type+4);
+        chunk.insert(chunk.end(),data.begin(),data.end());
+        putBigEndian(chunk,pngCRC(chunk.data()+4,chunk.size()-4));
+        file.write(reinterpret_cast<const char*>(chunk.data()),(std::streamsize)chunk.size());
+    };
+
+    //Raw scanlines, each with a "none" filter byte
+    std::vector<uint8_t> raw;
+    raw.reserve((size_t)frame_buffer.getHeight() * (frame_buffer.getWidth()*3+1));
+    for (int y = 0; y < frame_buffer.getHeight(); ++y) {
+        raw.push_back(0);
+        for (int x = 0; x < frame_buffer.getWidth(); ++x) {
+            uint32_t color = frame_buffer.getColor(x,y);
+            raw.push_back(color & 0xFF);
+            raw.push_back((color >> 8) & 0xFF);
+            raw.push_back((color >> 16) & 0xFF);
+        }
+    }
+    //Zlib stream of stored deflate blocks
+    std::vector<uint8_t> compressed{0x78,0x01};
+    const size_t MAX_BLOCK = 65535;
+    size_t start = 0;
+    do {
+        size_t size = std::min(MAX_BLOCK,raw.size()-start);
+        compressed.push_back(start + size == raw.size() ? 1 : 0); //Last block flag
+        compressed.push_back(size & 0xFF);
+        compressed.push_back(size >> 8);
+        compressed.push_back(~size & 0xFF);
+        compressed.push_back((~size >> 8) & 0xFF);
+        compressed.insert(compressed.end(),raw.begin()+(long long)start,raw.begin()+(long long)(start+size));
+        start += size;
+    } while (start < raw.size());
+    uint32_t a = 1, b = 0; //Adler-32
+    for (uint8_t byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBigEndian(compressed,(b << 16) | a);
+
+    const uint8_t SIGNATURE[8] = {0x89,'P','N','G','\r','\n',0x1A,'\n'};
+    file.write(reinterpret_cast<const char*>(SIGNATURE),8);
+    std::vector<uint8_t> header;
+    putBigEndian(header,(uint32_t)frame_buffer.getWidth());
+    putBigEndian(header,(uint32_t)frame_buffer.getHeight());
+    header.insert(header.end(),{8,2,0,0,0}); //8-bit rgb, no interlacing
+    writeChunk("IHDR",header);
+    writeChunk("IDAT",compressed);
+    writeChunk("IEND",{});
+}
+
+/**
+ * Save the color plane of a frame buffer, picking the format from the file extension
+ * @throws runtime_error Unable to write file.
+ * @param filepath Location to write to. Ends in .png or .ppm.
+ * @param frame_buffer Image to save.
+ */
+void saveImage(const std::string& filepath, const FrameBuffer& frame_buffer){
+    if(filepath.size() >= 4 && filepath.substr(filepath.size()-4) == ".png"){
+        savePNG(filepath,frame_buffer);
+    }else{
+        savePPM(filepath,frame_buffer);
+    }
+}
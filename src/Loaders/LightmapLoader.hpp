@@ -0,0 +1,117 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include "BinaryIO.hpp"
+#include "../Renderer/Lightmap.hpp"
+#include "../Renderer/Mesh.hpp"
+
+/**
+ * File format of a lightmap, all fields little endian
+ * @details "LMP2" magic, u64 mesh geometry hash, u32 width, u32 height, u64 corner count,
+ * then the corner uvs as f32 pairs, and then the packed texels row by row as u32.
+ */
+const char LIGHTMAP_FILE_MAGIC[4] = {'L','M','P','2'};
+
+/**
+ * Largest width or height a lightmap file may have
+ */
+const uint32_t MAX_LIGHTMAP_SIZE = 16384;
+
+/**
+ * Save a lightmap to a binary file
+ * @throws runtime_error Unable to write file.
+ * @param filepath Location to write to.
+ * @param lightmap Lightmap to save.
+ */
+void saveLightmap(const std::string& filepath, const Lightmap& lightmap){
+    std::ofstream file(filepath, std::ios::binary);
+    if(!file){
+        throw std::runtime_error("Error saving lightmap: " + filepath);
+    }
+    file.write(LIGHTMAP_FILE_MAGIC, 4);
+    writeUInt(file, lightmap.mesh_hash, 8);
+    writeUInt(file, (uint32_t)lightmap.width, 4);
+    writeUInt(file, (uint32_t)lightmap.height, 4);
+    writeUInt(file, lightmap.corner_uvs.size(), 8);
+    for (const glm::vec2& uv : lightmap.corner_uvs) {
+        writeFloat(file, uv.x);
+        writeFloat(file, uv.y);
+    }
+    writeUIntArray(file, lightmap.texels.data(), lightmap.texels.size());
+    if(!file){
+        throw std::runtime_error("Error saving lightmap: " + filepath);
+    }
+}
+
+/**
+ * Load a lightmap from a binary file
+ * @throws runtime_error Unable to read file, or file is not a valid lightmap.
+ * @param filepath Location of a file written by saveLightmap().
+ * @return Loaded lightmap. Check its mesh hash against the mesh it is used with.
+ */
+Lightmap loadLightmap(const std::string& filepath){
+    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+    auto file_size = (uint64_t)std::max<std::streamoff>(file.tellg(), 0);
+    file.seekg(0);
+    char magic[4] = {};
+    if(!file || !file.read(magic, 4) || std::string(magic, 4) != std::string(LIGHTMAP_FILE_MAGIC, 4)){
+        throw std::runtime_error("Error loading lightmap: " + filepath);
+    }
+    Lightmap lightmap{};
+    lightmap.mesh_hash = readUInt(file, 8);
+    auto width = (uint32_t)readUInt(file, 4), height = (uint32_t)readUInt(file, 4);
+    uint64_t corner_count = readUInt(file, 8);
+    //Check the sizes against the file before allocating, so a corrupt header can not ask for huge arrays
+    const uint64_t HEADER_BYTES = 28;
+    if(!file || width == 0 || height == 0 || width > MAX_LIGHTMAP_SIZE || height > MAX_LIGHTMAP_SIZE || corner_count % 3 != 0 ||
+       file_size != HEADER_BYTES + corner_count * 8 + (uint64_t)width * height * 4){
+        throw std::runtime_error("Error loading lightmap: " + filepath);
+    }
+    lightmap.width = (int)width;
+    lightmap.height = (int)height;
+    lightmap.corner_uvs.resize(corner_count);
+    for (glm::vec2& uv : lightmap.corner_uvs) {
+        uv.x = readFloat(file);
+        uv.y = readFloat(file);
+    }
+    lightmap.texels.resize((size_t)width * height);
+    readUIntArray(file, lightmap.texels.data(), lightmap.texels.size());
+    if(!file){
+        throw std::runtime_error("Error loading lightmap: " + filepath);
+    }
+    return lightmap;
+}
+
+/**
+ * Give the vertices of a mesh the lightmap uvs of a lightmap
+ * @param mesh Mesh the lightmap was baked for. Vertices shared between charts are duplicated, triangles keep their order.
+ * @param lightmap Lightmap with a uv for each corner of the mesh.
+ * @details Triangle order is kept, so meshlets and visibility sets stay valid. Levels of detail do not get lightmap uvs.
+ */
+void applyLightmapUVs(Mesh& mesh, const Lightmap& lightmap){
+    std::vector<bool> assigned(mesh.vertices.size(), false);
+    std::unordered_map<std::string, uint32_t> duplicates; //Vertex index and uv to duplicated vertex
+    for (size_t corner = 0; corner < mesh.indices.size(); ++corner) {
+        uint32_t& index = mesh.indices[corner];
+        const glm::vec2& uv = lightmap.corner_uvs[corner];
+        if(!assigned[index]){
+            assigned[index] = true;
+            mesh.vertices[index].lightmap_tex = uv;
+            continue;
+        }
+        if(mesh.vertices[index].lightmap_tex == uv) continue;
+        std::string key = std::string(reinterpret_cast<const char*>(&index), sizeof(uint32_t)) + std::string(reinterpret_cast<const char*>(&uv), sizeof(glm::vec2));
+        auto found = duplicates.find(key);
+        if(found == duplicates.end()){
+            Vertex vertex = mesh.vertices[index];
+            vertex.lightmap_tex = uv;
+            found = duplicates.emplace(key, (uint32_t)mesh.vertices.size()).first;
+            mesh.vertices.push_back(vertex);
+            assigned.push_back(true);
+        }
+        index = found->second;
+    }
+}
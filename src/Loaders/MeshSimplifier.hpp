@@ -0,0 +1,309 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <queue>
+#include <unordered_map>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "../Renderer/Mesh.hpp"
+#include "MeshletBuilder.hpp"
+
+/**
+ * Max number of simplified levels generated per mesh
+ */
+const int MAX_LOD_LEVELS = 4;
+
+/**
+ * Meshes are not simplified below this many triangles
+ */
+const size_t MIN_LOD_TRIANGLES = 32;
+
+/**
+ * Sum of squared distances to a set of planes
+ * @see Garland and Heckbert, Surface Simplification Using Quadric Error Metrics
+ */
+struct Quadric {
+    //Upper triangle of the symmetric 4x4 matrix
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+    /**
+     * Add the plane ax+by+cz+d=0
+     * @param normal Unit normal, a b c
+     * @param d Plane offset
+     */
+    void addPlane(const glm::dvec3& normal, double d) {
+        a2 += normal.x*normal.x; ab += normal.x*normal.y; ac += normal.x*normal.z; ad += normal.x*d;
+        b2 += normal.y*normal.y; bc += normal.y*normal.z; bd += normal.y*d;
+        c2 += normal.z*normal.z; cd += normal.z*d;
+        d2 += d*d;
+    }
+
+    /**
+     * Combine the planes of another quadric
+     */
+    void add(const Quadric& other) {
+        a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+        b2 += other.b2; bc += other.bc; bd += other.bd;
+        c2 += other.c2; cd += other.cd;
+        d2 += other.d2;
+    }
+
+    /**
+     * Get the sum of squared distances from a point to the planes
+     */
+    [[nodiscard]] double evaluate(const glm::vec3& point) const {
+        double x = point.x, y = point.y, z = point.z;
+        double error = a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x
+                     + b2*y*y + 2*bc*y*z + 2*bd*y
+                     + c2*z*z + 2*cd*z
+                     + d2;
+        return std::max(error, 0.0); //Rounding can make it slightly negative
+    }
+};
+
+/**
+ * Simplify a mesh by collapsing edges with the lowest quadric error
+ * @param mesh Mesh to simplify. Vertices with the same position are collapsed together, so uv and normal seams stay closed.
+ * @param target_triangles Stop once the mesh has this many triangles or fewer
+ * @param error Output. Estimated largest distance between the simplified and original surface, in model units.
+ * @return Simplified mesh, without meshlets. Only uses positions of the original vertices, so no attributes are interpolated.
+ * @details Half edge collapses move one position onto a neighbor. Vertices on open borders are locked to keep silhouettes.
+ * Collapses are rejected if they would fold a neighboring triangle over, or stack two triangles on the same three corners.
+ */
+Mesh simplifyMesh(const Mesh& mesh, size_t target_triangles, float& error){
+    //Group vertices by position, so seams are treated as one point
+    std::vector<uint32_t> position_ids(mesh.vertices.size());
+    std::vector<glm::vec3> positions;
+    std::vector<std::vector<uint32_t>> position_vertices; //Vertices at each position
+    {
+        std::unordered_map<std::string, uint32_t> lookup;
+        for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+            std::string key(reinterpret_cast<const char*>(&mesh.vertices[i].pos), sizeof(glm::vec3));
+            auto found = lookup.find(key);
+            if(found == lookup.end()){
+                found = lookup.emplace(key, (uint32_t)positions.size()).first;
+                positions.push_back(mesh.vertices[i].pos);
+                position_vertices.emplace_back();
+            }
+            position_ids[i] = found->second;
+            position_vertices[found->second].push_back((uint32_t)i);
+        }
+    }
+
+    std::vector<uint32_t> indices = mesh.indices;
+    size_t triangle_count = mesh.getTriangleCount();
+    std::vector<bool> triangle_alive(triangle_count, true);
+    std::vector<std::vector<size_t>> position_triangles(positions.size()); //Triangles around each position, may contain dead ones
+    std::vector<Quadric> quadrics(positions.size());
+    std::unordered_map<uint64_t, int> edge_uses;
+    auto edgeKey = [](uint32_t a, uint32_t b){return ((uint64_t)std::min(a,b) << 32) | std::max(a,b);};
+    for (size_t t = 0; t < triangle_count; ++t) {
+        uint32_t p[3];
+        for (int v = 0; v < 3; ++v) p[v] = position_ids[indices[t*3+v]];
+        if(p[0] == p[1] || p[1] == p[2] || p[0] == p[2]){ //Already degenerate
+            triangle_alive[t] = false;
+            continue;
+        }
+        for (int v = 0; v < 3; ++v) {
+            position_triangles[p[v]].push_back(t);
+            edge_uses[edgeKey(p[v],p[(v+1)%3])]++;
+        }
+        glm::dvec3 normal = glm::cross(glm::dvec3(positions[p[1]] - positions[p[0]]), glm::dvec3(positions[p[2]] - positions[p[0]]));
+        if(glm::dot(normal,normal) == 0) continue; //No plane
+        normal = glm::normalize(normal);
+        for (uint32_t position : p) {
+            quadrics[position].addPlane(normal, -glm::dot(normal, glm::dvec3(positions[p[0]])));
+        }
+    }
+    size_t alive_count = std::count(triangle_alive.begin(), triangle_alive.end(), true);
+
+    //Lock borders and non manifold edges
+    std::vector<bool> locked(positions.size(), false);
+    for (const auto& [key, uses] : edge_uses) {
+        if(uses != 2){
+            locked[key >> 32] = true;
+            locked[key & 0xFFFFFFFF] = true;
+        }
+    }
+
+    //Candidate collapses, cheapest first. Costs are rechecked when popped, since neighbors change.
+    struct Collapse {
+        double cost;
+        uint32_t from, to;
+        bool operator>(const Collapse& other) const {return cost > other.cost;}
+    };
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> queue;
+    std::vector<bool> removed(positions.size(), false);
+    auto collapseCost = [&](uint32_t from, uint32_t to){
+        Quadric combined = quadrics[from];
+        combined.add(quadrics[to]);
+        return combined.evaluate(positions[to]);
+    };
+    auto pushNeighbors = [&](uint32_t position){
+        for (size_t t : position_triangles[position]) {
+            if(!triangle_alive[t]) continue;
+            for (int v = 0; v < 3; ++v) {
+                uint32_t other = position_ids[indices[t*3+v]];
+                if(other == position) continue;
+                if(!locked[other]) queue.push({collapseCost(other,position), other, position});
+                if(!locked[position]) queue.push({collapseCost(position,other), position, other});
+            }
+        }
+    };
+    for (uint32_t i = 0; i < positions.size(); ++i) {
+        if(!locked[i]) pushNeighbors(i);
+    }
+
+    double max_cost = 0;
+    while (alive_count > target_triangles && !queue.empty()) {
+        Collapse collapse = queue.top();
+        queue.pop();
+        if(removed[collapse.from] || removed[collapse.to]) continue;
+        double cost = collapseCost(collapse.from, collapse.to);
+        if(cost > collapse.cost * 1.0001 + 1e-12){ //Got worse since it was queued
+            queue.push({cost, collapse.from, collapse.to});
+            continue;
+        }
+
+        //Check the edge still exists, no neighboring triangle flips, and no triangle lands on top of another
+        bool connected = false, rejected = false;
+        for (size_t t : position_triangles[collapse.from]) {
+            if(!triangle_alive[t]) continue;
+            glm::vec3 corners[3], moved[3];
+            uint32_t others[2]; //Corners that stay in place
+            int other_count = 0;
+            bool has_to = false;
+            for (int v = 0; v < 3; ++v) {
+                uint32_t position = position_ids[indices[t*3+v]];
+                has_to |= position == collapse.to;
+                if(position != collapse.from && other_count < 2) others[other_count++] = position;
+                corners[v] = positions[position];
+                moved[v] = position == collapse.from ? positions[collapse.to] : corners[v];
+            }
+            if(has_to){
+                connected = true;
+                continue; //Removed by the collapse
+            }
+            //Foldover, the face turns past 90 degrees
+            glm::vec3 old_normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+            glm::vec3 new_normal = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            if(glm::dot(old_normal,new_normal) <= 0){
+                rejected = true;
+                break;
+            }
+            //Duplicate face, the moved triangle would share all three corners with a triangle already at the target
+            for (size_t other : position_triangles[collapse.to]) {
+                if(!triangle_alive[other]) continue;
+                bool has_first = false, has_second = false;
+                for (int v = 0; v < 3; ++v) {
+                    uint32_t position = position_ids[indices[other*3+v]];
+                    has_first |= position == others[0];
+                    has_second |= position == others[1];
+                }
+                if(has_first && has_second){
+                    rejected = true;
+                    break;
+                }
+            }
+            if(rejected) break;
+        }
+        if(!connected || rejected) continue;
+
+        //Collapse
+        for (size_t t : position_triangles[collapse.from]) {
+            if(!triangle_alive[t]) continue;
+            bool has_to = false;
+            for (int v = 0; v < 3; ++v) has_to |= position_ids[indices[t*3+v]] == collapse.to;
+            if(has_to){
+                triangle_alive[t] = false;
+                alive_count--;
+                continue;
+            }
+            for (int v = 0; v < 3; ++v) {
+                uint32_t& index = indices[t*3+v];
+                if(position_ids[index] != collapse.from) continue;
+                //Use the vertex at the new position with the closest attributes, so seams stay seams
+                const Vertex& original = mesh.vertices[index];
+                uint32_t best = position_vertices[collapse.to][0];
+                float best_difference = INFINITY;
+                for (uint32_t candidate : position_vertices[collapse.to]) {
+                    const Vertex& other = mesh.vertices[candidate];
+                    float difference = glm::dot(other.tex - original.tex, other.tex - original.tex) + glm::dot(other.norm - original.norm, other.norm - original.norm);
+                    if(difference < best_difference){
+                        best_difference = difference;
+                        best = candidate;
+                    }
+                }
+                index = best;
+            }
+            position_triangles[collapse.to].push_back(t);
+        }
+        quadrics[collapse.to].add(quadrics[collapse.from]);
+        removed[collapse.from] = true;
+        max_cost = std::max(max_cost, cost);
+        pushNeighbors(collapse.to);
+    }
+    error = (float)std::sqrt(max_cost);
+
+    //Compact into a new mesh
+    Mesh output{};
+    std::vector<int64_t> remap(mesh.vertices.size(), -1);
+    for (size_t t = 0; t < triangle_count; ++t) {
+        if(!triangle_alive[t]) continue;
+        for (int v = 0; v < 3; ++v) {
+            uint32_t index = indices[t*3+v];
+            if(remap[index] < 0){
+                remap[index] = (int64_t)output.vertices.size();
+                output.vertices.push_back(mesh.vertices[index]);
+            }
+            output.indices.push_back((uint32_t)remap[index]);
+        }
+    }
+    return output;
+}
+
+/**
+ * Compute the bounding sphere of a mesh
+ * @param mesh Mesh to set the bounds of
+ * @details Centered on the bounding box, which is close enough for culling and level selection.
+ */
+void buildBounds(Mesh& mesh){
+    glm::vec3 min_bound = mesh.vertices[0].pos, max_bound = min_bound;
+    for (const Vertex& vertex : mesh.vertices) {
+        min_bound = glm::min(min_bound, vertex.pos);
+        max_bound = glm::max(max_bound, vertex.pos);
+    }
+    mesh.bounds_center = (min_bound + max_bound) / 2.0f;
+    mesh.bounds_radius = 0;
+    for (const Vertex& vertex : mesh.vertices) {
+        mesh.bounds_radius = std::max(mesh.bounds_radius, glm::distance(mesh.bounds_center, vertex.pos));
+    }
+}
+
+/**
+ * Compute the bounds of a mesh and generate its level of detail chain
+ * @param mesh Mesh to add levels to. Each level has about half the triangles of the last, and its own meshlets.
+ * @details Levels are always simplified from the full mesh, so errors do not stack up.
+ */
+void buildLODs(Mesh& mesh){
+    mesh.lods.clear();
+    buildBounds(mesh);
+
+    size_t triangles = mesh.getTriangleCount();
+    for (int level = 0; level < MAX_LOD_LEVELS; ++level) {
+        size_t target = triangles / 2;
+        if(target < MIN_LOD_TRIANGLES) break;
+        float error;
+        Mesh lod = simplifyMesh(mesh, target, error);
+        if(lod.indices.empty() || lod.getTriangleCount() > triangles * 9 / 10) break; //Locked borders or flips stopped it
+        if(error > mesh.bounds_radius) break; //Lost the shape
+        triangles = lod.getTriangleCount();
+        lod.lod_error = error;
+        lod.bounds_center = mesh.bounds_center;
+        lod.bounds_radius = mesh.bounds_radius;
+        buildMeshlets(lod);
+        mesh.lods.push_back(std::move(lod));
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include "../Renderer/Mesh.hpp"
+
+/**
+ * Max triangles in a single meshlet
+ */
+const size_t MESHLET_SIZE = 64;
+
+/**
+ * Interleave the low 10 bits of a number with two zero bits
+ * @see https://fgiesen.wordpress.com/2009/12/13/decoding-morton-codes/
+ */
+uint32_t spreadBits3D(uint32_t value){
+    value &= 0x000003ff;
+    value = (value ^ (value << 16)) & 0xff0000ff;
+    value = (value ^ (value << 8)) & 0x0300f00f;
+    value = (value ^ (value << 4)) & 0x030c30c3;
+    value = (value ^ (value << 2)) & 0x09249249;
+    return value;
+}
+
+/**
+ * Get the facing of a triangle, its dominant normal direction
+ * @param a,b,c Triangle corners in winding order
+ * @return 0 to 5 for +x, -x, +y, -y, +z, -z. Degenerate triangles are +x.
+ */
+int getFacing(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c){
+    glm::vec3 normal = glm::cross(b - a, c - a); //Same winding as backface culling
+    glm::vec3 size = glm::abs(normal);
+    int axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+    return axis * 2 + (normal[axis] < 0 ? 1 : 0);
+}
+
+/**
+ * Split a mesh into meshlets for cluster culling
+ * @param mesh Mesh to split. Its triangles are reordered along a Morton curve, grouped by facing within each grid cell, so each meshlet is a contiguous spatially coherent range.
+ * @param first_triangle, last_triangle Range of triangles to split(last not inclusive). Meshlets never cross the ends of the range.
+ * @details Each meshlet gets a bounding sphere, and a cone around the geometric normals of its triangles for backface culling.
+ * Meshlets never mix facings, which keeps their cones narrow enough to cull with.
+ */
+void buildMeshlets(Mesh& mesh, size_t first_triangle, size_t last_triangle){
+    if(last_triangle <= first_triangle) return;
+    //Get bounds for quantization
+    glm::vec3 min_bound = mesh.vertices[mesh.indices[first_triangle*3]].pos, max_bound = min_bound;
+    for (size_t i = first_triangle*3; i < last_triangle*3; ++i) {
+        min_bound = glm::min(min_bound,mesh.vertices[mesh.indices[i]].pos);
+        max_bound = glm::max(max_bound,mesh.vertices[mesh.indices[i]].pos);
+    }
+    glm::vec3 scale = 1023.0f / glm::max(max_bound - min_bound, glm::vec3(0.000001f));
+
+    //Get the Morton code of each triangle center, and its facing
+    size_t triangle_count = last_triangle - first_triangle;
+    std::vector<uint32_t> mortons(triangle_count);
+    std::vector<int> facings(triangle_count);
+    for (size_t i = first_triangle; i < last_triangle; ++i) {
+        glm::vec3 a = mesh.vertices[mesh.indices[i*3]].pos, b = mesh.vertices[mesh.indices[i*3+1]].pos, c = mesh.vertices[mesh.indices[i*3+2]].pos;
+        glm::uvec3 quantized = glm::uvec3(((a + b + c) / 3.0f - min_bound) * scale);
+        mortons[i - first_triangle] = spreadBits3D(quantized.x) | (spreadBits3D(quantized.y) << 1) | (spreadBits3D(quantized.z) << 2);
+        facings[i - first_triangle] = getFacing(a, b, c);
+    }
+
+    //Pick the smallest grid cells that still hold half a meshlet of triangles on average, so splitting a cell by facing leaves meshlets that are not tiny.
+    //A cell is a prefix of the Morton code, each 3 bits shorter halves the cell size.
+    std::vector<uint32_t> sorted_mortons = mortons;
+    std::sort(sorted_mortons.begin(), sorted_mortons.end());
+    int cell_shift = 30;
+    for (int shift = 27; shift >= 0; shift -= 3) {
+        size_t cells = 1;
+        for (size_t i = 1; i < triangle_count; ++i) {
+            if((sorted_mortons[i] >> shift) != (sorted_mortons[i-1] >> shift)) cells++;
+        }
+        if(cells * (MESHLET_SIZE / 2) > triangle_count) break;
+        cell_shift = shift;
+    }
+
+    //Sort triangles by cell, then facing, then Morton code
+    std::vector<uint64_t> codes(triangle_count);
+    for (size_t i = 0; i < triangle_count; ++i) {
+        uint64_t cell = mortons[i] >> cell_shift, position = mortons[i] & ((1u << cell_shift) - 1);
+        codes[i] = (((cell << 3) | (uint64_t)facings[i]) << cell_shift) | position;
+    }
+    std::vector<size_t> order(codes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&codes](size_t a, size_t b){return codes[a] < codes[b];});
+    std::vector<uint32_t> sorted_indices(order.size()*3);
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (int v = 0; v < 3; ++v) {
+            sorted_indices[i*3+v] = mesh.indices[(first_triangle + order[i])*3+v];
+        }
+    }
+    std::copy(sorted_indices.begin(), sorted_indices.end(), mesh.indices.begin() + (long long)first_triangle*3);
+
+    //Chop the curve of each facing in each cell into meshlets
+    size_t group_end = first_triangle;
+    for (size_t start = first_triangle; start < last_triangle; start = std::min(start + MESHLET_SIZE, group_end)) {
+        if(start == group_end){ //Find the end of the next cell and facing
+            uint64_t group = codes[order[start - first_triangle]] >> cell_shift;
+            while (group_end < last_triangle && codes[order[group_end - first_triangle]] >> cell_shift == group) group_end++;
+        }
+        Meshlet meshlet{};
+        meshlet.start = start;
+        meshlet.end = std::min(start + MESHLET_SIZE, group_end);
+
+        //Bounding sphere around the average point
+        glm::vec3 center = {0,0,0};
+        for (size_t i = meshlet.start*3; i < meshlet.end*3; ++i) {
+            center += mesh.vertices[mesh.indices[i]].pos;
+        }
+        center /= (float)((meshlet.end - meshlet.start)*3);
+        float radius = 0;
+        for (size_t i = meshlet.start*3; i < meshlet.end*3; ++i) {
+            radius = std::max(radius,glm::distance(center,mesh.vertices[mesh.indices[i]].pos));
+        }
+        meshlet.center = center;
+        meshlet.radius = radius;
+
+        //Normal cone, using the same winding as backface culling
+        glm::vec3 axis = {0,0,0};
+        for (size_t i = meshlet.start; i < meshlet.end; ++i) {
+            glm::vec3 a = mesh.vertices[mesh.indices[i*3]].pos, b = mesh.vertices[mesh.indices[i*3+1]].pos, c = mesh.vertices[mesh.indices[i*3+2]].pos;
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            if(glm::dot(normal,normal) > 0) axis += glm::normalize(normal);
+        }
+        meshlet.cone_sin = 2; //Disabled by default
+        meshlet.cone_cos = 0;
+        if(glm::dot(axis,axis) > 0){
+            axis = glm::normalize(axis);
+            float min_dot = 1;
+            for (size_t i = meshlet.start; i < meshlet.end; ++i) {
+                glm::vec3 a = mesh.vertices[mesh.indices[i*3]].pos, b = mesh.vertices[mesh.indices[i*3+1]].pos, c = mesh.vertices[mesh.indices[i*3+2]].pos;
+                glm::vec3 normal = glm::cross(b - a, c - a);
+                if(glm::dot(normal,normal) > 0) min_dot = std::min(min_dot,glm::dot(glm::normalize(normal),axis));
+            }
+            if(min_dot > 0){ //Cone narrower than a hemisphere
+                meshlet.cone_cos = min_dot;
+                meshlet.cone_sin = sqrtf(1.0f - min_dot*min_dot);
+            }
+        }
+        meshlet.cone_axis = axis;
+        mesh.meshlets.push_back(meshlet);
+    }
+}
+
+/**
+ * Split a whole mesh into meshlets for cluster culling
+ * @see buildMeshlets(Mesh&, size_t, size_t)
+ */
+void buildMeshlets(Mesh& mesh){
+    mesh.meshlets.clear();
+    buildMeshlets(mesh, 0, mesh.getTriangleCount());
+}
@@ -8,6 +8,7 @@
 #include <string>
 #include <iostream>
 #include "../Renderer/Mesh.hpp"
+#include "VertexWelder.hpp"
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tinyobj/tinyobjloader.h"
 
@@ -17,7 +18,7 @@
  * Load obj file using tinyOBJ
  * @param filepath Filepath to obj file
  * @param texture_id Texture ID to use for this mesh
- * @return Resulting mesh
+ * @return Resulting indexed mesh. Identical vertices are welded together.
  */
 Mesh loadOBJ(const std::string& filepath){
     //This code is mostly based on the tiny objloader example
@@ -26,6 +27,7 @@ Mesh loadOBJ(const std::string& filepath){
     reader_config.mtl_search_path = "./";
     tinyobj::ObjReader reader;
     Mesh mesh;
+    VertexWelder<Vertex> welder;
 
     if (!reader.ParseFromFile(filepath, reader_config)) {
         if (!reader.Error().empty()) {
@@ -35,7 +37,7 @@ Mesh loadOBJ(const std::string& filepath){
     }
 
     if (!reader.Warning().empty()) {
-        std::cout << "TinyObjReader: " << reader.Warning();
+        std::cerr << "TinyObjReader: " << reader.Warning();
     }
 
     auto& attrib = reader.GetAttrib();
@@ -49,34 +51,34 @@ Mesh loadOBJ(const std::string& filepath){
         for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
             auto fv = size_t(shape.mesh.num_face_vertices[f]);
 
-            Triangle triangle{};
             if(fv == 3){
                 // Loop over vertices in the face.
                 for (size_t v = 0; v < 3; v++) {
                     // access to vertex
                     tinyobj::index_t idx = shape.mesh.indices[index_offset + v];
-                    triangle.pos[v] = {attrib.vertices[3*size_t(idx.vertex_index)+0], attrib.vertices[3*size_t(idx.vertex_index)+1], attrib.vertices[3*size_t(idx.vertex_index)+2],1.0};
+                    Vertex vertex{};
+                    vertex.pos = {attrib.vertices[3*size_t(idx.vertex_index)+0], attrib.vertices[3*size_t(idx.vertex_index)+1], attrib.vertices[3*size_t(idx.vertex_index)+2]};
 
                     // Check if `normal_index` is zero or positive. negative = no normal data
                     if (idx.normal_index >= 0) {
-                        triangle.norm[v] = {attrib.normals[3*size_t(idx.normal_index)+0],attrib.normals[3*size_t(idx.normal_index)+1],attrib.normals[3*size_t(idx.normal_index)+2] };
+                        vertex.norm = {attrib.normals[3*size_t(idx.normal_index)+0],attrib.normals[3*size_t(idx.normal_index)+1],attrib.normals[3*size_t(idx.normal_index)+2] };
                     } else {
                         //todo auto generate normals
                     }
 
                     // Check if `texcoord_index` is zero or positive. Negative = no texcoord data
                     if (idx.texcoord_index >= 0) {
-                        triangle.tex[v] = {attrib.texcoords[2*size_t(idx.texcoord_index)+0],1.0 - attrib.texcoords[2*size_t(idx.texcoord_index)+1]}; //flip
+                        vertex.tex = {attrib.texcoords[2*size_t(idx.texcoord_index)+0],1.0 - attrib.texcoords[2*size_t(idx.texcoord_index)+1]}; //flip
                     } else {
                         //todo auto generate tex coords
-                        std::cout << "TinyObjReader: " << "Missing tex coords";
+                        std::cerr << "TinyObjReader: " << "Missing tex coords";
                     }
+                    mesh.indices.push_back(welder.add(vertex,mesh.vertices));
                 }
             } else {
-                std::cout << "TinyObjReader: " << "Non triangles in this mesh";
+                std::cerr << "TinyObjReader: " << "Non triangles in this mesh";
             }
 
-            mesh.tris.push_back(triangle);
             index_offset += fv;
 
             // per-face material
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include "BinaryIO.hpp"
+#include "../Physics/PotentiallyVisibleSet.hpp"
+
+/**
+ * File format of a potentially visible set, all fields little endian
+ * @details "PVS2" magic, u64 mesh geometry hash, f32 x3 min bound, f32 cell size, i32 x3 dimensions, u32 meshlet count,
+ * u64 meshlet words, u64 cell words, then the meshlet bitsets and the cell bitsets of the set as u64 words.
+ */
+const char PVS_FILE_MAGIC[4] = {'P','V','S','2'};
+
+/**
+ * Save a potentially visible set to a binary file
+ * @throws runtime_error Unable to write file.
+ * @param filepath Location to write to.
+ * @param pvs Set to save.
+ */
+void savePVS(const std::string& filepath, const PotentiallyVisibleSet& pvs){
+    std::ofstream file(filepath, std::ios::binary);
+    if(!file){
+        throw std::runtime_error("Error saving visibility: " + filepath);
+    }
+    file.write(PVS_FILE_MAGIC, 4);
+    writeUInt(file, pvs.mesh_hash, 8);
+    for (int axis = 0; axis < 3; ++axis) writeFloat(file, pvs.min_bound[axis]);
+    writeFloat(file, pvs.cell_size);
+    for (int axis = 0; axis < 3; ++axis) writeUInt(file, (uint32_t)pvs.dimensions[axis], 4);
+    writeUInt(file, pvs.meshlet_count, 4);
+    writeUInt(file, pvs.meshlet_bits.size(), 8);
+    writeUInt(file, pvs.cell_bits.size(), 8);
+    writeUIntArray(file, pvs.meshlet_bits.data(), pvs.meshlet_bits.size());
+    writeUIntArray(file, pvs.cell_bits.data(), pvs.cell_bits.size());
+    if(!file){
+        throw std::runtime_error("Error saving visibility: " + filepath);
+    }
+}
+
+/**
+ * Load a potentially visible set from a binary file
+ * @throws runtime_error Unable to read file, or file is not a valid set.
+ * @param filepath Location of a file written by savePVS().
+ * @return Loaded set. Check its mesh hash against the mesh it is used with.
+ */
+PotentiallyVisibleSet loadPVS(const std::string& filepath){
+    std::ifstream file(filepath, std::ios::binary);
+    char magic[4] = {};
+    if(!file || !file.read(magic, 4) || std::string(magic, 4) != std::string(PVS_FILE_MAGIC, 4)){
+        throw std::runtime_error("Error loading visibility: " + filepath);
+    }
+    PotentiallyVisibleSet pvs{};
+    pvs.mesh_hash = readUInt(file, 8);
+    for (int axis = 0; axis < 3; ++axis) pvs.min_bound[axis] = readFloat(file);
+    pvs.cell_size = readFloat(file);
+    for (int axis = 0; axis < 3; ++axis) pvs.dimensions[axis] = (int32_t)(uint32_t)readUInt(file, 4);
+    pvs.meshlet_count = (uint32_t)readUInt(file, 4);
+    uint64_t meshlet_words = readUInt(file, 8), cell_words = readUInt(file, 8);
+    //Check the sizes before allocating, so a corrupt header can not ask for huge arrays
+    uint64_t cells = (uint64_t)std::max(pvs.dimensions.x,0) * std::max(pvs.dimensions.y,0) * std::max(pvs.dimensions.z,0);
+    if(!file || meshlet_words != cells * ((pvs.meshlet_count + 63) / 64) || cell_words != cells * ((cells + 63) / 64)){
+        throw std::runtime_error("Error loading visibility: " + filepath);
+    }
+    pvs.meshlet_bits.resize(meshlet_words);
+    pvs.cell_bits.resize(cell_words);
+    readUIntArray(file, pvs.meshlet_bits.data(), pvs.meshlet_bits.size());
+    readUIntArray(file, pvs.cell_bits.data(), pvs.cell_bits.size());
+    if(!file){
+        throw std::runtime_error("Error loading visibility: " + filepath);
+    }
+    return pvs;
+}
@@ -12,6 +12,10 @@
 #include "FBXLoader.hpp"
 #include "OBJLoader.hpp"
 #include "TextureLoader.hpp"
+#include "MeshletBuilder.hpp"
+#include "MeshSimplifier.hpp"
+#include "PVSLoader.hpp"
+#include "LightmapLoader.hpp"
 
 /**
  * Manages any read only shared resources from the drive.
@@ -27,6 +31,7 @@ private:
     std::vector<Mesh> meshes;
     std::vector<SkinnedMesh> skinned_meshes;
     std::vector<PhysicsMesh> physics_meshes;
+    std::vector<PotentiallyVisibleSet> visibility_sets;
 
     std::unordered_map<std::string,ResourceID> files; //Keep track of filenames associated to resources.
 
@@ -43,9 +48,10 @@ public:
      * @throws runtime_error Unable to load mesh.
      * @param filename File location of mesh.
      * @param format File format.
+     * @param build_lods If levels of detail should be generated. Static maps with a visible set or lightmap are always drawn at full detail, so they can skip them.
      * @return Mesh resource ID.
      */
-    ResourceID getMesh(const std::string& filename, MeshFormat format){
+    ResourceID getMesh(const std::string& filename, MeshFormat format, bool build_lods = true){
         if(files.find(filename) == files.end()){ //Resource isn't yet created, load it.
             //todo create factory that detects extension and loader dependency injection
             //todo proper error handling in loader
@@ -59,10 +65,13 @@ public:
                     mesh = loadFBX(filename);
                     break;
             }
-            if(mesh.tris.empty()){
+            if(mesh.indices.empty()){
                 throw std::runtime_error("Error loading mesh: " + filename);
             }
-            meshes.push_back(mesh);
+            buildMeshlets(mesh);
+            buildBounds(mesh);
+            if(build_lods) buildLODs(mesh);
+            meshes.push_back(std::move(mesh));
             files[filename] = meshes.size()-1;
         }
         return files[filename];
@@ -79,7 +88,7 @@ public:
     ResourceID getSkinnedMesh(const std::string& filename){
         if(files.find(filename) == files.end()){ //Resource isn't yet created, load it.
             SkinnedMesh mesh = loadFBXSkinned(filename);
-            if(mesh.tris.empty()){
+            if(mesh.indices.empty()){
                 throw std::runtime_error("Error loading skinned mesh: " + filename);
             }
             skinned_meshes.push_back(mesh);
@@ -120,6 +129,47 @@ public:
         return files[filename];
     }
 
+    /**
+     * Get a precomputed potentially visible set from a filename.
+     * @throws runtime_error Unable to load set, or set was built for a different mesh, such as an older version of an edited map.
+     * @param filename File location of set. Created by the PVSBuilder target.
+     * @param mesh Mesh resource id the set was built for.
+     * @return Visibility resource id.
+     */
+    ResourceID getVisibility(const std::string& filename, ResourceID mesh){
+        if(files.find(filename) == files.end()){ //Resource isn't yet created, load it.
+            PotentiallyVisibleSet pvs = loadPVS(filename);
+            if(pvs.mesh_hash != meshes[mesh].getGeometryHash() || pvs.meshlet_count != meshes[mesh].meshlets.size()){
+                throw std::runtime_error("Visibility does not match mesh: " + filename);
+            }
+            visibility_sets.push_back(std::move(pvs));
+            meshes[mesh].lods = {}; //Drawn at full detail from now on, see Renderer::queueDraw()
+            files[filename] = visibility_sets.size()-1;
+        }
+        return files[filename];
+    }
+
+    /**
+     * Get a baked lightmap from a filename, and give its mesh the lightmap uvs.
+     * @throws runtime_error Unable to load lightmap, or lightmap was baked for a different mesh, such as an older version of an edited map.
+     * @param filename File location of lightmap. Created by the OVEN target.
+     * @param mesh Mesh resource id the lightmap was baked for. Its vertices are changed, but triangles and meshlets stay the same.
+     * @return Texture resource id of the lightmap texels. Sample it with the lightmap uvs.
+     */
+    ResourceID getLightmap(const std::string& filename, ResourceID mesh){
+        if(files.find(filename) == files.end()){ //Resource isn't yet created, load it.
+            Lightmap lightmap = loadLightmap(filename);
+            if(lightmap.mesh_hash != meshes[mesh].getGeometryHash() || lightmap.corner_uvs.size() != meshes[mesh].indices.size()){
+                throw std::runtime_error("Lightmap does not match mesh: " + filename);
+            }
+            applyLightmapUVs(meshes[mesh], lightmap);
+            meshes[mesh].lods = {}; //Levels do not get lightmap uvs, and are never drawn
+            textures.emplace_back(lightmap.width, lightmap.height, reinterpret_cast<const uint8_t*>(lightmap.texels.data()));
+            files[filename] = textures.size()-1;
+        }
+        return files[filename];
+    }
+
     /**
      * Access a mesh based on a resource id.
      * @param id Resource id.
@@ -160,4 +210,14 @@ public:
         return &textures[id];
     }
 
+    /**
+    * Access a potentially visible set based on a resource id.
+    * @param id Resource id.
+    * @return Reference to set for reading.
+    * @warning The returned reference is temporary, and will be invalidated by any non const methods on the resource manager.
+    */
+    const PotentiallyVisibleSet* readVisibility(ResourceID id) const {
+        return &visibility_sets[id];
+    }
+
 };
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <glm/gtx/euler_angles.hpp>
+#include "ResourceManager.hpp"
+#include "../Renderer/Renderer.hpp"
+
+/**
+ * A mesh placed in a scene
+ */
+struct SceneObject {
+    bool skinned = false; //If mesh is a skinned mesh, plays its first clip or a generated sway
+    ResourceManager::ResourceID mesh;
+    ResourceManager::ResourceID texture;
+    glm::mat4 transform;
+    bool has_visibility = false; //If the mesh has a precomputed visible set
+    ResourceManager::ResourceID visibility = 0;
+    bool has_lightmap = false; //If the mesh has baked lighting
+    ResourceManager::ResourceID lightmap = 0;
+    bool blended = false; //If the mesh is blended by its texture alpha
+    int clip = -1; //Generated clip of a skinned mesh without clips of its own, index into Scene::clips
+};
+
+/**
+ * Seconds the generated sway takes to loop
+ */
+const float SWAY_PERIOD = 2.0f * 3.14159265f / 6.0f;
+
+/**
+ * Create a looping sway for a skinned mesh without animations
+ * @param skeleton Skeleton to animate
+ * @return Clip that rotates every bone but the roots back and forth around its z axis, out of phase with its parent
+ */
+AnimationClip createSwayClip(const Skeleton& skeleton){
+    AnimationClip clip{"sway", SWAY_PERIOD, 30.0f, skeleton.getBoneCount()};
+    const LocalPose& bind = skeleton.bind_pose;
+    for (int frame = 0; frame < clip.frame_count; ++frame) {
+        float time = clip.getFrameTime(frame);
+        for (int bone = 0; bone < skeleton.getBoneCount(); ++bone) {
+            float angle = skeleton.parents[bone] < 0 ? 0.0f : sinf(time * 6.0f + (float)bone) / 20.0f;
+            glm::vec3 translation{bind.getChannel(LocalPose::TRANSLATION_X)[bone], bind.getChannel(LocalPose::TRANSLATION_Y)[bone], bind.getChannel(LocalPose::TRANSLATION_Z)[bone]};
+            glm::vec3 scale{bind.getChannel(LocalPose::SCALE_X)[bone], bind.getChannel(LocalPose::SCALE_Y)[bone], bind.getChannel(LocalPose::SCALE_Z)[bone]};
+            clip.setKey(frame, bone, translation, bind.getRotation(bone) * glm::angleAxis(angle, glm::vec3{0,0,1}), scale);
+        }
+    }
+    return clip;
+}
+
+/**
+ * A ray marched sphere placed in a scene
+ */
+struct SceneSphere {
+    glm::vec3 color; //0-1 per channel
+    glm::vec3 center;
+    float radius;
+};
+
+/**
+ * A camera position at a frame. Frames between keys are interpolated linearly.
+ */
+struct CameraKey {
+    int frame;
+    glm::vec3 position;
+    glm::vec3 look_at;
+};
+
+/**
+ * A static scene and camera path to render without a game running
+ */
+struct Scene {
+    int width = 800, height = 800; //Resolution in pixels
+    float fov = 90; //Degrees
+    int frames = 1; //Number of frames to render
+    std::vector<SceneObject> objects;
+    std::vector<SceneSphere> spheres;
+    std::vector<AnimationClip> clips; //Generated for skinned meshes without clips
+    std::vector<CameraKey> camera_path; //Sorted by frame
+    std::vector<Light> lights;
+    glm::vec3 ambient{1,1,1}; //Full ambient light and no lights is unlit
+
+    /**
+     * Get the camera at a frame
+     * @param frame Frame number. Clamped to the camera path.
+     */
+    [[nodiscard]] Camera getCamera(int frame) const {
+        Camera camera{fov,{0,0,-1},(float)width/(float)height}; //Same up direction as the client
+        camera.setPosition({2,2,2}); //Default values to avoid look at errors.
+        if(camera_path.empty()) return camera;
+        size_t next = 0;
+        while(next < camera_path.size() && camera_path[next].frame <= frame) next++;
+        if(next == 0 || next == camera_path.size()){ //Before the first key or after the last
+            const CameraKey& key = camera_path[next == 0 ? 0 : next-1];
+            camera.setPosition(key.position);
+            camera.setLookAt(key.look_at);
+            return camera;
+        }
+        const CameraKey& a = camera_path[next-1];
+        const CameraKey& b = camera_path[next];
+        float t = (float)(frame - a.frame) / (float)(b.frame - a.frame);
+        camera.setPosition(glm::mix(a.position,b.position,t));
+        camera.setLookAt(glm::mix(a.look_at,b.look_at,t));
+        return camera;
+    }
+
+    /**
+     * Set the camera and queue every object of a frame
+     * @param renderer Renderer to queue draws in
+     * @param manager Manager the scene was loaded with
+     * @param frame Frame number
+     */
+    void queueDraws(Renderer& renderer, const ResourceManager& manager, int frame) const {
+        renderer.setCamera(getCamera(frame));
+        renderer.setLights(lights,ambient);
+        float time = (float)frame / 60.0f; //Seconds at 60 fps
+        LocalPose pose{};
+        std::vector<glm::mat4> global_transforms, palette;
+        for (size_t i = 0; i < objects.size(); ++i) {
+            const SceneObject& object = objects[i];
+            if(object.blended){
+                renderer.queueDrawBlended(manager.readMesh(object.mesh),object.transform,manager.readTexture(object.texture));
+                continue;
+            }
+            if(!object.skinned){
+                renderer.queueDraw(manager.readMesh(object.mesh),object.transform,manager.readTexture(object.texture),object.has_visibility ? manager.readVisibility(object.visibility) : nullptr,
+                                   object.has_lightmap ? manager.readTexture(object.lightmap) : nullptr);
+                continue;
+            }
+            const SkinnedMesh* mesh = manager.readSkinnedMesh(object.mesh);
+            const Skeleton& skeleton = mesh->skeleton;
+            if(skeleton.getBoneCount() == 0) continue; //No skeleton
+            //Offset per object so copies do not move in lockstep, and fade in and out of the rest pose
+            const AnimationClip& clip = object.clip >= 0 ? clips[object.clip] : mesh->clips[0];
+            sampleClip(clip, time + (float)i / 6.0f, true, pose);
+            blendPoses(pose, skeleton.bind_pose, 0.5f + 0.5f * sinf(time + (float)i), pose);
+            global_transforms.resize(skeleton.getBoneCount());
+            palette.resize(skeleton.getBoneCount());
+            skeleton.computeGlobalTransforms(pose, global_transforms.data());
+            skeleton.computeSkinningMatrices(global_transforms.data(), palette.data());
+            renderer.queueSkinnedDraw(mesh,object.transform,manager.readTexture(object.texture),palette.data());
+        }
+        for (const SceneSphere& sphere : spheres) {
+            glm::vec3 center = sphere.center;
+            float radius = sphere.radius;
+            renderer.queueSDF([center, radius](const glm::vec4& x, const glm::vec4& y, const glm::vec4& z){
+                return sphereSDF(x - center.x, y - center.y, z - center.z, radius);
+            }, center, radius, sphere.color);
+        }
+    }
+};
+
+/**
+ * Load a scene from a text file
+ * @throws runtime_error Unable to read scene, or a resource in it.
+ * @param filepath Location of scene file.
+ * @param manager Resource manager to load meshes and textures with. Resource paths are relative to the working directory like everywhere else.
+ * @return Loaded scene.
+ * @details One command per line, # starts a comment:
+ * resolution <width> <height>
+ * fov <degrees>
+ * frames <count>
+ * mesh <obj or fbx file> <texture file> [x y z] [pitch yaw roll degrees] [scale x y z]
+ * skinned <fbx file> <texture file> [x y z] [pitch yaw roll degrees] [scale x y z] (plays the first clip of the mesh, or a sway if it has none)
+ * visibility <pvs file> (applies to the previous mesh)
+ * lightmap <lightmap file> (applies to the previous mesh)
+ * blend (applies to the previous mesh, blends it by its texture alpha)
+ * repeat <count x y z> <spacing x y z> (copies the previous object into a grid)
+ * camera <frame> <x y z> <look at x y z>
+ * ambient <r g b>
+ * light directional <r g b> <direction x y z>
+ * light point <r g b> <x y z> <range>
+ * sphere <r g b> <x y z> <radius> (ray marched signed distance field)
+ */
+Scene loadScene(const std::string& filepath, ResourceManager& manager){
+    std::ifstream file(filepath);
+    if(!file){
+        throw std::runtime_error("Error loading scene: " + filepath);
+    }
+    Scene scene{};
+    std::unordered_map<ResourceManager::ResourceID, int> sway_clips; //Skinned mesh to its generated clip
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file,line)) {
+        line_number++;
+        line = line.substr(0,line.find('#'));
+        std::istringstream stream(line);
+        std::string command;
+        if(!(stream >> command)) continue; //Empty line
+        std::string error = "Error in scene " + filepath + " line " + std::to_string(line_number) + ": ";
+
+        if(command == "resolution"){
+            if(!(stream >> scene.width >> scene.height) || scene.width <= 0 || scene.height <= 0) throw std::runtime_error(error + "expected resolution <width> <height>");
+        } else if(command == "fov"){
+            if(!(stream >> scene.fov)) throw std::runtime_error(error + "expected fov <degrees>");
+        } else if(command == "frames"){
+            if(!(stream >> scene.frames) || scene.frames <= 0) throw std::runtime_error(error + "expected frames <count>");
+        } else if(command == "mesh" || command == "skinned"){
+            std::string mesh_file, texture_file;
+            if(!(stream >> mesh_file >> texture_file)) throw std::runtime_error(error + "expected " + command + " <mesh file> <texture file>");
+            glm::vec3 position{0,0,0}, rotation{0,0,0}, scale{1,1,1};
+            stream >> position.x >> position.y >> position.z >> rotation.x >> rotation.y >> rotation.z >> scale.x >> scale.y >> scale.z; //Optional
+            bool fbx = mesh_file.size() >= 4 && mesh_file.substr(mesh_file.size()-4) == ".fbx";
+            SceneObject object{};
+            object.skinned = command == "skinned";
+            if(object.skinned){
+                if(!fbx) throw std::runtime_error(error + "skinned meshes must be fbx files");
+                object.mesh = manager.getSkinnedMesh(mesh_file);
+                const SkinnedMesh* mesh = manager.readSkinnedMesh(object.mesh);
+                if(mesh->clips.empty() && mesh->skeleton.getBoneCount() > 0){ //One sway per mesh
+                    auto found = sway_clips.find(object.mesh);
+                    if(found == sway_clips.end()){
+                        found = sway_clips.emplace(object.mesh, (int)scene.clips.size()).first;
+                        scene.clips.push_back(createSwayClip(mesh->skeleton));
+                    }
+                    object.clip = found->second;
+                }
+            }else{
+                object.mesh = manager.getMesh(mesh_file, fbx ? ResourceManager::FBX : ResourceManager::OBJ);
+            }
+            object.texture = manager.getTexture(texture_file);
+            glm::vec3 radians = glm::radians(rotation);
+            object.transform = glm::translate(glm::identity<glm::mat4>(),position) * glm::eulerAngleXYZ(radians.x,radians.y,radians.z) * glm::scale(glm::identity<glm::mat4>(),scale);
+            scene.objects.push_back(object);
+        } else if(command == "visibility"){
+            std::string visibility_file;
+            if(!(stream >> visibility_file) || scene.objects.empty() || scene.objects.back().skinned) throw std::runtime_error(error + "expected visibility <pvs file> after a mesh");
+            scene.objects.back().visibility = manager.getVisibility(visibility_file,scene.objects.back().mesh);
+            scene.objects.back().has_visibility = true;
+        } else if(command == "lightmap"){
+            std::string lightmap_file;
+            if(!(stream >> lightmap_file) || scene.objects.empty() || scene.objects.back().skinned) throw std::runtime_error(error + "expected lightmap <lightmap file> after a mesh");
+            scene.objects.back().lightmap = manager.getLightmap(lightmap_file,scene.objects.back().mesh);
+            scene.objects.back().has_lightmap = true;
+        } else if(command == "blend"){
+            if(scene.objects.empty() || scene.objects.back().skinned || scene.objects.back().has_visibility || scene.objects.back().has_lightmap){
+                throw std::runtime_error(error + "expected blend after a mesh without visibility or lightmap");
+            }
+            scene.objects.back().blended = true;
+        } else if(command == "repeat"){
+            glm::ivec3 count;
+            glm::vec3 spacing;
+            if(!(stream >> count.x >> count.y >> count.z >> spacing.x >> spacing.y >> spacing.z) || scene.objects.empty() || glm::any(glm::lessThan(count,glm::ivec3(1)))){
+                throw std::runtime_error(error + "expected repeat <count x y z> <spacing x y z> after an object");
+            }
+            SceneObject original = scene.objects.back();
+            for (int x = 0; x < count.x; ++x) {
+                for (int y = 0; y < count.y; ++y) {
+                    for (int z = 0; z < count.z; ++z) {
+                        if(x == 0 && y == 0 && z == 0) continue; //Already placed
+                        SceneObject copy = original;
+                        copy.transform = glm::translate(glm::identity<glm::mat4>(),glm::vec3(x,y,z) * spacing) * original.transform;
+                        scene.objects.push_back(copy);
+                    }
+                }
+            }
+        } else if(command == "camera"){
+            CameraKey key{};
+            if(!(stream >> key.frame >> key.position.x >> key.position.y >> key.position.z >> key.look_at.x >> key.look_at.y >> key.look_at.z)) throw std::runtime_error(error + "expected camera <frame> <x y z> <look at x y z>");
+            scene.camera_path.push_back(key);
+        } else if(command == "ambient"){
+            if(!(stream >> scene.ambient.x >> scene.ambient.y >> scene.ambient.z)) throw std::runtime_error(error + "expected ambient <r g b>");
+        } else if(command == "light"){
+            std::string type;
+            glm::vec3 color, vector;
+            float range = 0;
+            stream >> type >> color.x >> color.y >> color.z >> vector.x >> vector.y >> vector.z;
+            if(type == "point") stream >> range;
+            if(!stream || (type != "directional" && type != "point") || (type == "point" && range <= 0)){
+                throw std::runtime_error(error + "expected light directional <r g b> <direction x y z> or light point <r g b> <x y z> <range>");
+            }
+            if(scene.lights.size() >= Light::MAX_LIGHTS) throw std::runtime_error(error + "too many lights");
+            scene.lights.push_back(type == "point" ? Light::point(vector,color,range) : Light::directional(vector,color));
+        } else if(command == "sphere"){
+            SceneSphere sphere{};
+            if(!(stream >> sphere.color.x >> sphere.color.y >> sphere.color.z >> sphere.center.x >> sphere.center.y >> sphere.center.z >> sphere.radius) || sphere.radius <= 0){
+                throw std::runtime_error(error + "expected sphere <r g b> <x y z> <radius>");
+            }
+            scene.spheres.push_back(sphere);
+        } else {
+            throw std::runtime_error(error + "unknown command " + command);
+        }
+    }
+    std::stable_sort(scene.camera_path.begin(), scene.camera_path.end(), [](const CameraKey& a, const CameraKey& b){return a.frame < b.frame;});
+    return scene;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+
+/**
+ * Merges identical vertices while building an indexed mesh
+ * @tparam VERTEX Vertex type. Compared byte for byte, so it must not contain padding.
+ */
+template <class VERTEX> class VertexWelder {
+private:
+    /**
+     * FNV-1a hash over the bytes of a vertex
+     */
+    struct Hash {
+        size_t operator()(const VERTEX& vertex) const {
+            const auto* bytes = reinterpret_cast<const uint8_t*>(&vertex);
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < sizeof(VERTEX); ++i) {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+            return (size_t)hash;
+        }
+    };
+
+    /**
+     * Byte wise equality
+     */
+    struct Equal {
+        bool operator()(const VERTEX& a, const VERTEX& b) const {
+            return std::memcmp(&a,&b,sizeof(VERTEX)) == 0;
+        }
+    };
+
+    std::unordered_map<VERTEX,uint32_t,Hash,Equal> lookup{};
+
+public:
+    /**
+     * Get the index of a vertex, adding it if it has not been seen before
+     * @param vertex Vertex to add. Padding bytes must be zeroed, so value-initialize it.
+     * @param vertices Vertex buffer to add to. Must only be used with this welder.
+     * @return Index in vertex buffer
+     */
+    uint32_t add(const VERTEX& vertex, std::vector<VERTEX>& vertices){
+        auto [location, inserted] = lookup.try_emplace(vertex,(uint32_t)vertices.size());
+        if(inserted){
+            vertices.push_back(vertex);
+        }
+        return location->second;
+    }
+};
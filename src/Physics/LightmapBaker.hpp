@@ -0,0 +1,337 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include "../Renderer/Mesh.hpp"
+#include "../Renderer/Light.hpp"
+#include "../Renderer/Lightmap.hpp"
+#include "PhysicsMesh.hpp"
+
+/**
+ * Triangles join a chart while their normal is within this cosine of the chart's first triangle
+ */
+const float CHART_NORMAL_COS = 0.8f;
+
+/**
+ * Empty texels kept around each chart, so sampling near an edge never reads another chart
+ */
+const int CHART_PADDING = 2;
+
+/**
+ * Fraction of light reflected by every surface. The baker does not read textures, so bounced light is uncolored.
+ */
+const float BAKE_ALBEDO = 0.6f;
+
+/**
+ * Generate lightmap uvs by splitting a mesh into nearly flat charts and packing them into a texture
+ * @param mesh Mesh to unwrap
+ * @param width,height Lightmap size in texels
+ * @return Lightmap uv of each triangle corner, in the same order as the mesh indices
+ * @details Charts grow across shared edges and are projected onto the plane of their first triangle.
+ * They are then packed into shelves, tallest first, lowering the texel density until everything fits.
+ */
+std::vector<glm::vec2> unwrapLightmap(const Mesh& mesh, int width, int height){
+    size_t triangle_count = mesh.getTriangleCount();
+    //Group vertices by position, so charts grow across uv and normal seams
+    std::vector<uint32_t> position_ids(mesh.vertices.size());
+    {
+        std::unordered_map<std::string, uint32_t> lookup;
+        for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+            std::string key(reinterpret_cast<const char*>(&mesh.vertices[i].pos), sizeof(glm::vec3));
+            position_ids[i] = lookup.emplace(key, (uint32_t)lookup.size()).first->second;
+        }
+    }
+    std::vector<glm::vec3> normals(triangle_count);
+    std::unordered_map<uint64_t, std::vector<uint32_t>> edge_triangles;
+    auto edgeKey = [](uint32_t a, uint32_t b){return ((uint64_t)std::min(a,b) << 32) | std::max(a,b);};
+    for (size_t t = 0; t < triangle_count; ++t) {
+        const glm::vec3& a = mesh.vertices[mesh.indices[t*3]].pos;
+        glm::vec3 normal = glm::cross(mesh.vertices[mesh.indices[t*3+1]].pos - a, mesh.vertices[mesh.indices[t*3+2]].pos - a);
+        float length = glm::length(normal);
+        normals[t] = length > 0 ? normal / length : glm::vec3(0);
+        for (int v = 0; v < 3; ++v) {
+            uint32_t p0 = position_ids[mesh.indices[t*3+v]], p1 = position_ids[mesh.indices[t*3+(v+1)%3]];
+            if(p0 != p1) edge_triangles[edgeKey(p0,p1)].push_back((uint32_t)t);
+        }
+    }
+
+    //Grow charts
+    struct Chart {
+        std::vector<uint32_t> triangles;
+        glm::vec3 tangent, bitangent; //Projection axes
+        glm::vec2 min, max; //Projected bounds in model units
+        glm::ivec2 offset, size; //Packed location in texels
+    };
+    std::vector<Chart> charts;
+    std::vector<bool> assigned(triangle_count, false);
+    for (size_t seed = 0; seed < triangle_count; ++seed) {
+        if(assigned[seed]) continue;
+        Chart chart{};
+        glm::vec3 normal = normals[seed];
+        if(normal == glm::vec3(0)){ //Degenerate, any axes will do
+            chart.tangent = {1,0,0};
+            chart.bitangent = {0,1,0};
+        }else{
+            glm::vec3 up = fabsf(normal.z) < 0.9f ? glm::vec3(0,0,1) : glm::vec3(1,0,0);
+            chart.tangent = glm::normalize(glm::cross(up, normal));
+            chart.bitangent = glm::cross(normal, chart.tangent);
+        }
+        std::vector<uint32_t> stack{(uint32_t)seed};
+        assigned[seed] = true;
+        while (!stack.empty()) {
+            uint32_t t = stack.back();
+            stack.pop_back();
+            chart.triangles.push_back(t);
+            for (int v = 0; v < 3; ++v) {
+                uint32_t p0 = position_ids[mesh.indices[t*3+v]], p1 = position_ids[mesh.indices[t*3+(v+1)%3]];
+                if(p0 == p1) continue;
+                for (uint32_t other : edge_triangles[edgeKey(p0,p1)]) {
+                    if(assigned[other] || glm::dot(normals[other], normal) <= CHART_NORMAL_COS) continue;
+                    assigned[other] = true;
+                    stack.push_back(other);
+                }
+            }
+        }
+        chart.min = glm::vec2(INFINITY);
+        chart.max = glm::vec2(-INFINITY);
+        for (uint32_t t : chart.triangles) {
+            for (int v = 0; v < 3; ++v) {
+                const glm::vec3& position = mesh.vertices[mesh.indices[t*3+v]].pos;
+                glm::vec2 projected{glm::dot(position, chart.tangent), glm::dot(position, chart.bitangent)};
+                chart.min = glm::min(chart.min, projected);
+                chart.max = glm::max(chart.max, projected);
+            }
+        }
+        charts.push_back(std::move(chart));
+    }
+
+    //Pack, starting from a density that would fill about half the texture
+    std::vector<size_t> order(charts.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b){return charts[a].max.y - charts[a].min.y > charts[b].max.y - charts[b].min.y;});
+    double total_area = 0;
+    for (const Chart& chart : charts) total_area += (double)(chart.max.x - chart.min.x) * (chart.max.y - chart.min.y);
+    float texel_size = std::max(1e-6f, (float)std::sqrt(total_area / ((double)width * height * 0.5))); //Model units per texel
+    while (true) {
+        bool fits = true;
+        int x = 0, y = 0, shelf_height = 0;
+        for (size_t index : order) {
+            Chart& chart = charts[index];
+            chart.size = glm::ivec2(glm::ceil((chart.max - chart.min) / texel_size)) + 1 + CHART_PADDING * 2;
+            if(x + chart.size.x > width){ //Next shelf
+                x = 0;
+                y += shelf_height;
+                shelf_height = 0;
+            }
+            if(chart.size.x > width || y + chart.size.y > height){
+                fits = false;
+                break;
+            }
+            chart.offset = {x,y};
+            x += chart.size.x;
+            shelf_height = std::max(shelf_height, chart.size.y);
+        }
+        if(fits) break;
+        texel_size *= 1.1f;
+    }
+
+    std::vector<glm::vec2> corner_uvs(mesh.indices.size());
+    for (const Chart& chart : charts) {
+        for (uint32_t t : chart.triangles) {
+            for (int v = 0; v < 3; ++v) {
+                const glm::vec3& position = mesh.vertices[mesh.indices[t*3+v]].pos;
+                glm::vec2 projected{glm::dot(position, chart.tangent), glm::dot(position, chart.bitangent)};
+                glm::vec2 texel = glm::vec2(chart.offset) + (float)CHART_PADDING + 0.5f + (projected - chart.min) / texel_size;
+                corner_uvs[t*3+v] = texel / glm::vec2(width, height);
+            }
+        }
+    }
+    return corner_uvs;
+}
+
+/**
+ * Get the direct light arriving at a surface, with shadows
+ * @param occluder Mesh that casts shadows
+ * @param lights World space lights
+ * @param position Surface position
+ * @param normal Unit surface normal
+ * @param bias Distance to move ray origins off the surface
+ * @param far Length of shadow rays towards directional lights
+ */
+glm::vec3 bakeDirectLight(const PhysicsMesh& occluder, const std::vector<Light>& lights, const glm::vec3& position, const glm::vec3& normal, float bias, float far){
+    glm::vec3 light{0,0,0};
+    glm::vec3 origin = position + normal * bias;
+    for (const Light& source : lights) {
+        glm::vec3 arriving = source.evaluate(position, normal);
+        if(arriving == glm::vec3(0)) continue; //Facing away or out of range, skip the shadow ray
+        glm::vec3 target = source.type == Light::DIRECTIONAL ? origin - source.vector * far : source.vector;
+        if(!occluder.segmentBlocked(origin, target)) light += arriving;
+    }
+    return light;
+}
+
+/**
+ * Pick a direction around a normal with a cosine weighted distribution
+ * @param normal Unit normal
+ * @param random Random number generator
+ */
+glm::vec3 cosineSample(const glm::vec3& normal, std::mt19937& random){
+    std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+    float angle = 2.0f * 3.14159265f * distribution(random);
+    float radius_squared = distribution(random);
+    float radius = sqrtf(radius_squared);
+    glm::vec3 up = fabsf(normal.z) < 0.9f ? glm::vec3(0,0,1) : glm::vec3(1,0,0);
+    glm::vec3 tangent = glm::normalize(glm::cross(up, normal));
+    glm::vec3 bitangent = glm::cross(normal, tangent);
+    return tangent * (radius * cosf(angle)) + bitangent * (radius * sinf(angle)) + normal * sqrtf(1.0f - radius_squared);
+}
+
+/**
+ * Bake the direct and indirect light of a static mesh into a lightmap
+ * @param mesh Mesh to bake. Lightmap uvs follow its triangle order, so it must be loaded the same way as at runtime.
+ * @param occluder Physics mesh of the same mesh, used for ray casts
+ * @param lights World space lights
+ * @param sky Light arriving along rays that escape the mesh
+ * @param size Width and height of lightmap. Power of two.
+ * @param samples Indirect paths traced per texel, at least 1
+ * @param bounces Surfaces each indirect path can bounce off. 0 bakes direct light only.
+ * @return Lightmap with uvs and texels
+ * @details Texels are split into rows and traced in batches on all hardware threads. Meant to be run offline, see the OVEN target.
+ * Texels outside of every triangle are filled from their neighbors, so sampling just past a chart edge stays lit.
+ */
+Lightmap bakeLightmap(const Mesh& mesh, const PhysicsMesh& occluder, const std::vector<Light>& lights, const glm::vec3& sky, int size, int samples, int bounces){
+    Lightmap lightmap{};
+    lightmap.mesh_hash = mesh.getGeometryHash();
+    lightmap.width = size;
+    lightmap.height = size;
+    lightmap.corner_uvs = unwrapLightmap(mesh, size, size);
+
+    //Find the surface under each texel center
+    struct Surface {
+        glm::vec3 position, normal;
+        bool covered = false;
+    };
+    std::vector<Surface> surfaces((size_t)size * size);
+    glm::vec3 min_bound = mesh.vertices[0].pos, max_bound = min_bound;
+    for (const Vertex& vertex : mesh.vertices) {
+        min_bound = glm::min(min_bound, vertex.pos);
+        max_bound = glm::max(max_bound, vertex.pos);
+    }
+    float far = glm::distance(min_bound, max_bound) * 2.0f + 1.0f;
+    float bias = std::max(1e-4f, far * 1e-5f);
+    for (size_t t = 0; t < mesh.getTriangleCount(); ++t) {
+        glm::vec2 corners[3];
+        const Vertex* vertices[3];
+        for (int v = 0; v < 3; ++v) {
+            corners[v] = lightmap.corner_uvs[t*3+v] * (float)size;
+            vertices[v] = &mesh.vertices[mesh.indices[t*3+v]];
+        }
+        glm::vec3 face_normal = glm::cross(vertices[1]->pos - vertices[0]->pos, vertices[2]->pos - vertices[0]->pos);
+        float area = (corners[1].x - corners[0].x) * (corners[2].y - corners[0].y) - (corners[2].x - corners[0].x) * (corners[1].y - corners[0].y);
+        if(glm::length(face_normal) <= 0 || area == 0) continue;
+        face_normal = glm::normalize(face_normal);
+        glm::ivec2 box_min = glm::max(glm::ivec2(glm::floor(glm::min(glm::min(corners[0], corners[1]), corners[2]))), glm::ivec2(0));
+        glm::ivec2 box_max = glm::min(glm::ivec2(glm::ceil(glm::max(glm::max(corners[0], corners[1]), corners[2]))), glm::ivec2(size-1));
+        for (int y = box_min.y; y <= box_max.y; ++y) {
+            for (int x = box_min.x; x <= box_max.x; ++x) {
+                glm::vec2 center{(float)x + 0.5f, (float)y + 0.5f};
+                float w1 = ((corners[2].x - corners[1].x) * (center.y - corners[1].y) - (center.x - corners[1].x) * (corners[2].y - corners[1].y)) / area;
+                float w2 = ((corners[0].x - corners[2].x) * (center.y - corners[2].y) - (center.x - corners[2].x) * (corners[0].y - corners[2].y)) / area;
+                float w3 = 1.0f - w1 - w2;
+                if(w1 < -1e-4f || w2 < -1e-4f || w3 < -1e-4f) continue;
+                Surface& surface = surfaces[(size_t)y * size + x];
+                if(surface.covered) continue;
+                surface.covered = true;
+                surface.position = vertices[0]->pos * w1 + vertices[1]->pos * w2 + vertices[2]->pos * w3;
+                glm::vec3 normal = vertices[0]->norm * w1 + vertices[1]->norm * w2 + vertices[2]->norm * w3;
+                float length = glm::length(normal);
+                surface.normal = length > 0 && glm::dot(normal, face_normal) > 0 ? normal / length : face_normal; //Smooth normal unless it is missing or flipped
+            }
+        }
+    }
+
+    //Trace
+    std::vector<glm::vec3> light((size_t)size * size, glm::vec3(0));
+    const int ROWS_PER_BATCH = 4;
+    std::atomic<int> next_row = 0;
+    std::vector<std::thread> threads(std::max(1u,std::thread::hardware_concurrency()));
+    for (std::thread& thread : threads) {
+        thread = std::thread([&](){
+            for (int start = next_row.fetch_add(ROWS_PER_BATCH); start < size; start = next_row.fetch_add(ROWS_PER_BATCH)) {
+                std::mt19937 random(start); //Seeded per batch, so bakes are repeatable
+                for (size_t texel = (size_t)start * size; texel < (size_t)std::min(start + ROWS_PER_BATCH, size) * size; ++texel) {
+                    const Surface& surface = surfaces[texel];
+                    if(!surface.covered) continue;
+                    glm::vec3 direct = bakeDirectLight(occluder, lights, surface.position, surface.normal, bias, far);
+                    glm::vec3 indirect{0,0,0};
+                    for (int sample = 0; sample < samples && bounces > 0; ++sample) {
+                        glm::vec3 origin = surface.position + surface.normal * bias;
+                        glm::vec3 direction = cosineSample(surface.normal, random);
+                        float throughput = 1.0f;
+                        for (int bounce = 0; bounce < bounces; ++bounce) {
+                            float distance;
+                            int triangle;
+                            if(!occluder.rayCast(origin, direction, distance, triangle)){
+                                indirect += sky * throughput;
+                                break;
+                            }
+                            glm::vec3 hit = origin + direction * distance;
+                            const glm::vec3& a = mesh.vertices[mesh.indices[triangle*3]].pos;
+                            glm::vec3 normal = glm::cross(mesh.vertices[mesh.indices[triangle*3+1]].pos - a, mesh.vertices[mesh.indices[triangle*3+2]].pos - a);
+                            if(glm::length(normal) <= 0) break;
+                            normal = glm::normalize(glm::dot(normal, direction) > 0 ? -normal : normal); //Face the ray
+                            throughput *= BAKE_ALBEDO;
+                            indirect += bakeDirectLight(occluder, lights, hit, normal, bias, far) * throughput;
+                            origin = hit + normal * bias;
+                            direction = cosineSample(normal, random);
+                        }
+                    }
+                    light[texel] = direct + indirect / (float)samples;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    //Grow charts into their padding
+    std::vector<bool> filled(surfaces.size());
+    for (size_t i = 0; i < surfaces.size(); ++i) filled[i] = surfaces[i].covered;
+    for (int pass = 0; pass < CHART_PADDING; ++pass) {
+        std::vector<bool> next_filled = filled;
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                size_t index = (size_t)y * size + x;
+                if(filled[index]) continue;
+                glm::vec3 sum{0,0,0};
+                int count = 0;
+                const int offsets[4][2] = {{-1,0},{1,0},{0,-1},{0,1}};
+                for (const auto& offset : offsets) {
+                    int neighbor_x = x + offset[0], neighbor_y = y + offset[1];
+                    if(neighbor_x < 0 || neighbor_y < 0 || neighbor_x >= size || neighbor_y >= size) continue;
+                    size_t neighbor = (size_t)neighbor_y * size + neighbor_x;
+                    if(!filled[neighbor]) continue;
+                    sum += light[neighbor];
+                    count++;
+                }
+                if(count == 0) continue;
+                light[index] = sum / (float)count;
+                next_filled[index] = true;
+            }
+        }
+        filled = std::move(next_filled);
+    }
+
+    lightmap.texels.resize(light.size());
+    for (size_t i = 0; i < light.size(); ++i) {
+        lightmap.texels[i] = Lightmap::pack(light[i]);
+    }
+    return lightmap;
+}
@@ -6,6 +6,7 @@
 
 #include <numeric>
 #include <algorithm>
+#include <limits>
 #include "../Renderer/Mesh.hpp"
 #include "SphereBV.hpp"
 
@@ -118,7 +119,7 @@ private:
         if(bvh[index].bound.rayCast(origin,direction,sphere_distance)){
             if(bvh[index].triangle != -1){
                 glm::vec3 barycentric;
-                return mesh.tris[bvh[index].triangle].rayCast(origin,direction,distance,barycentric);
+                return tris[bvh[index].triangle].rayCast(origin,direction,distance,barycentric);
             }
             float distance_a;
             bool hit_a = rayCastRecurse(origin,direction,distance_a,bvh[index].child_a);
@@ -137,6 +138,41 @@ private:
         return false;
     }
 
+    /**
+     * Traverse the BVH for the closest hit, skipping nodes further than the closest hit so far
+     */
+    void rayCastClosestRecurse(const glm::vec3& origin, const glm::vec3& direction, float& closest, int& triangle, bool front_faces_only, int index) const {
+        float sphere_distance;
+        if(!bvh[index].bound.rayCast(origin,direction,sphere_distance) || sphere_distance > closest) return;
+        if(bvh[index].triangle != -1){
+            const Triangle& tri = tris[bvh[index].triangle];
+            if(front_faces_only && glm::dot(direction,glm::cross(glm::vec3(tri.pos[1] - tri.pos[0]),glm::vec3(tri.pos[2] - tri.pos[0]))) >= 0) return; //Same winding rule as renderer backface culling
+            float distance;
+            glm::vec3 barycentric;
+            if(tri.rayCast(origin,direction,distance,barycentric) && distance < closest){
+                closest = distance;
+                triangle = bvh[index].triangle;
+            }
+            return;
+        }
+        rayCastClosestRecurse(origin,direction,closest,triangle,front_faces_only,bvh[index].child_a);
+        rayCastClosestRecurse(origin,direction,closest,triangle,front_faces_only,bvh[index].child_b);
+    }
+
+    /**
+     * Traverse the BVH for segment occlusion, stopping at the first hit
+     */
+    bool segmentBlockedRecurse(const glm::vec3& a, const glm::vec3& b, const glm::vec3& direction, float length, int index) const {
+        const SphereBV& bound = bvh[index].bound;
+        if(glm::distance2(SphereBV::closestPointOnLineSegment(a,b,bound.position),bound.position) > bound.radius*bound.radius) return false;
+        if(bvh[index].triangle != -1){
+            float distance;
+            glm::vec3 barycentric;
+            return tris[bvh[index].triangle].rayCast(a,direction,distance,barycentric) && distance < length;
+        }
+        return segmentBlockedRecurse(a,b,direction,length,bvh[index].child_a) || segmentBlockedRecurse(a,b,direction,length,bvh[index].child_b);
+    }
+
     /**
      * Traverse the BVH for sphere collision
      */
@@ -146,7 +182,7 @@ private:
             if(bvh[index].triangle != -1){
                 glm::vec3 collision_point;
                 glm::vec3 plane;
-                if(sphere.collide( mesh.tris[bvh[index].triangle],collision_point,plane)){
+                if(sphere.collide( tris[bvh[index].triangle],collision_point,plane)){
                     return {plane};
                 };
                 return {};
@@ -175,15 +211,16 @@ public:
 
 /**
      * Create physics mesh from mesh
-     * Will copy mesh and build BVH
+     * Will unpack the mesh triangles and build BVH
      * @param source_mesh Mesh to use
      */
-    explicit PhysicsMesh(const Mesh& source_mesh) : mesh(source_mesh){
-        //Add indexes for BVH construction
-        for (size_t i = 0; i < mesh.tris.size(); ++i) {
-            mesh.tris[i].index = (int)i;
+    explicit PhysicsMesh(const Mesh& source_mesh) {
+        //Unpack triangles, with indexes for BVH construction
+        tris.reserve(source_mesh.getTriangleCount());
+        for (size_t i = 0; i < source_mesh.getTriangleCount(); ++i) {
+            tris.push_back(source_mesh.getTriangle(i));
         }
-        recurseBuild(mesh.tris);
+        recurseBuild(tris);
     }
 
     PhysicsMesh() = default;
@@ -199,6 +236,38 @@ public:
         return rayCastRecurse(origin,direction,distance,(int)bvh.size()-1);
     }
 
+    /**
+     * Ray cast the Physics mesh for the closest triangle
+     * @param origin Origin of ray
+     * @param direction Direction of ray
+     * @param distance Distance if hit
+     * @param triangle Index of hit triangle in the source mesh if hit
+     * @param front_faces_only Pass through triangles facing away from the ray, like the renderer does.
+     * @return True if hit
+     */
+    bool rayCast(const glm::vec3& origin, const glm::vec3& direction,float & distance, int& triangle, bool front_faces_only = false) const {
+        if(bvh.empty()) return false;
+        float closest = std::numeric_limits<float>::infinity();
+        int closest_triangle = -1;
+        rayCastClosestRecurse(origin,direction,closest,closest_triangle,front_faces_only,(int)bvh.size()-1);
+        if(closest_triangle == -1) return false;
+        distance = closest;
+        triangle = tris[closest_triangle].index;
+        return true;
+    }
+
+    /**
+     * Check if any triangle crosses a line segment
+     * @param a,b Ends of segment
+     * @return True if blocked
+     * @details Cheaper than rayCast(), since it only needs any hit rather than the closest one.
+     */
+    [[nodiscard]] bool segmentBlocked(const glm::vec3& a, const glm::vec3& b) const {
+        float length = glm::distance(a,b);
+        if(length <= 0 || bvh.empty()) return false;
+        return segmentBlockedRecurse(a,b,(b-a)/length,length,(int)bvh.size()-1);
+    }
+
     /**
      * Collide a sphere with the mesh
      * @param sphere Sphere to collide
@@ -208,6 +277,6 @@ public:
         return collideRecurse(sphere,(int)bvh.size()-1);
     }
 
-    Mesh mesh;
+    std::vector<Triangle> tris; //Standalone triangles, since ray casts need the positions of all three vertices at once
     std::vector<BVNode> bvh; //Root node is last node
 };
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <cstdint>
+#include <limits>
+#include "../Renderer/Mesh.hpp"
+#include "PhysicsMesh.hpp"
+
+/**
+ * Precomputed visibility of a static mesh
+ * @details The mesh bounds are split into a grid of cubic cells.
+ * Every cell stores a bitset of the meshlets and a bitset of the cells that can be seen from anywhere inside of it.
+ * Positions outside the grid see everything.
+ */
+class PotentiallyVisibleSet {
+public:
+    glm::vec3 min_bound{}; //Corner of the first cell
+    float cell_size = 1;
+    glm::ivec3 dimensions{0,0,0}; //Cells along each axis
+    uint32_t meshlet_count = 0; //Meshlets of the mesh this was built for
+    uint64_t mesh_hash = 0; //Mesh::getGeometryHash() of the mesh this was built for
+    std::vector<uint64_t> meshlet_bits; //Per cell, meshlet words each
+    std::vector<uint64_t> cell_bits; //Per cell, cell words each
+
+private:
+    /**
+     * Number of 64-bit words needed for a bitset
+     */
+    static size_t wordCount(size_t bits){
+        return (bits + 63) / 64;
+    }
+
+    static void setBit(uint64_t* bits, size_t index){
+        bits[index / 64] |= 1ull << (index % 64);
+    }
+
+    static bool getBit(const uint64_t* bits, size_t index){
+        return (bits[index / 64] >> (index % 64)) & 1;
+    }
+
+    /**
+     * Get the grid coordinate of a cell
+     */
+    [[nodiscard]] glm::ivec3 cellCoordinate(int cell) const {
+        return {cell % dimensions.x, (cell / dimensions.x) % dimensions.y, cell / (dimensions.x * dimensions.y)};
+    }
+
+    /**
+     * Get the center of a cell
+     */
+    [[nodiscard]] glm::vec3 cellCenter(int cell) const {
+        return min_bound + (glm::vec3(cellCoordinate(cell)) + 0.5f) * cell_size;
+    }
+
+    /**
+     * Mark every cell a ray passes through
+     * @param visible_cells Bitset to mark
+     * @param origin Start of ray. Inside of the grid.
+     * @param direction Normalized direction of ray
+     * @param length Distance to stop at
+     * @see http://www.cse.yorku.ca/~amana/research/grid.pdf
+     */
+    void markCellsAlongRay(uint64_t* visible_cells, const glm::vec3& origin, const glm::vec3& direction, float length) const {
+        glm::vec3 local = (origin - min_bound) / cell_size;
+        glm::ivec3 coordinate = glm::ivec3(glm::floor(local));
+        glm::ivec3 step{};
+        glm::vec3 next_boundary{}, boundary_spacing{}; //Ray distance to the next cell border along each axis, and between borders
+        for (int axis = 0; axis < 3; ++axis) {
+            if(direction[axis] == 0){
+                next_boundary[axis] = boundary_spacing[axis] = std::numeric_limits<float>::infinity();
+                continue;
+            }
+            step[axis] = direction[axis] > 0 ? 1 : -1;
+            float boundary = (float)coordinate[axis] + (direction[axis] > 0 ? 1.0f : 0.0f);
+            next_boundary[axis] = (boundary - local[axis]) * cell_size / direction[axis];
+            boundary_spacing[axis] = cell_size / fabsf(direction[axis]);
+        }
+        while(glm::all(glm::greaterThanEqual(coordinate,glm::ivec3(0))) && glm::all(glm::lessThan(coordinate,dimensions))){
+            setBit(visible_cells,coordinate.x + coordinate.y * dimensions.x + coordinate.z * dimensions.x * dimensions.y);
+            int axis = next_boundary.x < next_boundary.y ? (next_boundary.x < next_boundary.z ? 0 : 2) : (next_boundary.y < next_boundary.z ? 1 : 2);
+            if(next_boundary[axis] > length) break;
+            coordinate[axis] += step[axis];
+            next_boundary[axis] += boundary_spacing[axis];
+        }
+    }
+
+    /**
+     * Compute the visibility of a single cell
+     * @param cell Cell to compute
+     * @param mesh Mesh with meshlets
+     * @param triangle_meshlets Meshlet of each triangle in the mesh
+     * @param occluder Physics mesh of the same mesh
+     * @param samples Points in the cell to cast from
+     * @param directions Directions to cast in from each point
+     * @details Anything hit by a ray is visible, as is every cell a ray passes through before hitting something.
+     * Rays pass through backfaces, since the renderer does not draw them.
+     */
+    void buildCell(int cell, const Mesh& mesh, const std::vector<uint32_t>& triangle_meshlets, const PhysicsMesh& occluder, int samples, const std::vector<glm::vec3>& directions){
+        uint64_t* visible_meshlets = meshlet_bits.data() + cell * wordCount(meshlet_count);
+        uint64_t* visible_cells = cell_bits.data() + cell * wordCount(getCellCount());
+        glm::vec3 center = cellCenter(cell);
+
+        //Meshlets touching the cell are always visible
+        for (size_t m = 0; m < mesh.meshlets.size(); ++m) {
+            if(glm::all(glm::lessThanEqual(glm::abs(mesh.meshlets[m].center - center), glm::vec3(cell_size * 0.5f + mesh.meshlets[m].radius)))){
+                setBit(visible_meshlets,m);
+            }
+        }
+        //Neighbors are always visible, to hide sampling gaps at cell borders
+        glm::ivec3 coordinate = cellCoordinate(cell);
+        for (int z = std::max(0,coordinate.z-1); z <= std::min(dimensions.z-1,coordinate.z+1); ++z) {
+            for (int y = std::max(0,coordinate.y-1); y <= std::min(dimensions.y-1,coordinate.y+1); ++y) {
+                for (int x = std::max(0,coordinate.x-1); x <= std::min(dimensions.x-1,coordinate.x+1); ++x) {
+                    setBit(visible_cells,x + y * dimensions.x + z * dimensions.x * dimensions.y);
+                }
+            }
+        }
+
+        std::mt19937 generator(cell); //Seeded by cell so the output is deterministic regardless of thread count
+        std::uniform_real_distribution<float> offset(-0.5f,0.5f);
+        for (int i = 0; i < samples; ++i) {
+            glm::vec3 eye = i == 0 ? center : center + glm::vec3{offset(generator),offset(generator),offset(generator)} * cell_size;
+            for (const glm::vec3& direction : directions) {
+                float distance;
+                int triangle;
+                if(occluder.rayCast(eye,direction,distance,triangle,true)){
+                    setBit(visible_meshlets,triangle_meshlets[triangle]);
+                }else{
+                    distance = std::numeric_limits<float>::infinity();
+                }
+                markCellsAlongRay(visible_cells,eye,direction,distance);
+            }
+        }
+    }
+
+public:
+    PotentiallyVisibleSet() = default;
+
+    /**
+     * Precompute the visibility of a mesh by ray casting
+     * @param mesh Mesh to compute visibility for. Must have meshlets.
+     * @param occluder Physics mesh of the same mesh, used for ray casts.
+     * @param new_cell_size Size of each cell.
+     * @param samples Number of points per cell to cast from, at least 1.
+     * @param rays Number of rays cast from each point. More rays are slower, but miss fewer small or distant meshlets.
+     * @details Runs on all hardware threads. Meant to be run offline, see the PVSBuilder target.
+     */
+    PotentiallyVisibleSet(const Mesh& mesh, const PhysicsMesh& occluder, float new_cell_size, int samples, int rays) : cell_size(new_cell_size) {
+        glm::vec3 max_bound = mesh.vertices[0].pos;
+        min_bound = max_bound;
+        for (const Vertex& vertex : mesh.vertices) {
+            min_bound = glm::min(min_bound,vertex.pos);
+            max_bound = glm::max(max_bound,vertex.pos);
+        }
+        //Pad by a cell so cameras just outside the geometry are still covered
+        min_bound -= cell_size;
+        dimensions = glm::ivec3(glm::ceil((max_bound + cell_size - min_bound) / cell_size));
+        meshlet_count = (uint32_t)mesh.meshlets.size();
+        mesh_hash = mesh.getGeometryHash();
+        meshlet_bits.resize(getCellCount() * wordCount(meshlet_count));
+        cell_bits.resize(getCellCount() * wordCount(getCellCount()));
+
+        std::vector<uint32_t> triangle_meshlets(mesh.getTriangleCount());
+        for (size_t m = 0; m < mesh.meshlets.size(); ++m) {
+            std::fill(triangle_meshlets.begin() + (long long)mesh.meshlets[m].start, triangle_meshlets.begin() + (long long)mesh.meshlets[m].end, (uint32_t)m);
+        }
+        //Evenly spread directions on a sphere
+        //see http://extremelearning.com.au/how-to-evenly-distribute-points-on-a-sphere-more-effectively-than-the-canonical-fibonacci-lattice/
+        std::vector<glm::vec3> directions(rays);
+        const float GOLDEN_ANGLE = 2.39996323f;
+        for (int i = 0; i < rays; ++i) {
+            float z = 1.0f - 2.0f * ((float)i + 0.5f) / (float)rays;
+            float ring = sqrtf(1.0f - z*z);
+            directions[i] = {ring * cosf(GOLDEN_ANGLE * (float)i), ring * sinf(GOLDEN_ANGLE * (float)i), z};
+        }
+
+        std::atomic<int> next_cell = 0;
+        std::vector<std::thread> threads(std::max(1u,std::thread::hardware_concurrency()));
+        for (std::thread& thread : threads) {
+            thread = std::thread([&](){
+                for (int cell = next_cell++; cell < getCellCount(); cell = next_cell++) {
+                    buildCell(cell,mesh,triangle_meshlets,occluder,samples,directions);
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        //Grow each meshlet set by its neighbors', since a few points can not see everything a camera anywhere in the cell can
+        std::vector<uint64_t> sampled_meshlet_bits = meshlet_bits;
+        size_t meshlet_words = wordCount(meshlet_count);
+        for (int cell = 0; cell < getCellCount(); ++cell) {
+            glm::ivec3 coordinate = cellCoordinate(cell);
+            for (int z = std::max(0,coordinate.z-1); z <= std::min(dimensions.z-1,coordinate.z+1); ++z) {
+                for (int y = std::max(0,coordinate.y-1); y <= std::min(dimensions.y-1,coordinate.y+1); ++y) {
+                    for (int x = std::max(0,coordinate.x-1); x <= std::min(dimensions.x-1,coordinate.x+1); ++x) {
+                        const uint64_t* neighbor = sampled_meshlet_bits.data() + (x + y * dimensions.x + z * dimensions.x * dimensions.y) * meshlet_words;
+                        for (size_t word = 0; word < meshlet_words; ++word) {
+                            meshlet_bits[cell * meshlet_words + word] |= neighbor[word];
+                        }
+                    }
+                }
+            }
+        }
+        //Line of sight goes both ways
+        size_t cell_words = wordCount(getCellCount());
+        for (int cell = 0; cell < getCellCount(); ++cell) {
+            for (int other = cell + 1; other < getCellCount(); ++other) {
+                if(getBit(cell_bits.data() + cell * cell_words, other)) setBit(cell_bits.data() + other * cell_words, cell);
+                if(getBit(cell_bits.data() + other * cell_words, cell)) setBit(cell_bits.data() + cell * cell_words, other);
+            }
+        }
+    }
+
+    /**
+     * Get the total number of cells
+     */
+    [[nodiscard]] int getCellCount() const {
+        return dimensions.x * dimensions.y * dimensions.z;
+    }
+
+    /**
+     * Get the cell containing a point
+     * @param position Point in the space of the mesh
+     * @return Cell index, or -1 if outside of the grid
+     */
+    [[nodiscard]] int getCell(const glm::vec3& position) const {
+        glm::ivec3 coordinate = glm::ivec3(glm::floor((position - min_bound) / cell_size));
+        if(glm::any(glm::lessThan(coordinate,glm::ivec3(0))) || glm::any(glm::greaterThanEqual(coordinate,dimensions))) return -1;
+        return coordinate.x + coordinate.y * dimensions.x + coordinate.z * dimensions.x * dimensions.y;
+    }
+
+    /**
+     * Get the bitset of meshlets visible from a cell
+     * @param cell Cell index from getCell()
+     * @return Bit per meshlet, or nullptr if everything is visible
+     */
+    [[nodiscard]] const uint64_t* getVisibleMeshlets(int cell) const {
+        if(cell < 0) return nullptr;
+        return meshlet_bits.data() + cell * wordCount(meshlet_count);
+    }
+
+    /**
+     * Check if a meshlet is in a visible meshlet bitset
+     * @param visible_meshlets Bitset from getVisibleMeshlets(). Nullptr means everything is visible.
+     * @param meshlet Meshlet index
+     */
+    static bool isMeshletVisible(const uint64_t* visible_meshlets, size_t meshlet) {
+        return visible_meshlets == nullptr || getBit(visible_meshlets,meshlet);
+    }
+
+    /**
+     * Check if a bounding volume could be seen from a position
+     * @param eye Viewer position in the space of the mesh
+     * @param bounds Volume in the space of the mesh
+     * @return True if any cell the volume overlaps is visible from the viewer's cell
+     */
+    [[nodiscard]] bool isVisible(const glm::vec3& eye, const SphereBV& bounds) const {
+        int eye_cell = getCell(eye);
+        if(eye_cell < 0) return true;
+        glm::ivec3 low = glm::ivec3(glm::floor((bounds.position - bounds.radius - min_bound) / cell_size));
+        glm::ivec3 high = glm::ivec3(glm::floor((bounds.position + bounds.radius - min_bound) / cell_size));
+        //Anything reaching outside the grid may be seen from anywhere
+        if(glm::any(glm::lessThan(low,glm::ivec3(0))) || glm::any(glm::greaterThanEqual(high,dimensions))) return true;
+        const uint64_t* visible_cells = &cell_bits[eye_cell * wordCount(getCellCount())];
+        for (int z = low.z; z <= high.z; ++z) {
+            for (int y = low.y; y <= high.y; ++y) {
+                for (int x = low.x; x <= high.x; ++x) {
+                    if(getBit(visible_cells,x + y * dimensions.x + z * dimensions.x * dimensions.y)) return true;
+                }
+            }
+        }
+        return false;
+    }
+};
@@ -12,6 +12,13 @@
  */
 typedef std::function<float(const glm::vec3&)> SDF;
 
+/**
+ * Signed distance field evaluated at four points at once
+ * Points are passed one axis per vector(structure of arrays), so simple fields compile to wide vector math.
+ * World space x,y,z of each point in -> signed distance of each point out.
+ */
+typedef std::function<glm::vec4(const glm::vec4& x, const glm::vec4& y, const glm::vec4& z)> SDFPacket;
+
 /**
  * Estimate the normal of the surface nearest to a point querying the SDF function
  * @param sdf Signed distance field
@@ -185,5 +192,15 @@ float sphereSDF(const glm::vec3& point, float radius){
     return glm::length(point)- radius;
 }
 
+/**
+ * SDF for four points of a sphere at once
+ * @param x,y,z Input points, one axis per vector
+ * @param radius Sphere radius
+ * @return Signed distance of each point
+ */
+glm::vec4 sphereSDF(const glm::vec4& x, const glm::vec4& y, const glm::vec4& z, float radius){
+    return glm::sqrt(x*x + y*y + z*z) - radius;
+}
+
 //todo improve collision detection for deeply intersected objects
 //todo write article on how it works
\ No newline at end of file
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cmath>
+#include <cassert>
+#include <cstdint>
+#include "../Renderer/Camera.hpp"
+#include "../Renderer/Triangle.hpp"
+#include "SphereBV.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPHERE_BV_ARRAY_SSE
+#endif
+
+/**
+ * Many sphere bounding volumes, stored as a separate array per component so they can be culled in groups
+ * @details Padded to a multiple of GROUP_SIZE with spheres that are never visible, so groups never need a partial path.
+ */
+class SphereBVArray {
+public:
+    /**
+     * Spheres tested at once, one byte of the visibility mask
+     */
+    static const int GROUP_SIZE = 8;
+private:
+    std::vector<float> x{}, y{}, z{}, radius{}; //Always a multiple of GROUP_SIZE long
+    size_t count = 0;
+public:
+
+    /**
+     * Remove all spheres, keeping the memory
+     */
+    void clear(){
+        x.clear();
+        y.clear();
+        z.clear();
+        radius.clear();
+        count = 0;
+    }
+
+    /**
+     * Add a sphere
+     * @param sphere Sphere to add, gets the index size() had before
+     */
+    void push(const SphereBV& sphere){
+        if(count % GROUP_SIZE == 0){ //Start a new group of padding
+            x.resize(count + GROUP_SIZE, 0);
+            y.resize(count + GROUP_SIZE, 0);
+            z.resize(count + GROUP_SIZE, 0);
+            radius.resize(count + GROUP_SIZE, -INFINITY); //Behind every plane
+        }
+        x[count] = sphere.position.x;
+        y[count] = sphere.position.y;
+        z[count] = sphere.position.z;
+        radius[count] = sphere.radius;
+        count++;
+    }
+
+    /**
+     * Get the number of spheres, not counting padding
+     */
+    [[nodiscard]] size_t size() const {
+        return count;
+    }
+
+    /**
+     * Get a sphere
+     * @param index Index of the sphere. Must be in bounds.
+     */
+    [[nodiscard]] SphereBV get(size_t index) const {
+        assert(index < count);
+        return SphereBV{{x[index],y[index],z[index]},radius[index]};
+    }
+
+    /**
+     * Check which spheres are in the frustum of a camera, the same as SphereBV::inFrustum() on each of them
+     * @param camera Camera
+     * @param visible Output bitmask, bit i of byte j is set if sphere j*GROUP_SIZE+i is in the frustum. Resized to fit.
+     * @see isVisible()
+     */
+    void inFrustum(const Camera& camera, std::vector<uint8_t>& visible) const {
+        visible.resize(x.size() / GROUP_SIZE);
+        //Flip the planes to face out, and fold the plane offset into a distance from the origin
+        float normal_x[6], normal_y[6], normal_z[6], distance[6];
+        const std::array<Plane,6>& planes = camera.getFrustumPlanes();
+        for (int i = 0; i < 6; ++i) {
+            glm::vec3 normal = -planes[i].normal;
+            normal_x[i] = normal.x;
+            normal_y[i] = normal.y;
+            normal_z[i] = normal.z;
+            distance[i] = glm::dot(planes[i].offset, normal);
+        }
+        for (size_t group = 0; group < visible.size(); ++group) {
+            size_t start = group * GROUP_SIZE;
+#ifdef SPHERE_BV_ARRAY_SSE
+            //Two halves of four lanes
+            __m128 x_low = _mm_loadu_ps(&x[start]), x_high = _mm_loadu_ps(&x[start + 4]);
+            __m128 y_low = _mm_loadu_ps(&y[start]), y_high = _mm_loadu_ps(&y[start + 4]);
+            __m128 z_low = _mm_loadu_ps(&z[start]), z_high = _mm_loadu_ps(&z[start + 4]);
+            __m128 reach_low = _mm_loadu_ps(&radius[start]), reach_high = _mm_loadu_ps(&radius[start + 4]);
+            reach_low = _mm_add_ps(reach_low, reach_low); //SphereBV::intersectPlaneOrBehind() allows twice the radius
+            reach_high = _mm_add_ps(reach_high, reach_high);
+            __m128 inside_low = _mm_castsi128_ps(_mm_set1_epi32(-1)), inside_high = inside_low;
+            for (int i = 0; i < 6; ++i) {
+                __m128 plane_x = _mm_set1_ps(normal_x[i]), plane_y = _mm_set1_ps(normal_y[i]), plane_z = _mm_set1_ps(normal_z[i]), plane_distance = _mm_set1_ps(distance[i]);
+                __m128 distance_low = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x_low, plane_x), _mm_mul_ps(y_low, plane_y)), _mm_mul_ps(z_low, plane_z)), plane_distance);
+                __m128 distance_high = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x_high, plane_x), _mm_mul_ps(y_high, plane_y)), _mm_mul_ps(z_high, plane_z)), plane_distance);
+                inside_low = _mm_and_ps(inside_low, _mm_cmplt_ps(distance_low, reach_low));
+                inside_high = _mm_and_ps(inside_high, _mm_cmplt_ps(distance_high, reach_high));
+            }
+            visible[group] = (uint8_t)(_mm_movemask_ps(inside_low) | (_mm_movemask_ps(inside_high) << 4));
+#else
+            uint8_t mask = 0;
+            for (int lane = 0; lane < GROUP_SIZE; ++lane) {
+                size_t index = start + lane;
+                bool inside = true;
+                for (int i = 0; i < 6; ++i) {
+                    inside &= x[index] * normal_x[i] + y[index] * normal_y[i] + z[index] * normal_z[i] - distance[i] < radius[index] * 2;
+                }
+                mask |= (uint8_t)inside << lane;
+            }
+            visible[group] = mask;
+#endif
+        }
+    }
+
+    /**
+     * Read a visibility bitmask written by inFrustum()
+     * @param visible Bitmask
+     * @param index Index of the sphere
+     * @return True if the sphere is in the frustum
+     */
+    static bool isVisible(const std::vector<uint8_t>& visible, size_t index) {
+        return (visible[index / GROUP_SIZE] >> (index % GROUP_SIZE)) & 1;
+    }
+};
@@ -3,6 +3,7 @@
 //
 
 #pragma once
+#include <array>
 #include <glm/glm.hpp>
 #include <glm/gtx/euler_angles.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -83,6 +84,7 @@ public:
     void updateAspectRatio(float new_aspect_ratio){
         aspect_ratio = new_aspect_ratio;
         projection = glm::perspective(fov_radians,aspect_ratio,near_plane_distance,far_plane_distance);
+        updateTransform(); //Frustum planes depend on the aspect ratio
     }
 
     /**
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include "PixelSpan.hpp"
+
+/**
+ * Width and height in pixels of a glyph of drawText(), before scaling
+ */
+const int DEBUG_GLYPH_WIDTH = 5, DEBUG_GLYPH_HEIGHT = 7;
+
+/**
+ * Get the rows of a glyph of the built in debug font
+ * @param character Character to look up. Lower case is drawn as upper case.
+ * @return Seven rows, the low five bits of each are pixels with the leftmost as bit 4. Nullptr if the font has no such glyph.
+ * @details Only digits, letters, and a few symbols, enough for stats and labels.
+ */
+inline const uint8_t* getDebugGlyph(char character){
+    static const char characters[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:-+/%_";
+    static const uint8_t glyphs[][DEBUG_GLYPH_HEIGHT] = {
+            {0x0E,0x11,0x13,0x15,0x19,0x11,0x0E}, {0x04,0x0C,0x04,0x04,0x04,0x04,0x0E}, {0x0E,0x11,0x01,0x02,0x04,0x08,0x1F},
+            {0x1F,0x02,0x04,0x02,0x01,0x11,0x0E}, {0x02,0x06,0x0A,0x12,0x1F,0x02,0x02}, {0x1F,0x10,0x1E,0x01,0x01,0x11,0x0E},
+            {0x06,0x08,0x10,0x1E,0x11,0x11,0x0E}, {0x1F,0x01,0x02,0x04,0x08,0x08,0x08}, {0x0E,0x11,0x11,0x0E,0x11,0x11,0x0E},
+            {0x0E,0x11,0x11,0x0F,0x01,0x02,0x0C}, //Digits
+            {0x0E,0x11,0x11,0x1F,0x11,0x11,0x11}, {0x1E,0x11,0x11,0x1E,0x11,0x11,0x1E}, {0x0E,0x11,0x10,0x10,0x10,0x11,0x0E},
+            {0x1C,0x12,0x11,0x11,0x11,0x12,0x1C}, {0x1F,0x10,0x10,0x1E,0x10,0x10,0x1F}, {0x1F,0x10,0x10,0x1E,0x10,0x10,0x10},
+            {0x0E,0x11,0x10,0x17,0x11,0x11,0x0F}, {0x11,0x11,0x11,0x1F,0x11,0x11,0x11}, {0x0E,0x04,0x04,0x04,0x04,0x04,0x0E},
+            {0x07,0x02,0x02,0x02,0x02,0x12,0x0C}, {0x11,0x12,0x14,0x18,0x14,0x12,0x11}, {0x10,0x10,0x10,0x10,0x10,0x10,0x1F},
+            {0x11,0x1B,0x15,0x15,0x11,0x11,0x11}, {0x11,0x11,0x19,0x15,0x13,0x11,0x11}, {0x0E,0x11,0x11,0x11,0x11,0x11,0x0E},
+            {0x1E,0x11,0x11,0x1E,0x10,0x10,0x10}, {0x0E,0x11,0x11,0x11,0x15,0x12,0x0D}, {0x1E,0x11,0x11,0x1E,0x14,0x12,0x11},
+            {0x0F,0x10,0x10,0x0E,0x01,0x01,0x1E}, {0x1F,0x04,0x04,0x04,0x04,0x04,0x04}, {0x11,0x11,0x11,0x11,0x11,0x11,0x0E},
+            {0x11,0x11,0x11,0x11,0x11,0x0A,0x04}, {0x11,0x11,0x11,0x15,0x15,0x15,0x0A}, {0x11,0x11,0x0A,0x04,0x0A,0x11,0x11},
+            {0x11,0x11,0x11,0x0A,0x04,0x04,0x04}, {0x1F,0x01,0x02,0x04,0x08,0x10,0x1F}, //Letters
+            {0x00,0x00,0x00,0x00,0x00,0x0C,0x0C}, {0x00,0x0C,0x0C,0x00,0x0C,0x0C,0x00}, {0x00,0x00,0x00,0x1F,0x00,0x00,0x00},
+            {0x00,0x04,0x04,0x1F,0x04,0x04,0x00}, {0x00,0x01,0x02,0x04,0x08,0x10,0x00}, {0x18,0x19,0x02,0x04,0x08,0x13,0x03},
+            {0x00,0x00,0x00,0x00,0x00,0x00,0x1F} //Symbols
+    };
+    if(character >= 'a' && character <= 'z') character = (char)(character - 'a' + 'A');
+    if(character == '\0') return nullptr;
+    const char* found = std::strchr(characters, character);
+    return found == nullptr ? nullptr : glyphs[found - characters];
+}
+
+/**
+ * Draw a line of text with the built in debug font, for overlays like render stats
+ * @param target Pixels to draw to. Text is clipped to it.
+ * @param x,y Pixel of the top left corner of the first glyph. Rows go down the image, like the rest of the pixel span.
+ * @param text Text to draw. Characters without a glyph, like spaces, are left blank.
+ * @param color Packed rgba color of the text
+ * @param scale Size of a font pixel in pixels
+ * @details Each glyph gets a dark shadow one font pixel down and right, so it stays readable over any scene.
+ */
+inline void drawText(const PixelSpan& target, int x, int y, const std::string& text, uint32_t color, int scale = 1){
+    const uint32_t SHADOW_COLOR = 0xFF000000;
+    for (int pass = 0; pass < 2; ++pass) { //Shadow first
+        int offset = pass == 0 ? scale : 0;
+        uint32_t pass_color = pass == 0 ? SHADOW_COLOR : color;
+        for (size_t i = 0; i < text.size(); ++i) {
+            const uint8_t* glyph = getDebugGlyph(text[i]);
+            if(glyph == nullptr) continue;
+            int glyph_x = x + (int)i * (DEBUG_GLYPH_WIDTH + 1) * scale + offset;
+            for (int row = 0; row < DEBUG_GLYPH_HEIGHT * scale; ++row) {
+                int pixel_y = y + row + offset;
+                if(pixel_y < 0 || pixel_y >= target.height) continue;
+                uint32_t* pixels = target.getRow(pixel_y);
+                uint8_t bits = glyph[row / scale];
+                for (int column = 0; column < DEBUG_GLYPH_WIDTH * scale; ++column) {
+                    int pixel_x = glyph_x + column;
+                    if(pixel_x < 0 || pixel_x >= target.width) continue;
+                    if((bits >> (DEBUG_GLYPH_WIDTH - 1 - column / scale)) & 1) pixels[pixel_x] = pass_color;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+#include <glm/glm.hpp>
+
+/**
+ * Picks a render resolution so frame times stay near a target
+ * @details Rasterization cost is roughly proportional to pixel count, so the linear scale is corrected by the square root of the time ratio.
+ * Frame times are smoothed and changes are spaced out to avoid oscillating between resolutions.
+ */
+class DynamicResolution {
+private:
+    double target_ms; //Frame time to hold
+    float min_scale, max_scale; //Limits of the render scale, relative to the window size
+    float scale = 1.0f; //Current linear scale
+    double average_ms = -1; //Smoothed frame time, negative until the first frame
+    int frames_since_change = 0;
+
+    /**
+     * Frames to wait after a change before changing again, so the average reflects the new resolution
+     */
+    static const int SETTLE_FRAMES = 15;
+
+public:
+    /**
+     * Create a resolution controller
+     * @param target_ms Frame time to hold in milliseconds
+     * @param min_scale Lowest render scale relative to the window, 0-1.
+     * @param max_scale Highest render scale relative to the window.
+     */
+    explicit DynamicResolution(double target_ms, float min_scale = 0.4f, float max_scale = 1.0f) : target_ms(target_ms), min_scale(min_scale), max_scale(max_scale) {
+        assert(min_scale > 0 && min_scale <= max_scale);
+        scale = max_scale;
+    }
+
+    /**
+     * Add the time of a finished frame and update the scale
+     * @param frame_ms Time between frames in milliseconds
+     * @return True if the scale changed
+     */
+    bool addFrameTime(double frame_ms) {
+        average_ms = average_ms < 0 ? frame_ms : average_ms * 0.9 + frame_ms * 0.1;
+        frames_since_change++;
+        if(frames_since_change < SETTLE_FRAMES) return false;
+        float new_scale = scale;
+        if(average_ms > target_ms * 1.05){ //Too slow, drop resolution right away
+            new_scale = std::max(min_scale, scale * (float)std::sqrt(target_ms / average_ms));
+        } else if(average_ms < target_ms * 0.8){ //Plenty of headroom, raise it slowly
+            new_scale = std::min(max_scale, scale * std::min(1.1f,(float)std::sqrt(target_ms / average_ms)));
+        }
+        if(std::abs(new_scale - scale) < 0.01f) return false;
+        scale = new_scale;
+        frames_since_change = 0;
+        return true;
+    }
+
+    /**
+     * Get the current linear render scale relative to the window
+     */
+    [[nodiscard]] float getScale() const {
+        return scale;
+    }
+
+    /**
+     * Get the render resolution for a window
+     * @param window_size Window size in pixels
+     * @return Scaled size in pixels, rounded to a multiple of 4 and at least 16
+     */
+    [[nodiscard]] glm::ivec2 getRenderSize(const glm::ivec2& window_size) const {
+        glm::ivec2 size = glm::ivec2(glm::round(glm::vec2(window_size) * scale / 4.0f)) * 4;
+        return glm::max(size, glm::ivec2(16));
+    }
+};
@@ -5,29 +5,58 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cassert>
 #include <iostream>
+#include "PixelSpan.hpp"
 
 /**
  * The final image is stored here
+ * @details Stored as two separate planes, a 32-bit float depth plane and a packed RGBA8 color plane.
+ * This way the depth test only has to touch 4 bytes per pixel, and the color plane can be handed to the window as is.
  */
 class FrameBuffer {
 private:
-    std::vector<glm::vec4> pixels; // r,g,b,depth
-    std::vector<uint8_t> bit_pixels; //rgba
+    std::vector<float> depth; //Depth of each pixel
+    std::vector<uint32_t> colors; //Packed rgba, byte order r,g,b,a in memory
     int width{},height{};
 public:
 
+    /**
+     * Pack an 8-bit color into a pixel
+     * @param color R,G,B in 0-255 range
+     * @return Packed rgba pixel with full alpha
+     */
+    static uint32_t packColor(const glm::vec3& color) {
+        return packColor((uint8_t)color.x,(uint8_t)color.y,(uint8_t)color.z);
+    }
+
+    /**
+     * Pack an 8-bit color into a pixel
+     * @param r,g,b Color channels
+     * @return Packed rgba pixel with full alpha
+     */
+    static uint32_t packColor(uint8_t r, uint8_t g, uint8_t b) {
+        return (uint32_t)r | ((uint32_t)g << 8) | ((uint32_t)b << 16) | (0xFFu << 24);
+    }
+
+    /**
+     * Unpack a pixel into an 8-bit color
+     * @param pixel Packed rgba pixel
+     * @return R,G,B in 0-255 range
+     */
+    static glm::vec3 unpackColor(uint32_t pixel) {
+        return {(float)(pixel & 0xFF),(float)((pixel >> 8) & 0xFF),(float)((pixel >> 16) & 0xFF)};
+    }
+
     /**
      * Create a new framebuffer
      * @param width Width in pixels
      * @param height Height in pixels
      * @param default_value Initial pixel values. R,G,B,Depth
      */
-    FrameBuffer(int width, int height, const glm::vec4& default_value) : pixels(width*height), bit_pixels(width*height*4), width(width), height(height) {
-        for(glm::vec4& pixel : pixels){
-            pixel = default_value;
-        }
-    }
+    FrameBuffer(int width, int height, const glm::vec4& default_value) : depth(width*height,default_value.w), colors(width*height,packColor(glm::vec3(default_value))), width(width), height(height) {}
 
     //todo review
     FrameBuffer(){
@@ -35,50 +64,98 @@ public:
     };
 
     /**
-     * Get pixel value at coordinate
+     * Get pixel depth at coordinate
      * @param x,y Coordinate. Must be in bounds.
-     * @return R,G,B,Depth
      */
-    [[nodiscard]] const glm::vec4& getPixel(int x, int y) const {
+    [[nodiscard]] float getDepth(int x, int y) const {
         assert(x >= 0 && x < width);
         assert(y >= 0 && y < height);
-        return pixels[y*width+x];
+        return depth[y*width+x];
+    }
+
+    /**
+     * Get packed pixel color at coordinate
+     * @param x,y Coordinate. Must be in bounds.
+     * @return Packed rgba pixel
+     */
+    [[nodiscard]] uint32_t getColor(int x, int y) const {
+        assert(x >= 0 && x < width);
+        assert(y >= 0 && y < height);
+        return colors[y*width+x];
     }
 
     /**
     * Set pixel value at coordinate
     * @param x,y Coordinate. Must be in bounds.
-    * @param new_pixel R,G,B,Depth
+    * @param color Packed rgba pixel
+    * @param new_depth Depth of pixel
     */
-    void setPixel(int x, int y, const glm::vec4& new_pixel) {
+    void setPixel(int x, int y, uint32_t color, float new_depth) {
+        assert(x >= 0 && x < width);
+        assert(y >= 0 && y < height);
+        depth[y*width+x] = new_depth;
+        colors[y*width+x] = color;
+    }
+
+    /**
+     * Set pixel color at coordinate, keeping its depth
+     * @param x,y Coordinate. Must be in bounds.
+     * @param color Packed rgba pixel
+     */
+    void setColor(int x, int y, uint32_t color) {
         assert(x >= 0 && x < width);
         assert(y >= 0 && y < height);
-        pixels[y*width+x] = new_pixel;
-        int offset = (y*width+x)*4;
-        bit_pixels[offset + 0] = (uint8_t)new_pixel.x;
-        bit_pixels[offset + 1] = (uint8_t)new_pixel.y;
-        bit_pixels[offset + 2] = (uint8_t)new_pixel.z;
-        bit_pixels[offset + 3] = 255;
+        colors[y*width+x] = color;
     }
 
     /**
    * Set pixel value at coordinate if depth is less than current pixel
    * @param x,y Coordinate. Must be in bounds.
-   * @param new_pixel R,G,B,Depth
+   * @param color Packed rgba pixel
+   * @param new_depth Depth of pixel
    */
-    void setPixelIfDepth(int x, int y, const glm::vec4& new_pixel){
-        if(new_pixel.w < getPixel(x,y).w ){
-            setPixel(x,y,new_pixel);
+    void setPixelIfDepth(int x, int y, uint32_t color, float new_depth){
+        if(new_depth < getDepth(x,y)){
+            setPixel(x,y,color,new_depth);
         }
     }
+
     /**
      * Set pixel value at coordinate if depth is greater than current pixel
      * @param x,y Coordinate. Must be in bounds.
-     * @param new_pixel R,G,B,Depth
+     * @param color Packed rgba pixel
+     * @param new_depth Depth of pixel
+     */
+    void setPixelIfDepthGreater(int x, int y, uint32_t color, float new_depth){
+        if(new_depth >= getDepth(x,y)){
+            setPixel(x,y,color,new_depth);
+        }
+    }
+
+    /**
+     * Reset every pixel to a color and depth
+     * @param color Packed rgba pixel
+     * @param new_depth Depth of pixel
+     * @details Fills each plane linearly, which compiles down to wide stores.
      */
-    void setPixelIfDepthGreater(int x, int y, const glm::vec4& new_pixel){
-        if(new_pixel.w >= getPixel(x,y).w ){
-            setPixel(x,y,new_pixel);
+    void clear(uint32_t color, float new_depth) {
+        std::fill(depth.begin(), depth.end(), new_depth);
+        std::fill(colors.begin(), colors.end(), color);
+    }
+
+    /**
+     * Reset a rectangle of pixels to a color and depth
+     * @param color Packed rgba pixel
+     * @param new_depth Depth of pixel
+     * @param min,max Inclusive pixel bounds. Clamped to the buffer.
+     */
+    void clear(uint32_t color, float new_depth, const glm::ivec2& min, const glm::ivec2& max) {
+        int start_x = std::max(min.x, 0), end_x = std::min(max.x, width - 1);
+        if(start_x > end_x) return;
+        for (int y = std::max(min.y, 0); y <= std::min(max.y, height - 1); ++y) {
+            size_t row_start = (size_t)y * width;
+            std::fill(depth.begin() + row_start + start_x, depth.begin() + row_start + end_x + 1, new_depth);
+            std::fill(colors.begin() + row_start + start_x, colors.begin() + row_start + end_x + 1, color);
         }
     }
 
@@ -96,10 +173,38 @@ public:
         return height;
     }
 
+    /**
+     * Get pointer to the depth plane. Row major.
+     */
+    [[nodiscard]] const float* getDepthPlane() const {
+        return depth.data();
+    }
+
+    /**
+     * Get pointer to the packed color plane. Row major.
+     */
+    [[nodiscard]] const uint32_t* getColorPlane() const {
+        return colors.data();
+    }
+
+    /**
+     * Get pointer to the depth plane for writing. Row major.
+     */
+    [[nodiscard]] float* getDepthPlane() {
+        return depth.data();
+    }
+
+    /**
+     * Get the color plane as a pixel span for writing
+     */
+    [[nodiscard]] PixelSpan getPixelSpan() {
+        return PixelSpan{colors.data(),width,height,width};
+    }
+
     /**
      * Get pointer to raw rgba image.
      */
     [[nodiscard]] const uint8_t *getRawImage() const {
-        return bit_pixels.data();
+        return reinterpret_cast<const uint8_t*>(colors.data());
     }
 };
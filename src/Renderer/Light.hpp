@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+/**
+ * A directional or point light, evaluated per vertex
+ */
+struct Light {
+    /**
+     * Max lights in a frame
+     */
+    static const int MAX_LIGHTS = 8;
+
+    enum Type {
+        DIRECTIONAL, //Infinitely far away, like the sun
+        POINT //Falls off to nothing at its range
+    };
+
+    Type type;
+    glm::vec3 color; //Intensity of each channel. 1 is full brightness.
+    glm::vec3 vector; //Direction the light travels for directional lights, position for point lights
+    float range; //Distance a point light reaches
+
+    /**
+     * Create a directional light
+     * @param direction Direction the light travels. Does not need to be normalized.
+     * @param color Intensity of each channel
+     */
+    static Light directional(const glm::vec3& direction, const glm::vec3& color) {
+        return Light{DIRECTIONAL, color, glm::normalize(direction), INFINITY};
+    }
+
+    /**
+     * Create a point light
+     * @param position Position of light
+     * @param color Intensity of each channel
+     * @param range Distance at which the light has faded out. Must be positive.
+     */
+    static Light point(const glm::vec3& position, const glm::vec3& color, float range) {
+        return Light{POINT, color, position, range};
+    }
+
+    /**
+     * Check if the light can reach a bounding sphere
+     * @param center,radius Sphere in the same space as the light
+     */
+    [[nodiscard]] bool reaches(const glm::vec3& center, float radius) const {
+        if(type == DIRECTIONAL) return true;
+        return glm::distance(center, vector) < range + radius;
+    }
+
+    /**
+     * Move the light into another space
+     * @param transform Rigid transform, such as a camera transform
+     */
+    [[nodiscard]] Light transformed(const glm::mat4& transform) const {
+        Light output = *this;
+        output.vector = type == DIRECTIONAL ? glm::vec3(transform * glm::vec4(vector,0.0f)) : glm::vec3(transform * glm::vec4(vector,1.0f));
+        return output;
+    }
+
+    /**
+     * Get the light arriving at a surface
+     * @param position Surface position, in the same space as the light
+     * @param normal Unit surface normal
+     * @return Diffuse intensity of each channel
+     */
+    [[nodiscard]] glm::vec3 evaluate(const glm::vec3& position, const glm::vec3& normal) const {
+        if(type == DIRECTIONAL){
+            return color * std::max(0.0f, -glm::dot(normal, vector));
+        }
+        glm::vec3 to_light = vector - position;
+        float distance = glm::length(to_light);
+        if(distance >= range || distance <= 0) return {0,0,0};
+        float falloff = 1.0f - distance / range; //Squared, so it fades out smoothly at the range
+        return color * (std::max(0.0f, glm::dot(normal, to_light) / distance) * falloff * falloff);
+    }
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+/**
+ * Baked lighting of a static mesh
+ * @details Created offline by the OVEN target. The renderer samples it as a second texture,
+ * using a second set of uvs that the lightmap carries for each triangle corner.
+ */
+struct Lightmap {
+    /**
+     * Brightest light a texel can store. Light is divided by this to fit in 8 bits, so surfaces can still be lit above full brightness.
+     */
+    constexpr static float RANGE = 2.0f;
+
+    uint64_t mesh_hash = 0; //Geometry hash of the mesh it was baked for, see Mesh::getGeometryHash()
+    int width = 0, height = 0; //Power of two dimensions
+    std::vector<glm::vec2> corner_uvs; //Lightmap uv of each triangle corner, in the same order as the mesh indices
+    std::vector<uint32_t> texels; //Packed rgba, row major
+
+    /**
+     * Pack light into a texel
+     * @param light Light of each channel. Clamped to RANGE.
+     * @return Packed rgba texel with full alpha
+     */
+    static uint32_t pack(const glm::vec3& light) {
+        glm::vec3 scaled = glm::clamp(light / RANGE, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return (uint32_t)scaled.x | ((uint32_t)scaled.y << 8) | ((uint32_t)scaled.z << 16) | (0xFFu << 24);
+    }
+
+    /**
+     * Unpack the light of a texel
+     * @param texel Packed rgba texel
+     * @return Light of each channel
+     */
+    static glm::vec3 unpack(uint32_t texel) {
+        const float scale = RANGE / 255.0f;
+        return {(float)(texel & 0xFF) * scale, (float)((texel >> 8) & 0xFF) * scale, (float)((texel >> 16) & 0xFF) * scale};
+    }
+};
@@ -5,11 +5,89 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
+#include <cstring>
 #include "Triangle.hpp"
 
 /**
- * A geometric construct consisting of triangles
+ * A single mesh vertex
+ */
+struct Vertex {
+    glm::vec3 pos; //Position. W is implicitly 1.
+    glm::vec3 norm; //Normal
+    glm::vec2 tex; //UV Coords
+    glm::vec2 lightmap_tex; //Second UV set for baked lighting. Zero if the mesh has no lightmap.
+};
+
+/**
+ * A small spatially coherent cluster of triangles in a mesh
+ * @details Used to cull whole groups of triangles before any per triangle work.
+ */
+struct Meshlet {
+    size_t start; //Start triangle in mesh
+    size_t end; //End triangle(not inclusive)
+    glm::vec3 center; //Model space bounding sphere
+    float radius;
+    glm::vec3 cone_axis; //Average geometric normal
+    float cone_sin, cone_cos; //Spread of geometric normals around the axis. Sin is above 1 if the cone can not be used.
+};
+
+/**
+ * A geometric construct consisting of indexed triangles
+ * @details Vertices shared between triangles are only stored, and transformed, once.
  */
 struct Mesh {
-    std::vector<Triangle> tris;
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices; //Three per triangle, in winding order
+    std::vector<Meshlet> meshlets; //Covers every triangle in order. Optional.
+    std::vector<Mesh> lods; //Simplified versions, each coarser than the last. Optional.
+    float lod_error = 0; //Largest distance from the original surface in model units. Zero for the full mesh.
+    glm::vec3 bounds_center{}; //Model space bounding sphere, see buildBounds(). Zero radius if not set.
+    float bounds_radius = 0;
+
+    /**
+     * Get the number of triangles in the mesh
+     */
+    [[nodiscard]] size_t getTriangleCount() const {
+        return indices.size() / 3;
+    }
+
+    /**
+     * Assemble a standalone triangle
+     * @param triangle Triangle index. Must be in bounds.
+     * @return Triangle with its index set
+     */
+    [[nodiscard]] Triangle getTriangle(size_t triangle) const {
+        Triangle output{};
+        for (int i = 0; i < 3; ++i) {
+            const Vertex& vertex = vertices[indices[triangle*3+i]];
+            output.pos[i] = glm::vec4(vertex.pos,1.0f);
+            output.norm[i] = vertex.norm;
+            output.tex[i] = vertex.tex;
+        }
+        output.index = (int)triangle;
+        return output;
+    }
+
+    /**
+     * Hash the corner positions of every triangle in order, with FNV-1a
+     * @details Identifies the geometry that precomputed data, like visible sets and lightmaps, was built for.
+     * Only positions and triangle order count, so duplicating vertices to give them new attributes keeps the hash.
+     * Bytes are fed in little endian order, so files stay valid between machines.
+     * @see https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+     */
+    [[nodiscard]] uint64_t getGeometryHash() const {
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t index : indices) {
+            const glm::vec3& pos = vertices[index].pos;
+            for (int axis = 0; axis < 3; ++axis) {
+                uint32_t bits;
+                std::memcpy(&bits, &pos[axis], sizeof(bits));
+                for (int byte = 0; byte < 4; ++byte) {
+                    hash = (hash ^ ((bits >> (byte * 8)) & 0xFF)) * 1099511628211ull;
+                }
+            }
+        }
+        return hash;
+    }
 };
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Non owning view of a packed rgba image, like a locked window texture
+ * @details Same pixel layout as the frame buffer color plane. Rows may be padded.
+ */
+struct PixelSpan {
+    uint32_t* pixels = nullptr; //First pixel of the first row
+    int width = 0, height = 0; //In pixels
+    int pitch = 0; //Distance between rows in pixels, at least width
+
+    /**
+     * Get a row of pixels
+     * @param y Row. Must be in bounds.
+     */
+    [[nodiscard]] uint32_t* getRow(int y) const {
+        return pixels + (size_t)y * pitch;
+    }
+};
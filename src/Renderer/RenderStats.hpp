@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Counters and stage timings of a single rendered frame
+ */
+struct RenderStats {
+    /**
+     * Render threads that get their own busy time, same as Renderer::MAX_THREADS
+     */
+    static const int MAX_THREADS = 4;
+
+    double frame_ms = 0; //Wall time of the whole frame
+    //Stage times. Vertex, clip, raster, and sdf are summed over all render threads, so they can add up to more than the frame time.
+    //Vertex, clip, and raster are only measured if stage timing is enabled, since timing every triangle has a cost. The rest are timed once per frame or thread, so always.
+    double vertex_ms = 0; //Skinning and vertex transforms
+    double clip_ms = 0; //Cluster culling, clipping, and projection
+    double bin_ms = 0; //Splitting draw calls between threads
+    double raster_ms = 0; //Rasterization and shading
+    double merge_ms = 0; //Combining the thread frame buffers
+    double sdf_ms = 0; //Ray marching signed distance fields
+    double blend_ms = 0; //Drawing the blended draw calls over the combined frame buffer
+    std::array<double,MAX_THREADS> thread_ms{}; //Time each render thread spent working, including the blended pass. Time short of the frame time is spent waiting.
+    size_t draw_calls = 0; //Draw calls after batching instances of the same mesh and texture
+    size_t blended_draws = 0; //Blended draw calls, drawn back to front after the rest
+    size_t instances = 0; //Transforms drawn, one per queued object
+    size_t triangles = 0; //Triangles submitted, including blended ones
+    //Triangles skipped with their whole meshlet, counted by the first test that rejects it
+    size_t triangles_cluster_pvs_culled = 0; //Meshlet not in the visible set of the camera cell
+    size_t triangles_cluster_frustum_culled = 0; //Meshlet bounding sphere outside the view frustum
+    size_t triangles_cluster_cone_culled = 0; //Meshlet normal cone facing away from the camera
+    size_t triangles_near_clipped = 0; //Triangles entirely behind the near plane
+    size_t triangles_frustum_culled = 0; //Clipped triangles entirely outside a side plane
+    size_t triangles_rasterized = 0; //Triangles that passed cluster culling, clipping, and backface culling
+    size_t triangles_backface_culled = 0; //Clipped triangles facing away from the camera
+    size_t pixels_shaded = 0; //Pixels covered by rasterized triangles, including ones that lose the depth test
+    size_t pixels_written = 0; //Pixels that passed the depth and alpha tests and were written
+    size_t dirty_tiles = 0; //Tiles rendered when temporal reuse is on, the rest are copied from the last frame. Zero if the whole frame was reused.
+    size_t sdf_draws = 0; //Signed distance fields queued
+    size_t sdf_rays = 0; //Rays marched after the tile cones and bounding spheres, including rays that miss
+
+    /**
+     * Add the per thread counters and times of another frame
+     */
+    void addThread(const RenderStats& other){
+        vertex_ms += other.vertex_ms;
+        clip_ms += other.clip_ms;
+        raster_ms += other.raster_ms;
+        sdf_ms += other.sdf_ms;
+        triangles_cluster_pvs_culled += other.triangles_cluster_pvs_culled;
+        triangles_cluster_frustum_culled += other.triangles_cluster_frustum_culled;
+        triangles_cluster_cone_culled += other.triangles_cluster_cone_culled;
+        triangles_near_clipped += other.triangles_near_clipped;
+        triangles_frustum_culled += other.triangles_frustum_culled;
+        triangles_rasterized += other.triangles_rasterized;
+        triangles_backface_culled += other.triangles_backface_culled;
+        pixels_shaded += other.pixels_shaded;
+        pixels_written += other.pixels_written;
+        sdf_rays += other.sdf_rays;
+    }
+
+    /**
+     * Reset the per triangle counters, keeping the pixel counters and times
+     */
+    void clearTriangleCounters(){
+        triangles_cluster_pvs_culled = 0;
+        triangles_cluster_frustum_culled = 0;
+        triangles_cluster_cone_culled = 0;
+        triangles_near_clipped = 0;
+        triangles_frustum_culled = 0;
+        triangles_rasterized = 0;
+        triangles_backface_culled = 0;
+    }
+
+    /**
+     * Get the column names of toCSV()
+     */
+    static std::string getCSVHeader(){
+        std::string header = "frame_ms,vertex_ms,clip_ms,bin_ms,raster_ms,merge_ms,sdf_ms,blend_ms";
+        for (int i = 0; i < MAX_THREADS; ++i) {
+            header += ",thread_" + std::to_string(i) + "_ms";
+        }
+        return header + ",draw_calls,blended_draws,instances,triangles,triangles_cluster_pvs_culled,triangles_cluster_frustum_culled,triangles_cluster_cone_culled,"
+                        "triangles_near_clipped,triangles_frustum_culled,"
+                        "triangles_rasterized,triangles_backface_culled,pixels_shaded,pixels_written,dirty_tiles,sdf_draws,sdf_rays";
+    }
+
+    /**
+     * Get the stats as one comma separated line, without a line break
+     * @see getCSVHeader()
+     */
+    [[nodiscard]] std::string toCSV() const {
+        std::string line;
+        for (double time : {frame_ms, vertex_ms, clip_ms, bin_ms, raster_ms, merge_ms, sdf_ms, blend_ms}) {
+            line += formatLine("%.3f,", time);
+        }
+        for (double time : thread_ms) {
+            line += formatLine("%.3f,", time);
+        }
+        for (size_t count : {draw_calls, blended_draws, instances, triangles, triangles_cluster_pvs_culled, triangles_cluster_frustum_culled, triangles_cluster_cone_culled,
+                             triangles_near_clipped, triangles_frustum_culled,
+                             triangles_rasterized, triangles_backface_culled, pixels_shaded, pixels_written, dirty_tiles, sdf_draws}) {
+            line += std::to_string(count) + ",";
+        }
+        return line + std::to_string(sdf_rays);
+    }
+
+    /**
+     * Get a short summary for an on screen overlay
+     * @return Lines of upper case text, see drawText()
+     */
+    [[nodiscard]] std::vector<std::string> getOverlayLines() const {
+        std::vector<std::string> lines;
+        lines.push_back(formatLine("FRAME %.2f MS  DRAWS %zu+%zu  INSTANCES %zu", frame_ms, draw_calls, blended_draws, instances));
+        lines.push_back(formatLine("TRIS %zu  CLUSTER CULLED PVS %zu FRUSTUM %zu CONE %zu", triangles, triangles_cluster_pvs_culled, triangles_cluster_frustum_culled, triangles_cluster_cone_culled));
+        lines.push_back(formatLine("CULLED NEAR %zu SIDE %zu BACK %zu", triangles_near_clipped, triangles_frustum_culled, triangles_backface_culled));
+        lines.push_back(formatLine("RASTER %zu  PIXELS TESTED %zu WRITTEN %zu", triangles_rasterized, pixels_shaded, pixels_written));
+        std::string threads = "THREADS";
+        for (double time : thread_ms) {
+            threads += formatLine(" %.2f", time);
+        }
+        lines.push_back(threads + formatLine(" MS  MERGE %.2f  BLEND %.2f MS", merge_ms, blend_ms));
+        if(vertex_ms + clip_ms + raster_ms > 0){ //Stage timing is on
+            lines.push_back(formatLine("VERTEX %.2f  CLIP %.2f  RASTER %.2f  BIN %.2f MS", vertex_ms, clip_ms, raster_ms, bin_ms));
+        }
+        lines.push_back(formatLine("DIRTY TILES %zu  SDF %zu RAYS %zu", dirty_tiles, sdf_draws, sdf_rays));
+        return lines;
+    }
+
+private:
+    /**
+     * Format values into a short line of text
+     * @param format Printf format. Output is cut off at 127 characters.
+     */
+    template<typename... Args> static std::string formatLine(const char* format, Args... args){
+        char buffer[128];
+        std::snprintf(buffer, sizeof(buffer), format, args...);
+        return buffer;
+    }
+};
+
+/**
+ * Adds the time until it goes out of scope to a stage time
+ */
+class StageTimer {
+private:
+    double* total;
+    std::chrono::steady_clock::time_point start;
+public:
+    /**
+     * Start timing
+     * @param total Stage time to add to in milliseconds, or nullptr to not time anything.
+     */
+    explicit StageTimer(double* total) : total(total) {
+        if(total != nullptr) start = std::chrono::steady_clock::now();
+    }
+
+    ~StageTimer(){
+        if(total != nullptr) *total += std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
@@ -5,12 +5,19 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
+#include <tuple>
 #include "Texture.hpp"
 #include "Shaders/FragmentShader.hpp"
 #include "Shaders/VertexShader.hpp"
 #include "FrameBuffer.hpp"
 #include "Mesh.hpp"
 #include "SkinnedMesh.hpp"
+#include "RenderStats.hpp"
+#include "DebugText.hpp"
+#include "Lightmap.hpp"
+#include "../Physics/PotentiallyVisibleSet.hpp"
+#include "../Physics/SDFCollision.hpp"
 
 /**
  * Enable backface culling. Beware of winding order.
@@ -26,20 +33,102 @@ public:
      * Max threads for rendering
      */
     const static int MAX_THREADS = 4;
+    static_assert(MAX_THREADS == RenderStats::MAX_THREADS, "Every render thread needs a busy time");
+    /**
+     * Largest on screen error in pixels allowed when picking a mesh level of detail
+     */
+    constexpr static float LOD_PIXEL_ERROR = 1.0f;
+    /**
+     * Width and height in pixels of the screen tiles signed distance fields are marched in
+     */
+    const static int SDF_TILE_SIZE = 8;
+    /**
+     * Max steps of a single ray when marching a signed distance field
+     */
+    const static int SDF_MAX_STEPS = 64;
+    /**
+     * Width and height in pixels of the screen tiles tracked by temporal reuse
+     */
+    const static int REUSE_TILE_SIZE = 32;
 private:
-    Camera camera; //Camera used for rendering
+    Camera camera; //Camera of the frame being rendered
+    Camera queued_camera; //Camera of the frame being queued
+
+    /**
+     * Transform of one instance of a draw call
+     */
+    struct Instance{
+        glm::mat4 model_transform{1.0f};
+        //Cached once per frame when draw calls are batched, so split draw calls do not redo them
+        glm::mat4 inverse_transform{1.0f}; //Gives the camera position in model space and the normal matrix
+        float max_scale = 1.0f; //Largest axis scale
+        bool mirrored = false; //If the transform flips the winding
+        bool cone_culling = false; //If meshlet normal cones can be tested, see meshletFrontFacing()
+        uint32_t light_mask = 0; //Bit i is set if light i reaches the bounds of the mesh
+        glm::ivec2 screen_min{}, screen_max{}; //Inclusive pixel bounds of the mesh. Only set with temporal reuse.
+    };
+
+    /**
+     * A triangle on its way to the rasterizer, with the vertex attributes only the renderer uses
+     * @details Kept apart from Triangle, which physics shares.
+     */
+    struct ShadedTriangle{
+        Triangle triangle; //Positions, normals and uvs
+        glm::vec3 light[3]; //Vertex lighting. Only set if the frame is lit.
+        glm::vec2 lightmap_tex[3]; //Lightmap uv coords. Only set if the draw call has a lightmap.
+    };
+
+    /**
+     * How the texture alpha of a draw call is used
+     */
+    enum BlendMode {
+        OPAQUE, //Alpha is ignored
+        ALPHA_TESTED, //Texels below Texture::ALPHA_CUTOFF are discarded
+        BLENDED //Blended over what is behind by alpha, in a back to front pass after everything else
+    };
 
     /**
-     * A request to draw an object
+     * A request to draw one or more instances of an object
      */
     struct DrawCall{
         const Mesh* mesh;
         const SkinnedMesh* skinned_mesh;
-        const glm::mat4 model_transform;
         const Texture* texture;
-        size_t start; //Start triangle in mesh
+        const Texture* lightmap; //Baked lighting sampled with the lightmap uvs, or nullptr.
+        size_t start; //Start triangle, counting the triangles of each instance one after another
         size_t end; //End triangle(not inclusive)
-        std::vector<glm::mat4> bones{};
+        size_t instance_offset; //First instance in the instance arena
+        size_t instance_count; //Always 1 for skinned draw calls
+        size_t bone_offset; //Start of bone palette in the bone arena. Skinned only.
+        size_t skinned_vertex_offset; //Start of deformed vertices in the skinned vertex buffer. Skinned only.
+        const PotentiallyVisibleSet* visibility; //Precomputed meshlet visibility of mesh, or nullptr.
+        BlendMode blend_mode; //Picked from the texture when queued
+
+        /**
+         * Get the triangle count of a single instance
+         */
+        [[nodiscard]] size_t getInstanceTriangleCount() const {
+            return skinned_mesh == nullptr ? mesh->getTriangleCount() : skinned_mesh->getTriangleCount();
+        }
+    };
+
+    /**
+     * A request to ray march a signed distance field
+     */
+    struct SDFDrawCall{
+        SDFPacket sdf; //World space field
+        glm::vec3 center; //World space bounding sphere containing the whole surface
+        float radius;
+        glm::vec3 color; //0-1 per channel
+        glm::ivec2 screen_min, screen_max; //Inclusive pixel bounds of the bounding sphere, set when the frame starts
+    };
+
+    /**
+     * What a queued draw call looked like, to find what changed between frames
+     */
+    struct DrawSignature{
+        uint64_t hash; //Mesh, texture, transform, and pose
+        glm::ivec2 screen_min, screen_max; //Inclusive pixel bounds
     };
 
     /**
@@ -49,11 +138,59 @@ private:
         FrameBuffer frame_buffer{};
         std::vector<DrawCall> tasks{};
         VertexShader vertex_shader{};
+        std::vector<Vertex> vertex_cache{}; //View space vertices of the current draw call
+        std::vector<glm::vec3> light_cache{}; //Vertex lighting of the current draw call, if lighting is on
+        std::vector<uint32_t> vertex_cache_tags{}; //Which draw call each cached vertex was transformed for
+        uint32_t draw_tag = 0; //Current draw call. Invalidates the whole cache when incremented.
+        BlendMode blend_mode = OPAQUE; //Of the current draw call
+        FrameBuffer* target = nullptr; //Where triangles are rasterized. The thread's own frame buffer, except in the blended pass.
+        int scissor_min_y = 0, scissor_max_y = 0; //Inclusive rows of target the thread may write
+        RenderStats stats{}; //Counters of this thread for the current frame
+        double busy_ms = 0; //Time spent working on the current frame, over both passes
     };
 
-    std::vector<DrawCall> incoming_tasks{}; //Main task list
+    //Draw lists are double buffered, so the next frame can be queued while the last one is rendered
+    std::vector<DrawCall> incoming_tasks{}; //Draw calls of the frame being queued
+    std::vector<Instance> incoming_instances{}; //Instance transforms of the frame being queued
+    std::vector<glm::mat4> incoming_bones{}; //Bone palettes of the frame being queued
+    std::vector<DrawCall> render_tasks{}; //Batched draw calls of the frame being rendered
+    std::vector<Instance> instance_arena{}; //Instances of the batched draw calls, contiguous per draw call
+    std::vector<glm::mat4> bone_arena{}; //Bone palettes of the skinned draw calls being rendered
+    std::vector<Vertex> skinned_vertices{}; //Deformed vertices of the skinned draw calls being rendered
+    std::vector<DrawCall> blended_tasks{}; //Blended draw calls of the frame being rendered, back to front
+    std::vector<Instance> blended_instances{}; //Instances of the blended draw calls
+    std::vector<SDFDrawCall> incoming_sdfs{}; //Signed distance fields of the frame being queued
+    std::vector<SDFDrawCall> render_sdfs{}; //Signed distance fields of the frame being rendered
+    //Set up once per frame, so rays are not unprojected per pixel
+    glm::vec3 ray_corner{}; //World space direction of the ray through pixel 0,0. Not normalized.
+    glm::vec3 ray_dx{}, ray_dy{}; //Change in ray direction per pixel step in x and y
+    float pixel_slope = 0; //Approximate width of a pixel per unit of distance from the camera
+    glm::mat4 view_projection{}; //Gives the depth of ray hits and the screen bounds of objects
+    //Temporal reuse, tiles where nothing changed are copied from the last frame
+    bool temporal_reuse = false;
+    bool threads_started = false; //If the frame being rendered has any dirty tiles
+    bool partial_frame = false; //If only some tiles of the frame being rendered are dirty
+    bool history_valid = false; //If history holds the last frame
+    FrameBuffer history{}; //Last finished frame
+    uint64_t view_hash = 0; //Camera and lights of the last frame
+    uint64_t frame_number = 0; //Frames tracked so far
+    std::vector<DrawSignature> signatures{}; //Draw calls of the frame being rendered, sorted by hash
+    std::vector<DrawSignature> last_signatures{}; //Draw calls of the last frame, sorted by hash
+    std::vector<uint8_t> dirty_tiles{}; //1 if a tile has to be rendered, row major
+    bool rendering = false; //If a frame was started and not yet finished
+    std::chrono::steady_clock::time_point frame_start{}; //When the frame being rendered was started
     std::array<ThreadData,MAX_THREADS> thread_data{};
     std::array<std::thread,MAX_THREADS> thread_pool{};
+    std::vector<Light> queued_lights{}; //World space lights of the frame being queued
+    glm::vec3 queued_ambient{1,1,1};
+    std::vector<Light> lights{}; //World space lights of the frame being rendered
+    Light view_lights[Light::MAX_LIGHTS]{}; //Same lights in view space
+    glm::vec3 ambient{1,1,1};
+    bool lighting = false; //If the frame being rendered is lit at all
+    RenderStats stats{}; //Stats of the last frame
+    RenderStats rendered_stats{}; //Stats of the last frame that rendered anything, shown by the overlay while frames are fully reused
+    bool stage_timing = false; //If stage times should be measured
+    bool stats_overlay = false; //If the stats of the last frame are drawn over each finished frame
 
 
     /**
@@ -61,65 +198,38 @@ private:
      * @param id Thread location in pool
      */
     void renderThread(int id){
+        auto start = std::chrono::steady_clock::now();
         thread_data[id].vertex_shader.setCamera(camera);
-        clearFrame(thread_data[id].frame_buffer,{0,0,0});
-        for(const DrawCall& draw_call : thread_data[id].tasks){
-            if(draw_call.bones.empty()){
-                draw(thread_data[id].frame_buffer,draw_call.mesh,draw_call.model_transform,draw_call.texture,thread_data[id].vertex_shader, draw_call.start,draw_call.end);
-            }else{
-                drawSkinned(thread_data[id].frame_buffer,draw_call.skinned_mesh,draw_call.model_transform,draw_call.bones,draw_call.texture,thread_data[id].vertex_shader, draw_call.start,draw_call.end);
+        thread_data[id].stats = RenderStats{};
+        thread_data[id].target = &thread_data[id].frame_buffer;
+        thread_data[id].scissor_min_y = 0;
+        thread_data[id].scissor_max_y = getHeight() - 1;
+        if(partial_frame){ //Pixels outside the dirty tiles are not resolved, so they do not need clearing
+            clearDirtyTiles(thread_data[id].frame_buffer,{0,0,0});
+        }else{
+            clearFrame(thread_data[id].frame_buffer,{0,0,0});
+        }
+        for(const DrawCall& draw_call : thread_data[id].tasks){ //Opaque draw calls come first, so alpha tested ones can skip pixels this thread already hid
+            thread_data[id].blend_mode = draw_call.blend_mode;
+            //Split the triangle range back into instances
+            size_t triangle_count = draw_call.getInstanceTriangleCount();
+            for (size_t i = draw_call.start / triangle_count; i * triangle_count < draw_call.end; ++i) {
+                const Instance& instance = instance_arena[draw_call.instance_offset + i];
+                size_t offset = i * triangle_count;
+                size_t start = std::max(draw_call.start,offset) - offset, end = std::min(draw_call.end,offset + triangle_count) - offset;
+                if(draw_call.skinned_mesh == nullptr){
+                    draw(thread_data[id],draw_call.mesh->vertices.data(),draw_call.mesh->vertices.size(),draw_call.mesh->indices.data(),draw_call.mesh->meshlets.data(),draw_call.mesh->meshlets.size(),draw_call.visibility,instance,draw_call.texture,draw_call.lightmap, start,end);
+                }else{ //Already deformed by the skinning stage, so bounds of meshlets would not hold
+                    draw(thread_data[id],skinned_vertices.data() + draw_call.skinned_vertex_offset,draw_call.skinned_mesh->vertices.size(),draw_call.skinned_mesh->indices.data(),nullptr,0,nullptr,instance,draw_call.texture,nullptr, start,end);
+                }
             }
         }
         thread_data[id].tasks.clear();
-    }
-
-    /**
-       * Get interpolated value
-       * @param input Input values
-       * @param uvw Barycentric coordinates
-       * @return Interpolated value
-       */
-    template<int T> static glm::vec<T,float> applyBarycentric(const glm::vec<T,float> input[3],const glm::vec3& uvw){
-        return input[0] * uvw.x + input[1] * uvw.y  + input[2] * uvw.z;
-    }
-
-    /**
-     * Get interpolated value with perspective correction
-     * @param input Input values to interpolate
-     * @param uvw Barycentric Coordinates
-     * @param clip_space Clip spaces vertex positions(homogeneous coordinates)
-     * @return Interpolated value
-     * @see https://computergraphics.stackexchange.com/questions/4079/perspective-correct-texture-mapping
-     */
-    template<int T> static glm::vec<T,float> applyBarycentricPerspective(const glm::vec<T,float> input[3],const glm::vec3& uvw,const glm::vec4 clip_space[3]){
-        return ((input[0]/clip_space[0].w) * uvw.x + (input[1]/clip_space[1].w) * uvw.y  + (input[2]/clip_space[2].w) * uvw.z) / ((1.0f/clip_space[0].w) * uvw.x + (1.0f/clip_space[1].w) * uvw.y  + (1.0f/clip_space[2].w) * uvw.z);
-    }
-
-    /**
-     * Check if a pixel is in a triangle
-     * @param x,y Pixel coordinates
-     * @param positions Screen space positions
-     * @param depth Output pixel depth from triangle
-     * @param uv Output barycentric coordinates
-     * @return True if in triangle.
-     * @see https://codeplea.com/triangular-interpolation
-     * Adapted from my java version
-     */
-    static bool inTriangle(int x, int y, const glm::vec3 positions[3], float& depth, glm::vec3& uvw) {
-        //Get barycentric coords
-        float invDET = 1.0f/((positions[1].y-positions[2].y) * (positions[0].x-positions[2].x) +
-                             (positions[2].x-positions[1].x) * (positions[0].y-positions[2].y));
-        float w1 = ((positions[1].y-positions[2].y) * ((float)x-positions[2].x) + (positions[2].x-positions[1].x) * ((float)y-positions[2].y)) * invDET;
-        float w2 = ((positions[2].y-positions[0].y) * ((float)x-positions[2].x) + (positions[0].x-positions[2].x) * ((float)y-positions[2].y)) * invDET;
-        float w3 = 1.0f - w1 - w2;
-
-        if(w1 < 0 || w1 > 1 || w2 <0 || w2 > 1 || w1 + w2 > 1) return false;
-
-        depth = positions[0].z * w1 +  positions[1].z * w2 + positions[2].z * w3;
-        uvw = {w1,w2,w3};
-
-        return true;
-
+        if(!render_sdfs.empty()){
+            StageTimer timer(&thread_data[id].stats.sdf_ms);
+            marchSDFs(thread_data[id], id);
+        }
+        thread_data[id].busy_ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count();
     }
 
     /**
@@ -138,145 +248,282 @@ private:
 
 
     /**
-     * Convert a point on a triangle to barycentric coordinates
-     * @param point Point on triangle
-     * @param triangle Triangle
-     * @return UVW Barycentric coordinates
-     * @see https://gamedev.stackexchange.com/questions/23743/whats-the-most-efficient-way-to-find-barycentric-coordinates
+     * Get the screen space gradient of a value that is linear across a triangle
+     * @param screen_space Screen space positions of the triangle
+     * @param values Value at each vertex
+     * @param gradient_x,gradient_y Output change in value per pixel step in x and y
+     * @see https://fgiesen.wordpress.com/2013/02/06/the-barycentric-conspirac/
      */
-    template<int T> static glm::vec3 pointToBarycentric(glm::vec<T,float> point, const glm::vec<T,float> triangle[3])
-    {
-        //todo optimize
-        glm::vec3 v0 = triangle[1] - triangle[0] , v1 =  triangle[2] -  triangle[0], v2 = point -  triangle[0];
-        float d00 = glm::dot(v0, v0);
-        float d01 = glm::dot(v0, v1);
-        float d11 = glm::dot(v1, v1);
-        float d20 = glm::dot(v2, v0);
-        float d21 = glm::dot(v2, v1);
-        float denom = d00 * d11 - d01 * d01;
-        float v = (d11 * d20 - d01 * d21) / denom;
-        float w = (d00 * d21 - d01 * d20) / denom;
-        float u = 1.0f - v - w;
-        return {u,v,w};
+    template<int T> static void planeGradient(const glm::vec3 screen_space[3], const glm::vec<T,float> values[3], glm::vec<T,float>& gradient_x, glm::vec<T,float>& gradient_y){
+        float x1 = screen_space[1].x - screen_space[0].x, y1 = screen_space[1].y - screen_space[0].y;
+        float x2 = screen_space[2].x - screen_space[0].x, y2 = screen_space[2].y - screen_space[0].y;
+        float inverse_area = 1.0f / (x1 * y2 - x2 * y1);
+        glm::vec<T,float> delta_1 = values[1] - values[0], delta_2 = values[2] - values[0];
+        gradient_x = (delta_1 * y2 - delta_2 * y1) * inverse_area;
+        gradient_y = (delta_2 * x1 - delta_1 * x2) * inverse_area;
     }
 
+    /**
+     * A value that is linear in screen space across a triangle, stored as a plane equation
+     * @details Set up once per triangle. Evaluating it at a pixel is then two multiply adds, and stepping one pixel is one add.
+     * The plane is anchored at the first vertex rather than the screen origin, so large offsets do not eat the precision of depth.
+     */
+    template<int T> struct AttributePlane {
+        glm::vec<T,float> anchor_value; //Value at first vertex
+        glm::vec2 anchor; //Screen position of first vertex
+        glm::vec<T,float> dx, dy; //Change per pixel step in x and y
+
+        /**
+         * Create a plane that is zero everywhere, for a value the triangle does not use
+         */
+        AttributePlane() : anchor_value(0), anchor(0), dx(0), dy(0) {}
+
+        /**
+         * Set up the plane of a triangle
+         * @param screen_space Screen space positions of the triangle
+         * @param values Value at each vertex
+         */
+        AttributePlane(const glm::vec3 screen_space[3], const glm::vec<T,float> values[3]) : anchor_value(values[0]), anchor(screen_space[0]) {
+            planeGradient(screen_space, values, dx, dy);
+        }
+
+        /**
+         * Get the value at a pixel
+         */
+        [[nodiscard]] glm::vec<T,float> at(float x, float y) const {
+            return anchor_value + dx * (x - anchor.x) + dy * (y - anchor.y);
+        }
+    };
+
     /**
      * Rasterize a triangle to the frame buffer
-     * @param clip_tri Triangle after vertex shader and projection
+     * @tparam MODE How texture alpha is used. Opaque triangles skip all alpha work. Blended triangles are depth tested but do not write depth.
+     * @tparam LIT If the frame is lit. Unlit triangles skip the vertex lighting plane.
+     * @tparam LIGHTMAPPED If the draw call has a lightmap. Other triangles skip the lightmap uv plane and fetch.
+     * @param shaded_tri Triangle after vertex shader and projection
      * @param frame_buffer Frame buffer to write to
-     * @param texture Texture to use for colors
+     * @param texture Texture to use for colors. Multiplied by the interpolated vertex lighting if lit.
+     * @param lightmap Baked lighting added to the vertex lighting. Only used if LIGHTMAPPED.
+     * @param min_y,max_y Inclusive rows that may be written
+     * @param counters Stats to add the triangle, and the shaded and written pixels to
      */
-    void rasterize(const Triangle& clip_tri,FrameBuffer& frame_buffer, const Texture* texture) const {
+    template<BlendMode MODE, bool LIT, bool LIGHTMAPPED> void rasterize(const ShadedTriangle& shaded_tri,FrameBuffer& frame_buffer, const Texture* texture, const Texture* lightmap, int min_y, int max_y, RenderStats& counters) const {
+        const Triangle& clip_tri = shaded_tri.triangle;
         //Cull
-        if(cull(clip_tri)) return;
+        if(cull(clip_tri)){
+            counters.triangles_backface_culled++;
+            return;
+        }
+        counters.triangles_rasterized++;
         //Get screen space (x,y,depth)
         glm::vec3 screen_space[3];
         for (int i = 0; i < 3; ++i) {
             screen_space[i] = clip_tri.pos[i] / clip_tri.pos[i].w; //normalize with w
             screen_space[i] = {(screen_space[i].x + 1.0) * ((float)frame_buffer.getWidth()/2.0f),(screen_space[i].y + 1.0) * ((float)frame_buffer.getHeight()/2.0f), (screen_space[i].z+1.0f) * (camera.getFarPlaneDistance() - camera.getNearPlaneDistance())/2.0f + camera.getNearPlaneDistance()};
         }
-        //get bounding box(also clamp to screen bounds)
+        //get bounding box(also clamp to screen bounds, in float so vertices far outside the screen can not overflow)
         glm::int2 box_min = max(min(min(screen_space[0], screen_space[1]),screen_space[2]), {0,0,0});
         glm::int2 box_max = min(max(max(screen_space[0], screen_space[1]),screen_space[2]), {frame_buffer.getWidth()-1,frame_buffer.getHeight()-1, 0});
+        box_min.y = std::max(box_min.y, min_y);
+        box_max.y = std::min(box_max.y, max_y);
+        if(partial_frame && !touchesDirtyTile(box_min, box_max)) return; //Kept from the last frame
 
-        //Rasterize
-        for (int x = box_min.x; x <= box_max.x; x++) {
-            for (int y = box_min.y; y <= box_max.y; y++) {
-                glm::vec3 barycentric;
-                float depth;
-                if(inTriangle(x,y,screen_space,depth,barycentric)) {
-                    //todo add fragment shader class here
-                    glm::vec2 uv = applyBarycentricPerspective(clip_tri.tex, barycentric, clip_tri.pos);
-                    int uvx = std::abs((int)(uv.x * (float)(texture->getWidth()-1)) % (texture->getWidth()-1)); //Allow repeating textures
-                    int uvy = std::abs((int)(uv.y * (float)(texture->getHeight()-1)) % (texture->getHeight()-1));
-
-                    if( texture->isTransparent(uvx,uvy)){
-                        continue;
-                    }
-                    Texture::Color texture_color = texture->getPixel(uvx,uvy);
-                    glm::vec3 color = {(float)texture_color.r,(float)texture_color.g, (float)texture_color.b};
-                    frame_buffer.setPixelIfDepth(x,y,{color ,depth});
+        //Set up plane equations once per triangle, so the pixel loop only steps them.
+        //uv/w and 1/w are linear in screen space, so the derivative of uv follows from the quotient rule.
+        glm::vec2 coverage[3] = {{1,0},{0,1},{0,0}}; //First two barycentric coordinates
+        glm::vec4 attributes[3]; //u/w, v/w, 1/w, depth
+        for (int i = 0; i < 3; ++i) {
+            float inverse_w = 1.0f / clip_tri.pos[i].w;
+            attributes[i] = {clip_tri.tex[i] * inverse_w, inverse_w, screen_space[i].z};
+        }
+        AttributePlane<2> coverage_plane(screen_space, coverage);
+        AttributePlane<4> attribute_plane(screen_space, attributes);
+        AttributePlane<3> light_plane; //Gouraud shading
+        if constexpr (LIT){
+            glm::vec3 light_over_w[3];
+            for (int i = 0; i < 3; ++i) {
+                light_over_w[i] = shaded_tri.light[i] * attributes[i].z;
+            }
+            light_plane = AttributePlane<3>(screen_space, light_over_w);
+        }
+        AttributePlane<2> lightmap_plane; //In lightmap texels rather than uvs, so the fetch does not scale them
+        if constexpr (LIGHTMAPPED){
+            glm::vec2 lightmap_size(lightmap->getWidth(), lightmap->getHeight());
+            glm::vec2 lightmap_tex_over_w[3];
+            for (int i = 0; i < 3; ++i) {
+                lightmap_tex_over_w[i] = shaded_tri.lightmap_tex[i] * lightmap_size * attributes[i].z;
+            }
+            lightmap_plane = AttributePlane<2>(screen_space, lightmap_tex_over_w);
+        }
+        glm::vec2 tex_over_w_dx = attribute_plane.dx, tex_over_w_dy = attribute_plane.dy;
+        float inverse_w_dx = attribute_plane.dx.z, inverse_w_dy = attribute_plane.dy.z;
+
+        //Rasterize row by row, to match the frame buffer layout. The light and lightmap uvs are stepped unused if they are off, and optimized out.
+        size_t pixels_shaded = 0, pixels_written = 0;
+        for (int y = box_min.y; y <= box_max.y; y++) {
+            glm::vec4 attribute = attribute_plane.at((float)box_min.x, (float)y);
+            glm::vec3 light = light_plane.at((float)box_min.x, (float)y);
+            glm::vec2 lightmap_tex = lightmap_plane.at((float)box_min.x, (float)y);
+            for (int x = box_min.x; x <= box_max.x; x++, attribute += attribute_plane.dx, light += light_plane.dx, lightmap_tex += lightmap_plane.dx) {
+                glm::vec2 barycentric = coverage_plane.at((float)x, (float)y); //Not stepped, so rounding can not open cracks between triangles
+                if(barycentric.x < 0 || barycentric.y < 0 || barycentric.x + barycentric.y > 1) continue;
+                pixels_shaded++;
+                if(attribute.w >= frame_buffer.getDepth(x,y)) continue; //Hidden, skip the texture fetch
+                if(MODE == BLENDED && partial_frame && !touchesDirtyTile({x,y},{x,y})) continue; //Would blend over itself in the kept pixels
+                float pixel_w = 1.0f / attribute.z;
+                glm::vec2 uv = glm::vec2(attribute) * pixel_w;
+                glm::vec2 uv_dx = (tex_over_w_dx - uv * inverse_w_dx) * pixel_w;
+                glm::vec2 uv_dy = (tex_over_w_dy - uv * inverse_w_dy) * pixel_w;
+
+                uint32_t texel = texture->sample(uv.x, uv.y, texture->selectLevel(uv_dx.x, uv_dx.y, uv_dy.x, uv_dy.y)); //Repeats
+                if(MODE == ALPHA_TESTED && Texture::getAlpha(texel) < Texture::ALPHA_CUTOFF) continue;
+                if(MODE == BLENDED && Texture::getAlpha(texel) == 0) continue;
+                uint32_t color = texel | 0xFF000000;
+                if(LIGHTMAPPED){ //Single fetch of the full resolution level, the baked light is already smooth
+                    glm::vec2 lightmap_texel = lightmap_tex * pixel_w;
+                    uint32_t baked = lightmap->fetchClamped(lightmap_texel.x, lightmap_texel.y);
+                    color = LIT ? FragmentShader::light(texel, light * pixel_w + Lightmap::unpack(baked)) : FragmentShader::lightBaked(texel, baked);
+                }else if(LIT){
+                    color = FragmentShader::light(texel, light * pixel_w);
+                }
+                if(MODE == BLENDED){ //Depth is not written, so blended surfaces behind it still show through
+                    frame_buffer.setColor(x,y,FragmentShader::blend(color, Texture::getAlpha(texel), frame_buffer.getColor(x,y)));
+                }else{
+                    frame_buffer.setPixel(x,y,color,attribute.w);
                 }
+                pixels_written++;
             }
         }
+        counters.pixels_shaded += pixels_shaded;
+        counters.pixels_written += pixels_written;
+    }
+
+    /**
+     * Rasterize a triangle with the lighting of the frame and current draw call
+     * @tparam MODE Blend mode of the current draw call
+     * @param data Thread to draw with. Writes to its target, within its scissor rows.
+     * @param clip_tri Triangle after vertex shader and projection
+     * @param texture Texture to use for colors
+     * @param lightmap Baked lighting, or nullptr.
+     */
+    template<BlendMode MODE> void rasterizeLit(ThreadData& data, const ShadedTriangle& clip_tri, const Texture* texture, const Texture* lightmap) const {
+        if(lighting){
+            if(lightmap != nullptr) rasterize<MODE,true,true>(clip_tri,*data.target,texture,lightmap,data.scissor_min_y,data.scissor_max_y,data.stats);
+            else rasterize<MODE,true,false>(clip_tri,*data.target,texture,lightmap,data.scissor_min_y,data.scissor_max_y,data.stats);
+        }else{
+            if(lightmap != nullptr) rasterize<MODE,false,true>(clip_tri,*data.target,texture,lightmap,data.scissor_min_y,data.scissor_max_y,data.stats);
+            else rasterize<MODE,false,false>(clip_tri,*data.target,texture,lightmap,data.scissor_min_y,data.scissor_max_y,data.stats);
+        }
     }
 
     /**
-     * Move a vertex of a triangle and update(interpolate the attributes accordingly
-     * @param triangle Triangle to edit.
-     * @param vertex Vertex index. 0,1,2.
-     * @param new_position New position of vertex. Must still lie on the triangle.
+     * Rasterize a triangle with the blend mode of the current draw call
+     * @param data Thread to draw with. Writes to its target, within its scissor rows.
+     * @param clip_tri Triangle after vertex shader and projection
+     * @param texture Texture to use for colors
+     * @param lightmap Baked lighting, or nullptr.
+     * @details Adds to the counters of the thread.
      */
-    static void moveVertex(Triangle& triangle, int vertex, const glm::vec4& new_position){
-        glm::vec3 uvw = pointToBarycentric(new_position,triangle.pos);
-        triangle.tex[vertex] = applyBarycentric(triangle.tex,uvw);
-        //todo normals
-        triangle.pos[vertex] = new_position;
+    void rasterizeTriangle(ThreadData& data, const ShadedTriangle& clip_tri, const Texture* texture, const Texture* lightmap) const {
+        switch (data.blend_mode) {
+            case OPAQUE: rasterizeLit<OPAQUE>(data,clip_tri,texture,lightmap); break;
+            case ALPHA_TESTED: rasterizeLit<ALPHA_TESTED>(data,clip_tri,texture,lightmap); break;
+            default: rasterizeLit<BLENDED>(data,clip_tri,texture,lightmap); break;
+        }
     }
 
     /**
-     * Take a line and intersect it with the near clipping plane(0)
-     * @param a Start of line
-     * @param b End of line
-     * At least one part of the line must be one opposite side of the plane
-     * @return Intersection point
+     * Max triangles the near plane clipper can output
+     */
+    static const int MAX_CLIPPED_TRIANGLES = 2;
+
+    /**
+     * Interpolate all vertex attributes along a triangle edge
+     * @param triangle Triangle to read from
+     * @param a,b Vertex indices of the edge
+     * @param t Plane parameter. 0 is a, 1 is b.
+     * @param output Triangle to write to
+     * @param vertex Vertex of output to write
      */
-    [[nodiscard]] glm::vec4 intersectNearPlane(const glm::vec4& a,const glm::vec4& b) const{
-        //Get intersection with line xz
-        float slope_1 = (a.z-b.z)/(a.x-b.x);
-        // z = m(x-x1)+z1, near = m(x-x1)+z1, (near-z1)/m+x1  = x
-        float x = (-camera.getNearPlaneDistance()-a.z)/slope_1 + a.x;
-        //Get intersection with line yz
-        float slope_2 = (a.z-b.z)/(a.y-b.y);
-        float y = (-camera.getNearPlaneDistance()-a.z)/slope_2 + a.y;
-        return {x,y,-camera.getNearPlaneDistance(),1}; //W is always 1 in view space. Z must be on the plane.
+    static void interpolateEdge(const ShadedTriangle& triangle, int a, int b, float t, ShadedTriangle& output, int vertex){
+        output.triangle.pos[vertex] = triangle.triangle.pos[a] + (triangle.triangle.pos[b] - triangle.triangle.pos[a]) * t;
+        output.triangle.norm[vertex] = triangle.triangle.norm[a] + (triangle.triangle.norm[b] - triangle.triangle.norm[a]) * t;
+        output.triangle.tex[vertex] = triangle.triangle.tex[a] + (triangle.triangle.tex[b] - triangle.triangle.tex[a]) * t;
+        output.light[vertex] = triangle.light[a] + (triangle.light[b] - triangle.light[a]) * t;
+        output.lightmap_tex[vertex] = triangle.lightmap_tex[a] + (triangle.lightmap_tex[b] - triangle.lightmap_tex[a]) * t;
     }
 
+    /**
+     * Get where an edge crosses the near clipping plane
+     * @param a,b View space edge end points. Must be on opposite sides of the plane.
+     * @return Plane parameter t. 0 is a, 1 is b.
+     */
+    [[nodiscard]] float nearPlaneParameter(const glm::vec4& a, const glm::vec4& b) const {
+        return (-camera.getNearPlaneDistance() - a.z) / (b.z - a.z);
+    }
 
     /**
      * Clip a triangle against the near viewing plane if needed
      * @param view_tri View space triangle
-     * @return Resulting clipped triangles
+     * @param output Resulting clipped triangles. Winding order is preserved.
+     * @return Number of triangles written to output. 0 to MAX_CLIPPED_TRIANGLES.
+     * @details The side planes are not clipped against. The rasterizer only walks the on-screen part of each triangle,
+     * so the whole screen space acts as a guard band, and only triangles crossing the near plane take this slow path.
      */
-     [[nodiscard]] std::vector<Triangle> clip(const Triangle& view_tri) const {
-        //todo optimize and reserve
-        std::vector<int> inside;
-        std::vector<int> outside;
+    int clip(const ShadedTriangle& view_tri, ShadedTriangle output[MAX_CLIPPED_TRIANGLES]) const {
+        const glm::vec4* pos = view_tri.triangle.pos;
+        int inside[3], outside[3];
+        int inside_count = 0, outside_count = 0;
         for (int i = 0; i < 3; ++i) {
-            if(view_tri.pos[i].z < -camera.getNearPlaneDistance()){
-                inside.push_back(i);
+            if(pos[i].z < -camera.getNearPlaneDistance()){
+                inside[inside_count++] = i;
             }else{
-                outside.push_back(i);
+                outside[outside_count++] = i;
             }
         }
-        if(outside.empty()) return {view_tri}; //All in
-        if(inside.size() == 1){ //Move triangle
-            Triangle moved_triangle = view_tri;
+        if(outside_count == 0){ //All in
+            output[0] = view_tri;
+            return 1;
+        }
+        if(inside_count == 1){ //Move the two outside vertices onto the plane
             int a = inside[0];
             int b = outside[0];
             int c = outside[1];
-            moveVertex(moved_triangle,b,intersectNearPlane(view_tri.pos[a],view_tri.pos[b]));
-            moveVertex(moved_triangle,c,intersectNearPlane(view_tri.pos[a],view_tri.pos[c]));
-            return {moved_triangle};
+            output[0] = view_tri;
+            interpolateEdge(view_tri,a,b,nearPlaneParameter(pos[a],pos[b]),output[0],b);
+            interpolateEdge(view_tri,a,c,nearPlaneParameter(pos[a],pos[c]),output[0],c);
+            return 1;
         }
-        if(inside.size() == 2){ //Generate one additional triangle
+        if(inside_count == 2){ //Generate one additional triangle
             int a = inside[0];
             int b = inside[1];
             int c = outside[0];
-            glm::vec4 a_intersect = intersectNearPlane(view_tri.pos[a],view_tri.pos[c]);
-            glm::vec4 b_intersect = intersectNearPlane(view_tri.pos[b],view_tri.pos[c]);
-            Triangle triangle_1 = view_tri;
-            Triangle triangle_2 = view_tri;
-
-            moveVertex(triangle_1,c,a_intersect);
+            float a_t = nearPlaneParameter(pos[a],pos[c]);
+            float b_t = nearPlaneParameter(pos[b],pos[c]);
+            output[0] = view_tri;
+            output[1] = view_tri;
 
-            moveVertex(triangle_2,a,a_intersect);
-            moveVertex(triangle_2,c,b_intersect);
+            interpolateEdge(view_tri,a,c,a_t,output[0],c);
 
-            return {triangle_1,triangle_2};
+            interpolateEdge(view_tri,a,c,a_t,output[1],a);
+            interpolateEdge(view_tri,b,c,b_t,output[1],c);
+            return 2;
         }
         //none visible
-        return {};
+        return 0;
+    }
+
+    /**
+     * Check if a clip space triangle is entirely outside one of the side planes
+     * @param clip_tri Clip space triangle in front of the near plane
+     * @return True if it can not be visible
+     */
+    static bool outsideSidePlanes(const Triangle& clip_tri){
+        for (int axis = 0; axis < 2; ++axis) {
+            if(clip_tri.pos[0][axis] > clip_tri.pos[0].w && clip_tri.pos[1][axis] > clip_tri.pos[1].w && clip_tri.pos[2][axis] > clip_tri.pos[2].w) return true;
+            if(clip_tri.pos[0][axis] < -clip_tri.pos[0].w && clip_tri.pos[1][axis] < -clip_tri.pos[1].w && clip_tri.pos[2][axis] < -clip_tri.pos[2].w) return true;
+        }
+        return false;
     }
 
     /**
@@ -284,68 +531,710 @@ private:
     * @param frame_buffer Frame buffer to render to
     */
     void clearFrame(FrameBuffer& frame_buffer,const glm::vec3& background_color) const {
-        for (int x = 0; x < frame_buffer.getWidth(); ++x) {
-            for (int y = 0; y < frame_buffer.getHeight(); ++y) {
-                frame_buffer.setPixel(x,y,{background_color,camera.getFarPlaneDistance()});
+        frame_buffer.clear(FrameBuffer::packColor(background_color),camera.getFarPlaneDistance());
+    }
+
+    /**
+     * Prepare only the dirty tiles of a frame for rendering
+     * @param frame_buffer Frame buffer to render to
+     */
+    void clearDirtyTiles(FrameBuffer& frame_buffer,const glm::vec3& background_color) const {
+        int tiles_x = getTilesX();
+        for (size_t tile = 0; tile < dirty_tiles.size(); ++tile) {
+            if(!dirty_tiles[tile]) continue;
+            glm::ivec2 tile_min = glm::ivec2((int)tile % tiles_x, (int)tile / tiles_x) * REUSE_TILE_SIZE;
+            frame_buffer.clear(FrameBuffer::packColor(background_color),camera.getFarPlaneDistance(), tile_min, tile_min + REUSE_TILE_SIZE - 1);
+        }
+    }
+
+    /**
+     * Get the number of reuse tile columns
+     */
+    [[nodiscard]] int getTilesX() const {
+        return (getWidth() + REUSE_TILE_SIZE - 1) / REUSE_TILE_SIZE;
+    }
+
+    /**
+     * Get the number of reuse tile rows
+     */
+    [[nodiscard]] int getTilesY() const {
+        return (getHeight() + REUSE_TILE_SIZE - 1) / REUSE_TILE_SIZE;
+    }
+
+    /**
+     * Check if a pixel rectangle overlaps a dirty tile
+     * @param screen_min,screen_max Inclusive pixel bounds, clamped to the screen
+     */
+    [[nodiscard]] bool touchesDirtyTile(const glm::ivec2& screen_min, const glm::ivec2& screen_max) const {
+        int tiles_x = getTilesX();
+        for (int y = screen_min.y / REUSE_TILE_SIZE; y <= screen_max.y / REUSE_TILE_SIZE; ++y) {
+            for (int x = screen_min.x / REUSE_TILE_SIZE; x <= screen_max.x / REUSE_TILE_SIZE; ++x) {
+                if(dirty_tiles[y * tiles_x + x]) return true;
             }
         }
+        return false;
     }
 
     /**
-     * Draw a skinned mesh.
-     * @param frame_buffer Frame buffer to draw to.
-     * @param mesh Skinned Mesh to draw. Make sure texture ids match the renderer texture buffer.
-     * @param model_transform Transform of mesh.
-     * @param bones Bones to pose skinned mesh with their final transforms. Must be meant for the mesh.
-     * @param texture Texture to use for rendering
-     * @param shader Vertex shader with the camera set. This method will set the model transform.
-     * @param start, end Range of triangles to draw.
-    */
-    void drawSkinned(FrameBuffer& frame_buffer, const SkinnedMesh* mesh, const glm::mat4& model_transform, const std::vector<glm::mat4>& bones, const Texture* texture, VertexShader& vertex_shader, size_t start, size_t end) const{
-        assert(mesh->num_bones == (int)bones.size());
-        vertex_shader.setModelTransform(model_transform);
-        for (size_t i = start; i < end; ++i) {
-            const SkinnedTriangle& triangle = mesh->tris[i];
-            Triangle view_tri = vertex_shader.toViewSpaceSkinned(triangle, bones); //Geometry shader
-            std::vector<Triangle> clipped_view_tris = clip(view_tri);
-            for (const Triangle& clipped_view_tri : clipped_view_tris) {
-                Triangle clip_tri = vertex_shader.toClipSpace(clipped_view_tri); //Project
-                rasterize(clip_tri,frame_buffer,texture);
+     * Mark the tiles a pixel rectangle overlaps as dirty
+     * @param screen_min,screen_max Inclusive pixel bounds, clamped to the screen
+     */
+    void markDirty(const glm::ivec2& screen_min, const glm::ivec2& screen_max) {
+        int tiles_x = getTilesX();
+        for (int y = screen_min.y / REUSE_TILE_SIZE; y <= screen_max.y / REUSE_TILE_SIZE; ++y) {
+            for (int x = screen_min.x / REUSE_TILE_SIZE; x <= screen_max.x / REUSE_TILE_SIZE; ++x) {
+                dirty_tiles[y * tiles_x + x] = 1;
+            }
+        }
+    }
+
+    /**
+     * Hash bytes with FNV-1a
+     * @param data,size Bytes to hash
+     * @param hash Hash to continue from
+     * @see https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+     */
+    static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull){
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    /**
+     * Get the largest axis scale of a transform
+     */
+    static float getMaxScale(const glm::mat4& transform){
+        glm::mat3 linear = glm::mat3(transform);
+        return sqrtf(std::max({glm::dot(linear[0],linear[0]),glm::dot(linear[1],linear[1]),glm::dot(linear[2],linear[2])}));
+    }
+
+    /**
+     * Check if a transform scales every axis by the same amount
+     * @details Allows for float error in transforms built from rotations.
+     */
+    static bool isUniformScale(const glm::mat4& transform){
+        const float TOLERANCE = 1e-3f;
+        glm::mat3 linear = glm::mat3(transform);
+        float x = glm::dot(linear[0],linear[0]), y = glm::dot(linear[1],linear[1]), z = glm::dot(linear[2],linear[2]);
+        return std::max({x,y,z}) - std::min({x,y,z}) <= TOLERANCE * std::max({x,y,z});
+    }
+
+    /**
+     * Compare the queued frame to the last one, to find the tiles that have to be rendered again
+     * @details Each queued draw call is hashed with its transform and pose. Draw calls whose hash is only in one of the two frames
+     * moved, appeared, or disappeared, so the screen bounds they had in that frame are dirty.
+     * A different camera or lights make every tile dirty. Signed distance fields can not be hashed, so their bounds are always dirty, in the frame after too.
+     * Also sets the screen bounds of the queued instances.
+     */
+    void findDirtyTiles() {
+        uint64_t new_view_hash = hashBytes(&camera.getTransform(), sizeof(glm::mat4));
+        new_view_hash = hashBytes(&camera.getProjection(), sizeof(glm::mat4), new_view_hash);
+        new_view_hash = hashBytes(lights.data(), lights.size() * sizeof(Light), new_view_hash);
+        new_view_hash = hashBytes(&ambient, sizeof(glm::vec3), new_view_hash);
+        bool full_frame = !history_valid || new_view_hash != view_hash;
+        view_hash = new_view_hash;
+        dirty_tiles.assign((size_t)getTilesX() * getTilesY(), full_frame ? 1 : 0);
+
+        signatures.clear();
+        for (const DrawCall& draw_call : incoming_tasks) {
+            for (size_t i = 0; i < draw_call.instance_count; ++i) {
+                Instance& instance = incoming_instances[draw_call.instance_offset + i];
+                const void* state[] = {draw_call.mesh, draw_call.skinned_mesh, draw_call.texture, draw_call.lightmap, draw_call.visibility};
+                uint64_t hash = hashBytes(state, sizeof(state));
+                hash = hashBytes(&draw_call.blend_mode, sizeof(BlendMode), hash);
+                hash = hashBytes(&instance.model_transform, sizeof(glm::mat4), hash);
+                if(draw_call.skinned_mesh != nullptr){
+                    hash = hashBytes(incoming_bones.data() + draw_call.bone_offset, draw_call.skinned_mesh->num_bones * sizeof(glm::mat4), hash);
+                }
+                //Deformed skinned meshes have no bounds, so they cover the whole screen
+                instance.screen_min = {0,0};
+                instance.screen_max = {getWidth()-1, getHeight()-1};
+                if(draw_call.mesh != nullptr && draw_call.mesh->bounds_radius > 0){
+                    glm::vec3 center = instance.model_transform * glm::vec4(draw_call.mesh->bounds_center,1.0f);
+                    getScreenBounds(center, draw_call.mesh->bounds_radius * getMaxScale(instance.model_transform), instance.screen_min, instance.screen_max);
+                }
+                signatures.push_back(DrawSignature{hash, instance.screen_min, instance.screen_max});
             }
         }
+        //Fields get a hash no other frame has, so their bounds in this and the next frame are dirty
+        for (const SDFDrawCall& sdf : incoming_sdfs) {
+            uint64_t unique[] = {frame_number, signatures.size()};
+            DrawSignature signature{hashBytes(unique, sizeof(unique)), {}, {}};
+            getScreenBounds(sdf.center, sdf.radius, signature.screen_min, signature.screen_max);
+            if(signature.screen_min.x <= signature.screen_max.x && signature.screen_min.y <= signature.screen_max.y) signatures.push_back(signature);
+        }
+        frame_number++;
+        std::sort(signatures.begin(), signatures.end(), [](const DrawSignature& a, const DrawSignature& b){ return a.hash < b.hash; });
+        if(!full_frame){
+            //Walk both sorted lists, draw calls in both are unchanged
+            size_t current = 0, last = 0;
+            while(current < signatures.size() || last < last_signatures.size()){
+                if(last == last_signatures.size() || (current < signatures.size() && signatures[current].hash < last_signatures[last].hash)){
+                    markDirty(signatures[current].screen_min, signatures[current].screen_max);
+                    current++;
+                }else if(current == signatures.size() || last_signatures[last].hash < signatures[current].hash){
+                    markDirty(last_signatures[last].screen_min, last_signatures[last].screen_max);
+                    last++;
+                }else{
+                    current++;
+                    last++;
+                }
+            }
+        }
+        std::swap(signatures, last_signatures);
+        stats.dirty_tiles = std::count(dirty_tiles.begin(), dirty_tiles.end(), 1);
+        partial_frame = stats.dirty_tiles < dirty_tiles.size();
+    }
+
+    /**
+     * Find the lights of the frame that reach a mesh instance
+     * @param mesh Mesh to use the bounds of. Nullptr or no bounds counts as reached by every light.
+     * @param instance Transform of the mesh, with max scale set
+     * @return Bit i is set if light i reaches the instance
+     */
+    [[nodiscard]] uint32_t getLightMask(const Mesh* mesh, const Instance& instance) const {
+        uint32_t mask = 0;
+        bool bounded = mesh != nullptr && mesh->bounds_radius > 0;
+        glm::vec3 center = bounded ? glm::vec3(instance.model_transform * glm::vec4(mesh->bounds_center,1.0f)) : glm::vec3(0);
+        float radius = bounded ? mesh->bounds_radius * instance.max_scale : 0;
+        for (size_t i = 0; i < lights.size(); ++i) {
+            if(!bounded || lights[i].reaches(center, radius)) mask |= 1u << i;
+        }
+        return mask;
+    }
+
+    /**
+     * Pick the blend mode of a texture that is not blended
+     * @param texture Texture of the draw call
+     * @return Alpha tested if any texel is transparent, else opaque so the alpha test is skipped
+     */
+    static BlendMode getBlendMode(const Texture* texture) {
+        return texture->hasTransparency() ? ALPHA_TESTED : OPAQUE;
+    }
+
+    /**
+     * Move the queued blended draw calls into their own list, sorted back to front
+     * @details They are drawn after the thread frame buffers are resolved, so the sort is per object rather than per pixel.
+     */
+    void sortBlendedDrawCalls() {
+        blended_tasks.clear();
+        blended_instances.clear();
+        std::vector<float> view_depths;
+        for (const DrawCall& draw_call : incoming_tasks) {
+            if(draw_call.blend_mode != BLENDED) continue;
+            Instance instance = incoming_instances[draw_call.instance_offset];
+            if(partial_frame && !touchesDirtyTile(instance.screen_min, instance.screen_max)) continue; //Kept from the last frame
+            cacheInstance(instance, draw_call.mesh);
+            glm::vec3 center = camera.getTransform() * instance.model_transform * glm::vec4(draw_call.mesh->bounds_center,1.0f);
+            view_depths.push_back(-center.z);
+            blended_tasks.push_back(draw_call);
+            blended_tasks.back().instance_offset = blended_instances.size();
+            blended_instances.push_back(instance);
+        }
+        std::stable_sort(blended_tasks.begin(), blended_tasks.end(), [&](const DrawCall& a, const DrawCall& b){
+            return view_depths[a.instance_offset] > view_depths[b.instance_offset]; //Farthest first
+        });
+        incoming_tasks.erase(std::remove_if(incoming_tasks.begin(), incoming_tasks.end(), [](const DrawCall& draw_call){ return draw_call.blend_mode == BLENDED; }), incoming_tasks.end());
+    }
+
+    /**
+     * Blend the blended draw calls over the resolved frame
+     * @param id Thread id. Each thread draws every blended draw call in order, but only writes its own band of rows.
+     * @param composite Resolved frame to blend over. Depth is tested but not written.
+     */
+    void blendThread(int id, FrameBuffer* composite){
+        ThreadData& data = thread_data[id];
+        StageTimer timer(&data.busy_ms);
+        data.stats = RenderStats{};
+        data.target = composite;
+        data.blend_mode = BLENDED;
+        int band_height = (getHeight() + MAX_THREADS - 1) / MAX_THREADS;
+        data.scissor_min_y = id * band_height;
+        data.scissor_max_y = std::min(getHeight(), (id + 1) * band_height) - 1;
+        if(data.scissor_min_y > data.scissor_max_y) return;
+        for (const DrawCall& draw_call : blended_tasks) {
+            const Mesh* mesh = draw_call.mesh;
+            draw(data,mesh->vertices.data(),mesh->vertices.size(),mesh->indices.data(),mesh->meshlets.data(),mesh->meshlets.size(),nullptr,blended_instances[draw_call.instance_offset],draw_call.texture,nullptr,0,mesh->getTriangleCount());
+        }
+        if(id != 0) data.stats.clearTriangleCounters(); //Every thread walks the same triangles, so only the first counts them
+    }
+
+    /**
+     * Sort the queued draw calls by blend mode, mesh and texture, and merge ones that share all their state into instanced draw calls
+     * @details Moves the incoming draw calls and instances into the render lists. Also caches the inverse of every instance transform,
+     * so it is computed once per object rather than once per thread a draw call is split between.
+     * Opaque draw calls sort before alpha tested ones, and the two are split between all threads separately.
+     * So every thread draws its share of the opaque triangles before its share of the alpha tested ones, and skips the texture fetch
+     * and alpha test of pixels already hidden in its own depth buffer. Pixels hidden only by the opaque triangles of another thread
+     * are still shaded, and lose in the depth resolve.
+     */
+    void batchDrawCalls() {
+        std::stable_sort(incoming_tasks.begin(), incoming_tasks.end(), [](const DrawCall& a, const DrawCall& b){
+            return std::tie(a.blend_mode, a.skinned_mesh, a.mesh, a.texture, a.lightmap, a.visibility) < std::tie(b.blend_mode, b.skinned_mesh, b.mesh, b.texture, b.lightmap, b.visibility);
+        });
+        render_tasks.clear();
+        instance_arena.clear();
+        instance_arena.reserve(incoming_instances.size());
+        for (const DrawCall& draw_call : incoming_tasks) {
+            bool same_state = !render_tasks.empty() && draw_call.skinned_mesh == nullptr && render_tasks.back().skinned_mesh == nullptr &&
+                    render_tasks.back().mesh == draw_call.mesh && render_tasks.back().texture == draw_call.texture &&
+                    render_tasks.back().lightmap == draw_call.lightmap && render_tasks.back().visibility == draw_call.visibility && render_tasks.back().blend_mode == draw_call.blend_mode;
+            if(!same_state){
+                render_tasks.push_back(draw_call);
+                render_tasks.back().instance_offset = instance_arena.size();
+                render_tasks.back().instance_count = 0;
+            }
+            DrawCall& batch = render_tasks.back();
+            for (size_t i = 0; i < draw_call.instance_count; ++i) {
+                Instance instance = incoming_instances[draw_call.instance_offset + i];
+                if(partial_frame && !touchesDirtyTile(instance.screen_min, instance.screen_max)) continue; //Kept from the last frame
+                cacheInstance(instance, draw_call.mesh);
+                instance_arena.push_back(instance);
+                batch.instance_count++;
+            }
+            batch.start = 0;
+            batch.end = batch.instance_count * batch.getInstanceTriangleCount();
+        }
+        if(partial_frame){
+            render_tasks.erase(std::remove_if(render_tasks.begin(), render_tasks.end(), [](const DrawCall& draw_call){ return draw_call.instance_count == 0; }), render_tasks.end());
+        }
+        incoming_tasks.clear();
+        incoming_instances.clear();
+    }
+
+    /**
+     * Split a range of batched draw calls evenly between all threads, by triangle count
+     * @param begin,end Range of render tasks. Draw calls are split between threads where needed.
+     * @param triangle_count Triangles in the range
+     * @details Threads get contiguous triangle ranges, appended after what they already have.
+     */
+    void distributeDrawCalls(size_t begin, size_t end, size_t triangle_count) {
+        size_t max_tris_per_thread = triangle_count/MAX_THREADS + 1; //count for truncation
+        int current_thread = 0;
+        size_t triangles_in_current_thread = 0;
+        for (size_t i = begin; i < end; ++i) {
+            if((render_tasks[i].end - render_tasks[i].start) <= 0) continue; //Empty mesh
+            //The mesh fits in current thread
+            if( (render_tasks[i].end - render_tasks[i].start)  + triangles_in_current_thread < max_tris_per_thread){
+                thread_data[current_thread].tasks.push_back( render_tasks[i]);
+                triangles_in_current_thread +=   (render_tasks[i].end - render_tasks[i].start);
+            }else{
+                //split mesh and move onto next thread.
+                DrawCall draw_call_a =  render_tasks[i];
+                draw_call_a.end = max_tris_per_thread - triangles_in_current_thread + draw_call_a.start;
+                thread_data[current_thread].tasks.push_back(draw_call_a);
+                render_tasks[i].start =  draw_call_a.end;
+                i--;
+                current_thread++;
+                triangles_in_current_thread = 0;
+            }
+        }
+    }
+
+    /**
+     * Deform the vertices of all queued skinned draw calls with their bone palettes
+     * @details Runs once per frame before the draw calls are split between threads, so every vertex is only skinned once.
+     */
+    void skinDrawCalls() {
+        size_t vertex_count = 0;
+        for (DrawCall& draw_call : render_tasks) {
+            if(draw_call.skinned_mesh == nullptr) continue;
+            draw_call.skinned_vertex_offset = vertex_count;
+            vertex_count += draw_call.skinned_mesh->vertices.size();
+        }
+        skinned_vertices.resize(vertex_count);
+        for (const DrawCall& draw_call : render_tasks) {
+            if(draw_call.skinned_mesh == nullptr) continue;
+            VertexShader::skin(draw_call.skinned_mesh->vertices.data(), draw_call.skinned_mesh->vertices.size(), bone_arena.data() + draw_call.bone_offset, skinned_vertices.data() + draw_call.skinned_vertex_offset);
+        }
+    }
+
+    /**
+     * Get a view space vertex, transforming and lighting it only the first time it is used in the current draw call
+     * @param data Thread to use the vertex cache of. Cache must be big enough for the mesh.
+     * @param vertices Model space vertices of the current draw call
+     * @param index Vertex index
+     * @return View space vertex
+     */
+    const Vertex& getCachedVertex(ThreadData& data, const Vertex* vertices, uint32_t index) const {
+        if(data.vertex_cache_tags[index] != data.draw_tag){
+            data.vertex_cache[index] = data.vertex_shader.toViewSpace(vertices[index]);
+            if(lighting) data.light_cache[index] = data.vertex_shader.shade(data.vertex_cache[index]);
+            data.vertex_cache_tags[index] = data.draw_tag;
+        }
+        return data.vertex_cache[index];
+    }
+
+    /**
+     * Fill in the per frame cache of an instance
+     * @param instance Instance with its model transform set
+     * @param mesh Mesh of the draw call, for light bounds. Nullptr if it has none.
+     * @details Normal cones are only tested under rotation and uniform scale, which keep the angles between normals.
+     * Mirrored transforms flip the winding, and non-uniform scale skews normals by the inverse transpose, so both skip the cone test.
+     */
+    void cacheInstance(Instance& instance, const Mesh* mesh) const {
+        instance.inverse_transform = glm::inverse(instance.model_transform);
+        instance.max_scale = getMaxScale(instance.model_transform);
+        instance.mirrored = glm::determinant(glm::mat3(instance.model_transform)) < 0;
+        instance.cone_culling = !instance.mirrored && isUniformScale(instance.model_transform);
+        instance.light_mask = getLightMask(mesh, instance);
+    }
+
+    /**
+     * Check if the bounding sphere of a meshlet could be in the view frustum
+     * @param meshlet Meshlet to check
+     * @param model_view Model to view space transform of the draw call
+     * @param max_scale Largest axis scale of the model transform
+     * @return False if the meshlet is outside the view frustum
+     */
+    bool meshletInFrustum(const Meshlet& meshlet, const glm::mat4& model_view, float max_scale) const {
+        //Frustum planes of a symmetric perspective projection in view space
+        glm::vec3 center = model_view * glm::vec4(meshlet.center,1.0f);
+        float radius = meshlet.radius * max_scale;
+        if(center.z - radius > -camera.getNearPlaneDistance() || center.z + radius < -camera.getFarPlaneDistance()) return false;
+        const glm::mat4& projection = camera.getProjection();
+        float scale_x = projection[0][0], scale_y = projection[1][1];
+        if(fabsf(center.x) * scale_x + center.z > radius * sqrtf(scale_x*scale_x + 1.0f)) return false;
+        return fabsf(center.y) * scale_y + center.z <= radius * sqrtf(scale_y*scale_y + 1.0f);
+    }
+
+    /**
+     * Check if a meshlet could have any front facing triangles, using its normal cone
+     * @param meshlet Meshlet to check
+     * @param eye Camera position in model space
+     * @param cone_culling If the normal cone can be used, see cacheInstance()
+     * @return False if every triangle of the meshlet faces away from the camera
+     */
+    static bool meshletFrontFacing(const Meshlet& meshlet, const glm::vec3& eye, bool cone_culling) {
+        //Every triangle is backfacing if the angle between the cone axis and every point of the sphere is within 90 degrees minus the cone spread
+        if(!BACKFACE_CULLING || !cone_culling || meshlet.cone_sin > 1.0f) return true;
+        glm::vec3 to_center = meshlet.center - eye;
+        float distance = glm::length(to_center);
+        if(distance <= meshlet.radius) return true;
+        float sphere_sin = meshlet.radius / distance;
+        float sphere_cos = sqrtf(1.0f - sphere_sin*sphere_sin);
+        float spread_sin = meshlet.cone_sin * sphere_cos + meshlet.cone_cos * sphere_sin; //sin(cone angle + sphere angle)
+        if(meshlet.cone_cos * sphere_cos - meshlet.cone_sin * sphere_sin <= 0) return true; //Combined angle is past 90 degrees
+        return glm::dot(to_center,meshlet.cone_axis) < spread_sin * distance;
     }
 
     /**
       * Draw a mesh.
-      * @param frame_buffer Frame buffer to draw to.
-      * @param mesh Mesh to draw.
-      * @param model_transform Transform of mesh.
+      * @param data Thread to draw with. Its vertex shader must have the camera set. This method will set the model transform.
+      * @param vertices Model space vertex buffer of mesh to draw.
+      * @param vertex_count Size of vertex buffer.
+      * @param indices Index buffer of mesh to draw.
+      * @param meshlets Meshlets of the mesh in triangle order. If there are none every triangle in range is drawn.
+      * @param meshlet_count Number of meshlets.
+      * @param visibility Precomputed visibility of the meshlets, or nullptr.
+      * @param instance Transform of mesh, with its cached inverse.
       * @param texture Texture to use for rendering
-      * @param shader Vertex shader with the camera set. This method will set the model transform.
+      * @param lightmap Baked lighting, or nullptr. Replaces the ambient light.
       * @param start, end Range of triangles to draw.
     */
-    void draw(FrameBuffer& frame_buffer, const Mesh* mesh, const glm::mat4& model_transform ,const Texture* texture, VertexShader& vertex_shader, size_t start, size_t end)  const {
-        vertex_shader.setModelTransform(model_transform);
+    void draw(ThreadData& data, const Vertex* vertices, size_t vertex_count, const uint32_t* indices, const Meshlet* meshlets, size_t meshlet_count, const PotentiallyVisibleSet* visibility, const Instance& instance ,const Texture* texture, const Texture* lightmap, size_t start, size_t end)  const {
+        data.vertex_shader.setModelTransform(instance.model_transform, instance.inverse_transform);
+        if(lighting) data.vertex_shader.setLights(view_lights, instance.light_mask, lightmap == nullptr ? ambient : glm::vec3(0));
+        //Invalidate the vertex cache
+        if(data.vertex_cache.size() < vertex_count){
+            data.vertex_cache.resize(vertex_count);
+            data.light_cache.resize(vertex_count);
+            data.vertex_cache_tags.resize(vertex_count, data.draw_tag);
+        }
+        data.draw_tag++;
+        if(data.draw_tag == 0){ //Wrapped around, old tags could match again
+            std::fill(data.vertex_cache_tags.begin(), data.vertex_cache_tags.end(), 0);
+            data.draw_tag = 1;
+        }
+
+        if(meshlet_count == 0){
+            drawTriangles(data, vertices, indices, texture, lightmap, start, end);
+            return;
+        }
+        //Cull whole meshlets before any per triangle work
+        glm::mat4 model_view = camera.getTransform() * instance.model_transform;
+        glm::vec3 eye = instance.inverse_transform * glm::vec4(camera.getPosition(),1.0f);
+        const uint64_t* visible_meshlets = visibility == nullptr ? nullptr : visibility->getVisibleMeshlets(visibility->getCell(eye)); //Camera cell
+        const Meshlet* meshlets_end = meshlets + meshlet_count;
+        const Meshlet* meshlet = std::upper_bound(meshlets, meshlets_end, start, [](size_t triangle, const Meshlet& other){return triangle < other.end;}); //First meshlet overlapping range
+        for (; meshlet != meshlets_end && meshlet->start < end; ++meshlet) {
+            size_t range_start = std::max(start,meshlet->start), range_end = std::min(end,meshlet->end);
+            {
+                StageTimer timer(stage_timing ? &data.stats.clip_ms : nullptr);
+                size_t* culled = nullptr; //Counter of the first test that rejects the meshlet
+                if(!PotentiallyVisibleSet::isMeshletVisible(visible_meshlets, meshlet - meshlets)) culled = &data.stats.triangles_cluster_pvs_culled;
+                else if(!meshletInFrustum(*meshlet, model_view, instance.max_scale)) culled = &data.stats.triangles_cluster_frustum_culled;
+                else if(!meshletFrontFacing(*meshlet, eye, instance.cone_culling)) culled = &data.stats.triangles_cluster_cone_culled;
+                if(culled != nullptr){
+                    *culled += range_end - range_start;
+                    continue;
+                }
+            }
+            drawTriangles(data, vertices, indices, texture, lightmap, range_start, range_end);
+        }
+    }
+
+    /**
+     * Draw a range of triangles of the current draw call
+     * @param data Thread to draw with. Vertex shader and vertex cache must be set up for the draw call.
+     * @param vertices Model space vertex buffer of mesh to draw.
+     * @param indices Index buffer of mesh to draw.
+     * @param texture Texture to use for rendering
+     * @param lightmap Baked lighting, or nullptr.
+     * @param start, end Range of triangles to draw.
+     */
+    void drawTriangles(ThreadData& data, const Vertex* vertices, const uint32_t* indices, const Texture* texture, const Texture* lightmap, size_t start, size_t end) const {
+        RenderStats& thread_stats = data.stats;
         for (size_t i = start; i < end; ++i) {
-            const Triangle& triangle = mesh->tris[i];
-            Triangle view_tri = vertex_shader.toViewSpace(triangle); //Geometry shader
-            std::vector<Triangle> clipped_view_tris = clip(view_tri);
-            for (const Triangle& clipped_view_tri : clipped_view_tris) {
-                Triangle clip_tri = vertex_shader.toClipSpace(clipped_view_tri); //Project
-                rasterize(clip_tri,frame_buffer,texture);
+            ShadedTriangle view_tri{}; //Geometry shader
+            {
+                StageTimer timer(stage_timing ? &thread_stats.vertex_ms : nullptr);
+                for (int v = 0; v < 3; ++v) {
+                    const Vertex& vertex = getCachedVertex(data, vertices, indices[i*3+v]);
+                    view_tri.triangle.pos[v] = glm::vec4(vertex.pos,1.0f);
+                    view_tri.triangle.norm[v] = vertex.norm;
+                    view_tri.triangle.tex[v] = vertex.tex;
+                    if(lightmap != nullptr) view_tri.lightmap_tex[v] = vertex.lightmap_tex;
+                    if(lighting) view_tri.light[v] = data.light_cache[indices[i*3+v]];
+                }
+            }
+            ShadedTriangle clip_tris[MAX_CLIPPED_TRIANGLES];
+            int clipped_count;
+            {
+                StageTimer timer(stage_timing ? &thread_stats.clip_ms : nullptr);
+                ShadedTriangle clipped_view_tris[MAX_CLIPPED_TRIANGLES];
+                clipped_count = clip(view_tri, clipped_view_tris);
+                if(clipped_count == 0) thread_stats.triangles_near_clipped++;
+                int visible_count = 0;
+                for (int c = 0; c < clipped_count; ++c) {
+                    clip_tris[visible_count] = clipped_view_tris[c];
+                    clip_tris[visible_count].triangle = data.vertex_shader.toClipSpace(clipped_view_tris[c].triangle); //Project
+                    if(!outsideSidePlanes(clip_tris[visible_count].triangle)) visible_count++;
+                }
+                thread_stats.triangles_frustum_culled += clipped_count - visible_count;
+                clipped_count = visible_count;
+            }
+            StageTimer timer(stage_timing ? &thread_stats.raster_ms : nullptr);
+            for (int c = 0; c < clipped_count; ++c) {
+                rasterizeTriangle(data,clip_tris[c],texture,lightmap);
             }
         }
     }
 
 
     /**
-     * Combine right frame buffer into the left
-     * @warning Must be the same size
+     * Get the world space direction of the ray through a pixel
+     * @param x,y Pixel coordinate, matching the sample positions of the rasterizer
+     * @return Direction, not normalized
      */
-    static void combineFrameBuffers(FrameBuffer& left, const FrameBuffer& right){
-        for (int x = 0; x < left.getWidth(); ++x) { //X first is cache efficient for framebuffer layout
-            for (int y = 0; y < left.getHeight(); ++y) {
-                left.setPixelIfDepth(x,y,right.getPixel(x,y));
+    [[nodiscard]] glm::vec3 rayDirection(float x, float y) const {
+        return ray_corner + ray_dx * x + ray_dy * y;
+    }
+
+    /**
+     * March a cone containing every ray of a tile, to find how far all of them can skip before any could hit a field
+     * @param sdf Field to march
+     * @param direction Unit direction of the cone axis, starting at the camera
+     * @param slope Tangent of the cone half angle
+     * @param start Output distance from the camera to start the rays of the tile at
+     * @param end Output distance from the camera to stop the rays at
+     * @return False if no ray of the tile can hit the field
+     * @see https://www.youtube.com/watch?v=fo2HwbHV7EQ cone marching
+     * @details The field is a lower bound of the distance to the surface, so a sphere of that radius around a point on the axis is empty.
+     * Stepping while that sphere still contains the cross-section of the cone keeps the whole cone up to start empty.
+     */
+    bool coneMarch(const SDFDrawCall& sdf, const glm::vec3& direction, float slope, float& start, float& end) const {
+        glm::vec3 eye = camera.getPosition();
+        glm::vec3 to_center = sdf.center - eye;
+        float center_distance = glm::length(to_center);
+        start = std::max(camera.getNearPlaneDistance(), center_distance - sdf.radius);
+        end = std::min(camera.getFarPlaneDistance(), center_distance + sdf.radius);
+        if(start >= end) return false;
+        //Bounding sphere against cone, the angle to the center must be less than the cone angle plus the angle of the sphere
+        if(center_distance > sdf.radius){
+            float cos_cone = 1.0f / sqrtf(1.0f + slope * slope), sin_cone = slope * cos_cone;
+            float sin_sphere = sdf.radius / center_distance, cos_sphere = sqrtf(1.0f - sin_sphere * sin_sphere);
+            if(glm::dot(direction, to_center) / center_distance < cos_cone * cos_sphere - sin_cone * sin_sphere) return false;
+        }
+        for (int i = 0; i < SDF_MAX_STEPS; ++i) {
+            glm::vec3 point = eye + direction * start;
+            float distance = sdf.sdf(glm::vec4(point.x), glm::vec4(point.y), glm::vec4(point.z)).x;
+            if(distance < slope * start) return true; //Cone touches the surface, rays take over from here
+            start += (distance - slope * start) / (1.0f + slope);
+            if(start >= end) return false;
+        }
+        return true;
+    }
+
+    /**
+     * March the rays of a tile into a field, in packets of 2x2 pixels
+     * @param data Thread to write to
+     * @param sdf Field to march
+     * @param tile_min,tile_max Inclusive pixel bounds of the tile
+     * @param start,end Distance range to march, from coneMarch()
+     */
+    void marchTile(ThreadData& data, const SDFDrawCall& sdf, const glm::ivec2& tile_min, const glm::ivec2& tile_max, float start, float end) const {
+        const float NORMAL_ESTIMATION_DIST = 0.001;
+        glm::vec3 eye = camera.getPosition();
+        glm::vec3 to_center = sdf.center - eye;
+        float center_distance_squared = glm::dot(to_center, to_center);
+        float near_plane = camera.getNearPlaneDistance(), far_plane = camera.getFarPlaneDistance();
+        for (int packet_y = tile_min.y; packet_y <= tile_max.y; packet_y += 2) {
+            for (int packet_x = tile_min.x; packet_x <= tile_max.x; packet_x += 2) {
+                //Rays as structure of arrays, one lane per pixel
+                glm::vec4 direction_x, direction_y, direction_z, distance{start}, lane_end{end}, field{0};
+                bool active[4], hit[4] = {false,false,false,false};
+                for (int lane = 0; lane < 4; ++lane) {
+                    int x = packet_x + (lane & 1), y = packet_y + (lane >> 1);
+                    glm::vec3 direction = glm::normalize(rayDirection((float)x, (float)y));
+                    direction_x[lane] = direction.x;
+                    direction_y[lane] = direction.y;
+                    direction_z[lane] = direction.z;
+                    //Clip each ray to the bounding sphere, the tile range is only a bound for the whole tile
+                    float along = glm::dot(to_center, direction);
+                    float half_chord_squared = sdf.radius * sdf.radius - (center_distance_squared - along * along);
+                    active[lane] = x <= tile_max.x && y <= tile_max.y && half_chord_squared > 0;
+                    if(!active[lane]) continue;
+                    float half_chord = sqrtf(half_chord_squared);
+                    distance[lane] = std::max(start, along - half_chord);
+                    lane_end[lane] = std::min(end, along + half_chord);
+                    active[lane] = distance[lane] < lane_end[lane];
+                    if(active[lane]) data.stats.sdf_rays++;
+                }
+                //Sphere trace, see https://michaelwalczyk.com/blog-ray-marching.html
+                for (int i = 0; i < SDF_MAX_STEPS && (active[0] || active[1] || active[2] || active[3]); ++i) {
+                    field = sdf.sdf(eye.x + direction_x * distance, eye.y + direction_y * distance, eye.z + direction_z * distance);
+                    for (int lane = 0; lane < 4; ++lane) {
+                        if(!active[lane]) continue;
+                        if(field[lane] < distance[lane] * pixel_slope * 0.5f){ //Closer than half a pixel
+                            hit[lane] = true;
+                            active[lane] = false;
+                            continue;
+                        }
+                        distance[lane] += field[lane];
+                        if(distance[lane] > lane_end[lane]) active[lane] = false;
+                    }
+                }
+                if(!(hit[0] || hit[1] || hit[2] || hit[3])) continue;
+                //Normals from forward differences, one packet per axis
+                glm::vec4 hit_x = eye.x + direction_x * distance, hit_y = eye.y + direction_y * distance, hit_z = eye.z + direction_z * distance;
+                glm::vec4 normal_x = sdf.sdf(hit_x + NORMAL_ESTIMATION_DIST, hit_y, hit_z) - field;
+                glm::vec4 normal_y = sdf.sdf(hit_x, hit_y + NORMAL_ESTIMATION_DIST, hit_z) - field;
+                glm::vec4 normal_z = sdf.sdf(hit_x, hit_y, hit_z + NORMAL_ESTIMATION_DIST) - field;
+                for (int lane = 0; lane < 4; ++lane) {
+                    if(!hit[lane]) continue;
+                    int x = packet_x + (lane & 1), y = packet_y + (lane >> 1);
+                    glm::vec3 position{hit_x[lane], hit_y[lane], hit_z[lane]};
+                    //Same depth as the rasterizer, so fields and triangles are depth tested against each other
+                    glm::vec4 clip = view_projection * glm::vec4(position, 1.0f);
+                    float depth = (clip.z / clip.w + 1.0f) * (far_plane - near_plane) / 2.0f + near_plane;
+                    if(depth >= data.frame_buffer.getDepth(x,y)) continue;
+                    glm::vec3 normal = glm::normalize(glm::vec3{normal_x[lane], normal_y[lane], normal_z[lane]});
+                    glm::vec3 light{0.25f + 0.75f * std::max(0.0f, -(normal.x * direction_x[lane] + normal.y * direction_y[lane] + normal.z * direction_z[lane]))}; //Light at the camera
+                    if(lighting){
+                        light = ambient;
+                        for (const Light& world_light : lights) {
+                            light += world_light.evaluate(position, normal);
+                        }
+                    }
+                    data.frame_buffer.setPixel(x,y,FrameBuffer::packColor(glm::clamp(sdf.color * light, 0.0f, 1.0f) * 255.0f),depth);
+                }
+            }
+        }
+    }
+
+    /**
+     * Ray march the signed distance fields of the frame into the frame buffer of a thread
+     * @param data Thread to write to. Its triangles should already be drawn, so hidden pixels are not shaded.
+     * @param id Thread location in pool. Threads take every MAX_THREADS-th tile, so fields covering part of the screen are still split evenly.
+     */
+    void marchSDFs(ThreadData& data, int id) const {
+        int width = data.frame_buffer.getWidth(), height = data.frame_buffer.getHeight();
+        int tiles_x = (width + SDF_TILE_SIZE - 1) / SDF_TILE_SIZE, tiles_y = (height + SDF_TILE_SIZE - 1) / SDF_TILE_SIZE;
+        for (int tile = id; tile < tiles_x * tiles_y; tile += MAX_THREADS) {
+            glm::ivec2 tile_min{(tile % tiles_x) * SDF_TILE_SIZE, (tile / tiles_x) * SDF_TILE_SIZE};
+            glm::ivec2 tile_max = glm::min(tile_min + SDF_TILE_SIZE - 1, glm::ivec2{width - 1, height - 1});
+            if(partial_frame && !touchesDirtyTile(tile_min, tile_max)) continue; //Kept from the last frame
+            //Cone through the tile center that contains the rays of the corner pixels
+            glm::vec2 tile_center = glm::vec2(tile_min + tile_max) / 2.0f;
+            glm::vec3 direction = glm::normalize(rayDirection(tile_center.x, tile_center.y));
+            float min_cos = 1;
+            for (int corner = 0; corner < 4; ++corner) {
+                glm::vec3 corner_direction = rayDirection((float)(corner & 1 ? tile_max.x : tile_min.x), (float)(corner & 2 ? tile_max.y : tile_min.y));
+                min_cos = std::min(min_cos, glm::dot(direction, glm::normalize(corner_direction)));
+            }
+            float slope = sqrtf(std::max(0.0f, 1.0f - min_cos * min_cos)) / min_cos + pixel_slope; //Padded by a pixel for rounding
+            for (const SDFDrawCall& sdf : render_sdfs) {
+                if(glm::any(glm::greaterThan(tile_min, sdf.screen_max)) || glm::any(glm::lessThan(tile_max, sdf.screen_min))) continue;
+                float start, end;
+                if(!coneMarch(sdf, direction, slope, start, end)) continue;
+                marchTile(data, sdf, tile_min, tile_max, start, end);
+            }
+        }
+    }
+
+    /**
+     * Get the pixels a bounding sphere can cover
+     * @param center,radius World space bounding sphere
+     * @param screen_min,screen_max Output inclusive pixel bounds, clamped to the screen. Empty if min is larger than max.
+     * @details Projects the corners of the box around the sphere. The whole screen if any corner is behind the camera.
+     */
+    void getScreenBounds(const glm::vec3& center, float radius, glm::ivec2& screen_min, glm::ivec2& screen_max) const {
+        glm::vec2 projected_min{INFINITY}, projected_max{-INFINITY};
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 offset{corner & 1 ? radius : -radius, corner & 2 ? radius : -radius, corner & 4 ? radius : -radius};
+            glm::vec4 clip = view_projection * glm::vec4(center + offset, 1.0f);
+            if(clip.w <= camera.getNearPlaneDistance()){
+                screen_min = {0,0};
+                screen_max = {getWidth()-1, getHeight()-1};
+                return;
+            }
+            glm::vec2 screen = (glm::vec2(clip) / clip.w + 1.0f) * glm::vec2(getWidth(), getHeight()) / 2.0f; //Same mapping as the rasterizer
+            projected_min = glm::min(projected_min, screen);
+            projected_max = glm::max(projected_max, screen);
+        }
+        screen_min = glm::max(glm::ivec2(glm::floor(projected_min)), glm::ivec2(0));
+        screen_max = glm::min(glm::ivec2(glm::ceil(projected_max)), glm::ivec2(getWidth()-1, getHeight()-1));
+    }
+
+    /**
+     * Combine the frame buffers of all threads, writing every output pixel once
+     * @param target Where to write the nearest color of each pixel. Must be the same size as the thread frame buffers.
+     * @param depth Where to write the nearest depth of each pixel, row major without padding. Nullptr to skip.
+     * @param tile_mask Only write the tiles set in this mask, see dirty_tiles. Nullptr to write every pixel.
+     * @details On equal depth the lower thread wins, the same as combining them pairwise from the last thread down.
+     */
+    void resolveFrameBuffers(const PixelSpan& target, float* depth, const uint8_t* tile_mask) const {
+        const int width = thread_data[0].frame_buffer.getWidth();
+        assert(target.width == width && target.height == thread_data[0].frame_buffer.getHeight());
+        const float* depth_planes[MAX_THREADS];
+        const uint32_t* color_planes[MAX_THREADS];
+        for (int i = 0; i < MAX_THREADS; ++i) {
+            depth_planes[i] = thread_data[i].frame_buffer.getDepthPlane();
+            color_planes[i] = thread_data[i].frame_buffer.getColorPlane();
+        }
+        int span_width = tile_mask != nullptr ? REUSE_TILE_SIZE : width, tiles_x = getTilesX();
+        for (int y = 0; y < target.height; ++y) { //Y first is cache efficient for the row major framebuffer layout
+            uint32_t* row = target.getRow(y);
+            size_t row_start = (size_t)y * width;
+            for (int span_start = 0; span_start < width; span_start += span_width) {
+                if(tile_mask != nullptr && !tile_mask[(y / REUSE_TILE_SIZE) * tiles_x + span_start / REUSE_TILE_SIZE]) continue;
+                int span_end = std::min(width, span_start + span_width);
+                for (int x = span_start; x < span_end; ++x) {
+                    size_t index = row_start + x;
+                    float nearest = depth_planes[0][index];
+                    uint32_t color = color_planes[0][index];
+                    for (int i = 1; i < MAX_THREADS; ++i) {
+                        if(depth_planes[i][index] < nearest){
+                            nearest = depth_planes[i][index];
+                            color = color_planes[i][index];
+                        }
+                    }
+                    row[x] = color;
+                    if(depth != nullptr) depth[index] = nearest;
+                }
             }
         }
     }
@@ -356,7 +1245,7 @@ public:
      * Create a renderer
      * @param width,height Resolution in pixels.
      */
-    explicit Renderer(int width, int height) :camera(Camera{90,{0,0,1},(float)width/(float)height}) {
+    explicit Renderer(int width, int height) :camera(Camera{90,{0,0,1},(float)width/(float)height}), queued_camera(camera) {
         camera.setPosition({2,2,2}); //Default values to avoid look at errors.
         setCamera(camera);
         for(ThreadData& data : thread_data){
@@ -364,23 +1253,146 @@ public:
         }
     }
 
+    Renderer(const Renderer&) = delete;
+    Renderer& operator=(const Renderer&) = delete;
+
+    /**
+     * Wait for a frame still being rendered
+     */
+    ~Renderer(){
+        if(rendering && threads_started){
+            for (std::thread& thread : thread_pool) {
+                thread.join();
+            }
+        }
+    }
+
+    /**
+     * Pick the coarsest level of detail whose error stays below LOD_PIXEL_ERROR on screen
+     * @param mesh Mesh with optional lods
+     * @param model_transform Transform of mesh
+     * @return Mesh to draw
+     * @details The bounding sphere is projected with the queued camera, and its error to radius ratio gives the pixel error.
+     */
+    [[nodiscard]] const Mesh* selectLOD(const Mesh* mesh, const glm::mat4& model_transform) const {
+        if(mesh->lods.empty()) return mesh;
+        float max_scale = getMaxScale(model_transform);
+        glm::vec3 center = model_transform * glm::vec4(mesh->bounds_center,1.0f);
+        float radius = mesh->bounds_radius * max_scale;
+        float distance = glm::distance(center, queued_camera.getPosition()) - radius; //Nearest point of the sphere
+        if(distance <= queued_camera.getNearPlaneDistance() || radius <= 0) return mesh;
+        float projected_radius = radius * queued_camera.getProjection()[1][1] * (float)getHeight() / 2.0f / distance; //In pixels
+        const Mesh* selected = mesh;
+        for (const Mesh& lod : mesh->lods) {
+            if(projected_radius * (lod.lod_error * max_scale / radius) > LOD_PIXEL_ERROR) break;
+            selected = &lod;
+        }
+        return selected;
+    }
+
     /**
-     * Set the current camera
-     * @details Will override the last camera set
+     * Change the render resolution
+     * @param width,height New resolution in pixels. Aspect ratio is up to the camera.
+     * @warning No frame may be rendering.
+     */
+    void resize(int width, int height) {
+        assert(!rendering);
+        for(ThreadData& data : thread_data){
+            data.frame_buffer = FrameBuffer(width,height,{0,0,0,0});
+        }
+        if(temporal_reuse){
+            history = FrameBuffer(width,height,{0,0,0,0});
+            history_valid = false;
+        }
+    }
+
+    /**
+     * Enable or disable temporal reuse
+     * @param enabled If tiles where nothing changed since the last frame should be copied from it instead of rendered again.
+     * @details Off by default. Draw calls are tracked by their mesh, textures, transform, and pose, so resources must not change while they are in use.
+     * A frame where nothing changed starts no render threads at all, see RenderStats::dirty_tiles.
+     * @warning No frame may be rendering.
+     */
+    void setTemporalReuse(bool enabled) {
+        assert(!rendering);
+        temporal_reuse = enabled;
+        history = enabled ? FrameBuffer(getWidth(),getHeight(),{0,0,0,0}) : FrameBuffer();
+        history_valid = false;
+        last_signatures.clear();
+    }
+
+    /**
+     * Get render width in pixels
+     */
+    [[nodiscard]] int getWidth() const {
+        return thread_data[0].frame_buffer.getWidth();
+    }
+
+    /**
+     * Get render height in pixels
+     */
+    [[nodiscard]] int getHeight() const {
+        return thread_data[0].frame_buffer.getHeight();
+    }
+
+    /**
+     * Set the camera of the frame being queued
+     * @details Will override the last camera set. A frame still being rendered keeps its camera.
      */
     void setCamera(const Camera& new_camera) {
-        camera = new_camera;
+        queued_camera = new_camera;
+    }
+
+    /**
+     * Set the lights of the frame being queued
+     * @param new_lights World space lights. At most Light::MAX_LIGHTS. Each draw is only lit by the lights reaching its bounds.
+     * @param new_ambient Light reaching every surface
+     * @details Lights are evaluated per vertex and interpolated(Gouraud shading). Stays until changed.
+     * With no lights and an ambient light of 1 lighting is skipped entirely, which is the default.
+     */
+    void setLights(const std::vector<Light>& new_lights, const glm::vec3& new_ambient) {
+        assert(new_lights.size() <= Light::MAX_LIGHTS);
+        queued_lights = new_lights;
+        queued_ambient = new_ambient;
     }
 
 
     /**
      * Queue a draw call
-     * @param mesh Mesh to draw
+     * @param mesh Mesh to draw. A coarser level of detail is drawn instead if the difference is not visible. Set the camera first.
      * @param model_transform Transform of mesh
      * @param texture Texture to use for rendering
+     * @param visibility Precomputed visibility of the mesh's meshlets. Meshlets not visible from the camera's cell are skipped.
+     * Always draws the full mesh, since the visibility is for its meshlets.
+     * @param lightmap Baked lighting of the mesh, see ResourceManager::getLightmap(). Replaces the ambient light, dynamic lights still add on top.
+     * Always draws the full mesh, since only it has lightmap uvs.
      */
-    void queueDraw(const Mesh* mesh, const glm::mat4& model_transform ,const Texture* texture){
-        incoming_tasks.push_back(DrawCall{mesh, nullptr,model_transform,texture,0,mesh->tris.size(),{}});
+    void queueDraw(const Mesh* mesh, const glm::mat4& model_transform ,const Texture* texture, const PotentiallyVisibleSet* visibility = nullptr, const Texture* lightmap = nullptr){
+        assert(visibility == nullptr || visibility->meshlet_count == mesh->meshlets.size());
+        if(visibility == nullptr && lightmap == nullptr) mesh = selectLOD(mesh, model_transform);
+        incoming_tasks.push_back(DrawCall{mesh, nullptr,texture,lightmap,0,mesh->getTriangleCount(),incoming_instances.size(),1,0,0,visibility,getBlendMode(texture)});
+        incoming_instances.push_back(Instance{model_transform});
+    }
+
+    /**
+     * Queue many instances of a mesh with the same texture
+     * @param mesh Mesh to draw. All instances share the finest level of detail any of them needs. Set the camera first.
+     * @param model_transforms Transform of each instance
+     * @param texture Texture to use for rendering
+     * @details Queues a single draw call for all instances, so the mesh and texture are only set up once.
+     * Separate queueDraw() calls with the same mesh, level and texture are batched the same way when the frame starts.
+     */
+    void queueDrawInstanced(const Mesh* mesh, const std::vector<glm::mat4>& model_transforms, const Texture* texture){
+        if(model_transforms.empty()) return;
+        const Mesh* selected = nullptr;
+        for (const glm::mat4& model_transform : model_transforms) {
+            const Mesh* level = selectLOD(mesh, model_transform);
+            if(selected == nullptr || level->getTriangleCount() > selected->getTriangleCount()) selected = level;
+        }
+        incoming_tasks.push_back(DrawCall{selected, nullptr,texture,nullptr,0,model_transforms.size() * selected->getTriangleCount(),incoming_instances.size(),model_transforms.size(),0,0,nullptr,getBlendMode(texture)});
+        for (const glm::mat4& model_transform : model_transforms) {
+            incoming_instances.push_back(Instance{model_transform});
+        }
     }
 
     /**
@@ -388,93 +1400,288 @@ public:
      * @param mesh Mesh to draw
      * @param model_transform Transform of mesh
      * @param texture Texture to use for rendering
-     * @param bones Pose to deform mesh with. Must be compatible with mesh.
+     * @param bones Pose to deform mesh with. Must be compatible with mesh. Copied into the frame's bone arena.
      */
     void queueSkinnedDraw(const SkinnedMesh* mesh, const glm::mat4& model_transform ,const Texture* texture,const std::vector<glm::mat4>& bones){
-        incoming_tasks.push_back(DrawCall{nullptr, mesh,model_transform,texture,0,mesh->tris.size(),bones});
+        assert(mesh->num_bones == (int)bones.size());
+        queueSkinnedDraw(mesh, model_transform, texture, bones.data());
     }
 
     /**
-     * Get the result of the render and wait for it to finish.
-     * @param frame_buffer Frame buffer to write the result to.
+     * Queue a skinned draw call
+     * @param mesh Mesh to draw
+     * @param model_transform Transform of mesh
+     * @param texture Texture to use for rendering
+     * @param bones Pose to deform mesh with, one matrix per bone of the mesh. Copied into the frame's bone arena.
      */
-    void getResult(FrameBuffer& frame_buffer){
+    void queueSkinnedDraw(const SkinnedMesh* mesh, const glm::mat4& model_transform ,const Texture* texture,const glm::mat4* bones){
+        incoming_tasks.push_back(DrawCall{nullptr, mesh,texture,nullptr,0,mesh->getTriangleCount(),incoming_instances.size(),1,incoming_bones.size(),0,nullptr,getBlendMode(texture)});
+        incoming_instances.push_back(Instance{model_transform});
+        incoming_bones.insert(incoming_bones.end(),bones,bones + mesh->num_bones);
+    }
+
+    /**
+     * Queue a draw call that is blended over what is behind it by its texture alpha
+     * @param mesh Mesh to draw. A coarser level of detail is drawn instead if the difference is not visible. Set the camera first.
+     * @param model_transform Transform of mesh
+     * @param texture Texture to use for rendering. Alpha of 255 is opaque, 0 is invisible.
+     * @details Drawn after everything else, sorted back to front by the center of the mesh bounds. Does not write depth.
+     * Triangles within the mesh are not sorted, so overlapping parts of the same mesh may blend in the wrong order.
+     */
+    void queueDrawBlended(const Mesh* mesh, const glm::mat4& model_transform ,const Texture* texture){
+        mesh = selectLOD(mesh, model_transform);
+        incoming_tasks.push_back(DrawCall{mesh, nullptr,texture,nullptr,0,mesh->getTriangleCount(),incoming_instances.size(),1,0,0,nullptr,BLENDED});
+        incoming_instances.push_back(Instance{model_transform});
+    }
+
+    /**
+     * Queue a signed distance field to be ray marched
+     * @param sdf World space field. Must stay valid until the frame is finished.
+     * @param center,radius World space bounding sphere containing the whole surface. Rays are only marched inside it.
+     * @param color Surface color, 0-1 per channel. Lit by the lights of the frame, or by a light at the camera if the frame is unlit.
+     * @details Marched after the triangles with depth, so fields and meshes hide each other correctly.
+     */
+    void queueSDF(const SDFPacket& sdf, const glm::vec3& center, float radius, const glm::vec3& color){
+        incoming_sdfs.push_back(SDFDrawCall{sdf, center, radius, color, {}, {}});
+    }
+
+    /**
+     * Start rendering the queued draw calls in the background
+     * @details The draw list is swapped out, so the next frame can be queued while this one renders.
+     * Resources used by the draw calls must stay valid until finishRender() returns.
+     * With temporal reuse only the tiles that changed are rendered.
+     * @warning The last frame must have been finished.
+     */
+    void startRender(){
+        assert(!rendering);
+        frame_start = std::chrono::steady_clock::now();
+        stats = RenderStats{};
+        camera = queued_camera;
+        lights = queued_lights;
+        ambient = queued_ambient;
+        lighting = !lights.empty() || ambient != glm::vec3(1);
+        for (size_t i = 0; i < lights.size(); ++i) {
+            view_lights[i] = lights[i].transformed(camera.getTransform());
+        }
+        view_projection = camera.getProjection() * camera.getTransform();
+        stats.instances = incoming_instances.size();
+        rendering = true;
+        partial_frame = false;
+        stats.dirty_tiles = (size_t)getTilesX() * getTilesY();
+        if(temporal_reuse){
+            findDirtyTiles();
+        }
+        threads_started = stats.dirty_tiles > 0;
+        if(!threads_started){ //Nothing changed, finishRender() hands out the last frame
+            incoming_tasks.clear();
+            incoming_instances.clear();
+            incoming_bones.clear();
+            incoming_sdfs.clear();
+            return;
+        }
+        {
+            StageTimer timer(&stats.bin_ms);
+            sortBlendedDrawCalls();
+            batchDrawCalls();
+        }
+        std::swap(bone_arena,incoming_bones);
+        incoming_bones.clear();
+        std::swap(render_sdfs,incoming_sdfs);
+        incoming_sdfs.clear();
+        if(!render_sdfs.empty()){
+            //Rays through the mid depth plane are linear in screen space, so only three need unprojecting
+            glm::mat4 inverse_camera = camera.getInverseMatrix();
+            auto unproject = [&](float x, float y){
+                glm::vec4 point = inverse_camera * glm::vec4{x, y, 0.0f, 1.0f};
+                return glm::vec3(point) / point.w - camera.getPosition();
+            };
+            ray_corner = unproject(-1,-1);
+            ray_dx = (unproject(1,-1) - ray_corner) / (float)getWidth();
+            ray_dy = (unproject(-1,1) - ray_corner) / (float)getHeight();
+            pixel_slope = glm::length(ray_dx) / glm::length(rayDirection((float)getWidth() / 2.0f, (float)getHeight() / 2.0f));
+            for (SDFDrawCall& sdf : render_sdfs) {
+                getScreenBounds(sdf.center, sdf.radius, sdf.screen_min, sdf.screen_max);
+            }
+        }
+        stats.sdf_draws = render_sdfs.size();
+        {
+            StageTimer timer(stage_timing ? &stats.vertex_ms : nullptr);
+            skinDrawCalls();
+        }
+
         //Get triangle count
         size_t num_triangles = 0;
-        for (const DrawCall& draw_call : incoming_tasks) {
-                num_triangles += draw_call.mesh->tris.size();
+        for (const DrawCall& draw_call : render_tasks) {
+                num_triangles += draw_call.end - draw_call.start;
         }
+        size_t num_blended_triangles = 0;
+        for (const DrawCall& draw_call : blended_tasks) {
+            num_blended_triangles += draw_call.end - draw_call.start;
+        }
+        stats.draw_calls = render_tasks.size();
+        stats.blended_draws = blended_tasks.size();
+        stats.triangles = num_triangles + num_blended_triangles;
 
-        size_t max_tris_per_thread = num_triangles/MAX_THREADS + 1; //count for truncation
-
-        //Distribute work
-        int current_thread = 0;
-        size_t triangles_in_current_thread = 0;
-        for (size_t i = 0; i <  incoming_tasks.size(); ++i) {
-            if((incoming_tasks[i].end - incoming_tasks[i].start) <= 0) continue; //Empty mesh
-            //The mesh fits in current thread
-            if( (incoming_tasks[i].end - incoming_tasks[i].start)  + triangles_in_current_thread < max_tris_per_thread){
-                thread_data[current_thread].tasks.push_back( incoming_tasks[i]);
-                triangles_in_current_thread +=   (incoming_tasks[i].end - incoming_tasks[i].start);
-            }else{
-                //split mesh and move onto next thread.
-                DrawCall draw_call_a =  incoming_tasks[i];
-                draw_call_a.end = max_tris_per_thread - triangles_in_current_thread + draw_call_a.start;
-                thread_data[current_thread].tasks.push_back(draw_call_a);
-                incoming_tasks[i].start =  draw_call_a.end;
-                i--;
-                current_thread++;
-                triangles_in_current_thread = 0;
+        //Distribute work. Each blend mode is split between all threads on its own, see batchDrawCalls()
+        auto bin_start = std::chrono::steady_clock::now();
+        size_t group_start = 0;
+        while (group_start < render_tasks.size()) {
+            size_t group_end = group_start, group_triangles = 0;
+            while (group_end < render_tasks.size() && render_tasks[group_end].blend_mode == render_tasks[group_start].blend_mode) {
+                group_triangles += render_tasks[group_end].end - render_tasks[group_end].start;
+                group_end++;
             }
+            distributeDrawCalls(group_start, group_end, group_triangles);
+            group_start = group_end;
         }
+        stats.bin_ms += std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - bin_start).count();
         //Start threads
         for (int i = 0; i < MAX_THREADS; ++i) {
             thread_pool[i] = std::thread(&Renderer::renderThread,this, i);
         }
-        //End threads
-        for (int i = 0; i < MAX_THREADS; ++i) {
-            thread_pool[i].join();
+    }
+
+    /**
+     * Wait for the frame started with startRender() to finish
+     * @param frame_buffer Frame buffer to write the result to. Must be the same size as the renderer.
+     */
+    void finishRender(FrameBuffer& frame_buffer){
+        finishRender(frame_buffer.getPixelSpan(),frame_buffer.getDepthPlane());
+    }
+
+    /**
+     * Wait for the frame started with startRender() to finish
+     * @param target Pixels to write the final colors to, such as locked window texture memory. Every pixel is written exactly once.
+     * @param depth Where to also write the final depth, row major without padding. Nullptr if not needed.
+     */
+    void finishRender(const PixelSpan& target, float* depth = nullptr){
+        assert(rendering);
+        if(threads_started){
+            //End threads
+            for (int i = 0; i < MAX_THREADS; ++i) {
+                thread_pool[i].join();
+            }
+            for (int i = 0; i < MAX_THREADS; ++i) {
+                stats.addThread(thread_data[i].stats);
+                stats.thread_ms[i] += thread_data[i].busy_ms;
+            }
         }
-        //Combine frame buffers
-        for (int i = MAX_THREADS-1; i >= 1; --i) {
-            combineFrameBuffers(thread_data[i-1].frame_buffer,thread_data[i].frame_buffer);
+        bool blending = threads_started && !blended_tasks.empty();
+        {
+            StageTimer timer(&stats.merge_ms);
+            if(!temporal_reuse && !blending){ //Combine frame buffers straight into the target
+                resolveFrameBuffers(target,depth,nullptr);
+            }else if(temporal_reuse){ //Combine the dirty tiles into the history
+                if(threads_started) resolveFrameBuffers(history.getPixelSpan(),history.getDepthPlane(),partial_frame ? dirty_tiles.data() : nullptr);
+                history_valid = true;
+            }else{ //Combine into the first thread's frame buffer, to blend over
+                resolveFrameBuffers(thread_data[0].frame_buffer.getPixelSpan(),thread_data[0].frame_buffer.getDepthPlane(),nullptr);
+            }
         }
-        frame_buffer = thread_data[0].frame_buffer;
-        incoming_tasks.clear();
+        if(blending){
+            StageTimer timer(&stats.blend_ms);
+            FrameBuffer* composite = temporal_reuse ? &history : &thread_data[0].frame_buffer;
+            for (int i = 0; i < MAX_THREADS; ++i) {
+                thread_data[i].busy_ms = 0;
+                thread_pool[i] = std::thread(&Renderer::blendThread,this, i, composite);
+            }
+            for (int i = 0; i < MAX_THREADS; ++i) {
+                thread_pool[i].join();
+                stats.addThread(thread_data[i].stats);
+                stats.thread_ms[i] += thread_data[i].busy_ms;
+            }
+        }
+        if(temporal_reuse || blending){ //Hand out the whole composite
+            const FrameBuffer& composite = temporal_reuse ? history : thread_data[0].frame_buffer;
+            for (int y = 0; y < target.height; ++y) {
+                std::copy_n(composite.getColorPlane() + (size_t)y * target.width, target.width, target.getRow(y));
+            }
+            if(depth != nullptr) std::copy_n(composite.getDepthPlane(), (size_t)target.width * target.height, depth);
+        }
+        render_tasks.clear();
+        blended_tasks.clear();
+        blended_instances.clear();
+        bone_arena.clear();
+        render_sdfs.clear();
+        rendering = false;
+        stats.frame_ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+        if(threads_started) rendered_stats = stats;
+        if(stats_overlay) drawStatsOverlay(target); //Not part of the frame time, and never in the history
     }
 
+    /**
+     * Check if a frame was started and not yet finished
+     */
+    [[nodiscard]] bool isRendering() const {
+        return rendering;
+    }
 
-};
+    /**
+     * Get the result of the render and wait for it to finish.
+     * @param frame_buffer Frame buffer to write the result to.
+     */
+    void getResult(FrameBuffer& frame_buffer){
+        startRender();
+        finishRender(frame_buffer);
+    }
 
+    /**
+     * Get the result of the render and wait for it to finish.
+     * @param target Pixels to write the final colors to. Every pixel is written exactly once.
+     */
+    void getResult(const PixelSpan& target){
+        startRender();
+        finishRender(target);
+    }
 
-//todo move to gpu backend
-/*
-void drawSDF(FrameBuffer& frame_buffer, const SDF& sdf, const glm::vec3& color) const {
-    for (int x = 0; x < frame_buffer.getWidth(); ++x) {
-        for (int y = 0; y < frame_buffer.getHeight(); ++y) {
-            //Get clip space -1 to 1 range
-            float uvx = 2.0f*((float)x/frame_buffer.getWidth() - 0.5f);
-            float uvy = 2.0f*(float)y/frame_buffer.getWidth() - 0.5f;
-            //Get ray origin and direction in world space
-            //see https://stackoverflow.com/questions/2354821/raycasting-how-to-properly-apply-a-projection-matrix
-            glm::mat4 inverse_camera = camera.getInverseMatrix();
-            glm::vec3 ray_origin = inverse_camera * glm::vec4{uvx,uvy,-1.0f,1.0f} * near_plane;
-            glm::vec3 ray_direction = glm::normalize(inverse_camera * glm::vec4{glm::vec2{uvx,uvy} * (far_plane - near_plane), far_plane + near_plane, far_plane - near_plane});
-            //March rays
-            //see https://michaelwalczyk.com/blog-ray-marching.html
-            float depth = 0;
-            const int MAX_STEPS = 40;
-            const float MIN_DIST = 0.01;
-            for(int i = 0; i < MAX_STEPS; i++){
-                if(depth > far_plane) break;
-                glm::vec3 current_position = ray_origin + ray_direction * depth;
-                float current_distance = sdf(current_position);
-                if(current_distance < MIN_DIST){
-                    frame_buffer.setPixelIfDepth(x,y,{color,depth});//todo fix depth
-                }
-                depth += current_distance;
-            }
+    /**
+     * Get counters and timings of the last finished frame
+     * @details Frame time is measured from startRender() to finishRender(), so it includes any work done in between.
+     */
+    [[nodiscard]] const RenderStats& getStats() const {
+        return stats;
+    }
+
+    /**
+     * Enable or disable per stage timing
+     * @param enabled If vertex, clip, and raster times should be measured. Counters and the other times are always collected.
+     * @details Off by default, timing every triangle slows down rendering a bit.
+     */
+    void setStageTiming(bool enabled) {
+        stage_timing = enabled;
+    }
+
+    /**
+     * Enable or disable drawing the stats of each frame over it
+     * @param enabled If finishRender() should draw getStats() in the top left corner of the target
+     * @details Off by default. Drawn after the frame is timed, so it does not show up in the stats.
+     * Fully reused frames show the stats of the last rendered frame below a reused line, rather than their own empty counters.
+     */
+    void setStatsOverlay(bool enabled) {
+        stats_overlay = enabled;
+    }
+
+    /**
+     * Draw the stats of the last finished frame as text
+     * @param target Pixels to draw over, such as a finished frame
+     * @see RenderStats::getOverlayLines()
+     */
+    void drawStatsOverlay(const PixelSpan& target) const {
+        const int MARGIN = 4, LINE_HEIGHT = DEBUG_GLYPH_HEIGHT + 3;
+        const uint32_t TEXT_COLOR = FrameBuffer::packColor(255,255,0);
+        std::vector<std::string> lines;
+        if(threads_started){
+            lines = stats.getOverlayLines();
+        }else{ //Nothing changed, so the counters of the frame whose pixels are shown say more than this frame's zeros
+            char reused[64];
+            std::snprintf(reused, sizeof(reused), "REUSED IN %.2f MS  LAST RENDERED FRAME:", stats.frame_ms);
+            lines = rendered_stats.getOverlayLines();
+            lines.insert(lines.begin(), reused);
+        }
+        for (size_t i = 0; i < lines.size(); ++i) {
+            drawText(target, MARGIN, MARGIN + (int)i * LINE_HEIGHT, lines[i], TEXT_COLOR);
         }
     }
-}
-*/
\ No newline at end of file
+
+
+};
@@ -7,7 +7,10 @@
 #include <SDL2/SDL.h>
 #include <string>
 #include <utility>
+#include <array>
+#include <atomic>
 #include "../FrameBuffer.hpp"
+#include "../PixelSpan.hpp"
 #include "../../Events/EventList.hpp"
 
 /**
@@ -15,13 +18,15 @@
  */
 class Window {
 private:
-    int width,height;
+    int width,height; //Size of the frame buffer texture
+    std::atomic<int> window_width,window_height; //Size of the window, changes when resized
     std::string name;
 
     SDL_Renderer *renderer;
     SDL_Window *window;
 
     SDL_Texture* frame_texture;
+    std::array<SDL_Texture*,2> stream_textures{}; //Double buffered textures the renderer can write into directly
 public:
     /**
      * Create an SDL window
@@ -30,29 +35,76 @@ public:
      * @param height Height of window in pixels
      * @param name Name of window
      */
-    Window(int width,int height, const std::string& name) : width(width), height(height), name(name) {
+    Window(int width,int height, const std::string& name) : width(width), height(height), window_width(width), window_height(height), name(name) {
         SDL_Init(SDL_INIT_VIDEO);
+        SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear"); //Frames rendered below window resolution are upscaled smoothly
         SDL_CreateWindowAndRenderer(width, height, SDL_WINDOW_RESIZABLE  , &window, &renderer);
         SDL_SetWindowTitle(window, name.c_str());
         frame_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, width, height);;
-        SDL_RenderSetLogicalSize(renderer, width, height);
+        for (SDL_Texture*& texture : stream_textures) {
+            texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, width, height); //Same byte order as the frame buffer
+        }
     }
 
-    //todo handle resize
+    /**
+     * Get the current size of the window in pixels
+     * @details Safe to call from any thread.
+     */
+    [[nodiscard]] glm::ivec2 getSize() const {
+        return {window_width.load(),window_height.load()};
+    }
 
     /**
-     * Draw a frame buffer to the screen
-     * @param buffer Frame buffer to draw. Must be same size;
+     * Draw a frame buffer to the screen, stretched to the window
+     * @param buffer Frame buffer to draw. Any size.
      */
     void drawFrameBuffer(const FrameBuffer& buffer){
-        assert(buffer.getHeight() == height);
-        assert(buffer.getWidth() == width);
+        if(buffer.getWidth() != width || buffer.getHeight() != height){
+            width = buffer.getWidth();
+            height = buffer.getHeight();
+            SDL_DestroyTexture(frame_texture);
+            frame_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+        }
         SDL_RenderClear(renderer);
         SDL_UpdateTexture(frame_texture , nullptr, buffer.getRawImage(), width * 4);
         SDL_RenderCopy(renderer, frame_texture , nullptr, nullptr);
         SDL_RenderPresent(renderer);
     }
 
+    /**
+     * Lock a streaming texture so a frame can be written straight into it
+     * @param index Texture to lock, 0 or 1. Must not be locked already.
+     * @param frame_width,frame_height Resolution of the frame. The texture is recreated if it changed.
+     * @return Texture memory. Write only, old contents are undefined. Valid until presentFrame() with the same index.
+     */
+    PixelSpan lockFrame(int index, int frame_width, int frame_height){
+        int texture_width, texture_height;
+        SDL_QueryTexture(stream_textures[index], nullptr, nullptr, &texture_width, &texture_height);
+        if(texture_width != frame_width || texture_height != frame_height){
+            SDL_DestroyTexture(stream_textures[index]);
+            stream_textures[index] = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, frame_width, frame_height);
+        }
+        void* pixels;
+        int pitch;
+        if(SDL_LockTexture(stream_textures[index], nullptr, &pixels, &pitch) != 0){
+            std::cerr << "Failed to lock frame texture: " << SDL_GetError() << "\n";
+            return PixelSpan{};
+        }
+        return PixelSpan{static_cast<uint32_t*>(pixels),frame_width,frame_height,pitch / 4};
+    }
+
+    /**
+     * Unlock a streaming texture and draw it to the screen
+     * @param index Texture locked with lockFrame()
+     * @details The texture is stretched to the window, which upscales frames rendered at a lower resolution.
+     */
+    void presentFrame(int index){
+        SDL_UnlockTexture(stream_textures[index]);
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, stream_textures[index], nullptr, nullptr);
+        SDL_RenderPresent(renderer);
+    }
+
     /**
      * Call this in the main loop to check if window is still open and poll events
      * @param events_list Output of all current events
@@ -64,6 +116,10 @@ public:
         while(SDL_PollEvent(&event)){
             events.push_back(event);
             if(event.type == SDL_QUIT) return false;
+            if(event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED){
+                window_width = event.window.data1;
+                window_height = event.window.data2;
+            }
         };
         events_list.update(events);
         return true;
@@ -84,6 +140,10 @@ public:
         SDL_Event event;
         while(SDL_PollEvent(&event)){
             if(event.type == SDL_QUIT) return false;
+            if(event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED){
+                window_width = event.window.data1;
+                window_height = event.window.data2;
+            }
         };
         return true;
     }
@@ -93,6 +153,9 @@ public:
      */
     ~Window(){
         SDL_DestroyTexture(frame_texture);
+        for (SDL_Texture* texture : stream_textures) {
+            SDL_DestroyTexture(texture);
+        }
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
         SDL_Quit();
@@ -3,6 +3,8 @@
 //
 
 #pragma once
+#include <algorithm>
+#include <cstdint>
 #include "glm/glm.hpp"
 /**
  * Shade pixels
@@ -23,4 +25,48 @@ public:
     static glm::vec3 run(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv, const glm::vec3& texture){
         return texture;
     }
+
+    /**
+     * Apply interpolated vertex lighting to a texel
+     * @param texel Packed rgba texel
+     * @param light Light reaching the pixel. Channels above 1 brighten, up to full intensity.
+     * @return Packed rgba pixel with full alpha
+     */
+    static uint32_t light(uint32_t texel, const glm::vec3& light){
+        uint32_t r = (uint32_t)std::min(255.0f, (float)(texel & 0xFF) * light.x);
+        uint32_t g = (uint32_t)std::min(255.0f, (float)((texel >> 8) & 0xFF) * light.y);
+        uint32_t b = (uint32_t)std::min(255.0f, (float)((texel >> 16) & 0xFF) * light.z);
+        return r | (g << 8) | (b << 16) | 0xFF000000;
+    }
+
+    /**
+     * Apply a lightmap texel to a texel, in integer math
+     * @param texel Packed rgba texel
+     * @param lightmap_texel Packed lightmap texel, where 255 is twice full brightness(Lightmap::RANGE)
+     * @return Packed rgba pixel with full alpha
+     */
+    static uint32_t lightBaked(uint32_t texel, uint32_t lightmap_texel){
+        uint32_t r = std::min(255u, ((texel & 0xFF) * (lightmap_texel & 0xFF)) >> 7);
+        uint32_t g = std::min(255u, (((texel >> 8) & 0xFF) * ((lightmap_texel >> 8) & 0xFF)) >> 7);
+        uint32_t b = std::min(255u, (((texel >> 16) & 0xFF) * ((lightmap_texel >> 16) & 0xFF)) >> 7);
+        return r | (g << 8) | (b << 16) | 0xFF000000;
+    }
+
+    /**
+     * Blend a pixel over another, in integer math
+     * @param color Packed rgba pixel to draw
+     * @param alpha Opacity of color. 255 fully covers destination.
+     * @param destination Packed rgba pixel already in the frame buffer
+     * @return Packed rgba pixel with full alpha
+     */
+    static uint32_t blend(uint32_t color, uint32_t alpha, uint32_t destination){
+        uint32_t inverse = 255 - alpha;
+        //Red and blue are blended together, they are 16 bits apart so they can not overflow into each other
+        uint32_t red_blue = (color & 0xFF00FF) * alpha + (destination & 0xFF00FF) * inverse + 0x800080;
+        uint32_t green = ((color >> 8) & 0xFF) * alpha + ((destination >> 8) & 0xFF) * inverse + 0x80;
+        //Divide by 255 with rounding, x/255 = (x + x/256)/256
+        red_blue = ((red_blue + ((red_blue >> 8) & 0xFF00FF)) >> 8) & 0xFF00FF;
+        green = ((green + (green >> 8)) >> 8) & 0xFF;
+        return red_blue | (green << 8) | 0xFF000000;
+    }
 };
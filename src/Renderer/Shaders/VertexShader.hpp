@@ -7,7 +7,14 @@
 #include "../Triangle.hpp"
 #include "../Camera.hpp"
 #include "../SkinnedMesh.hpp"
+#include "../Mesh.hpp"
+#include "../Light.hpp"
 #include <glm/gtx/string_cast.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VERTEX_SHADER_SSE
+#endif
 /**
  * Transforms vertices
  */
@@ -18,7 +25,10 @@ private:
     glm::mat4 camera_transform;
     glm::mat4 camera_projection;
     glm::mat4 clip_matrix; //camera matrix * transform
-    glm::mat3 normal_matrix; //For correcting normals
+    glm::mat3 normal_matrix; //For correcting normals, model to view space
+    Light lights[Light::MAX_LIGHTS]; //View space lights of the current model
+    int light_count = 0;
+    glm::vec3 ambient{1,1,1}; //Light reaching every vertex
 public:
 
     /**
@@ -26,8 +36,17 @@ public:
      * Do this once for each 3d model with a different transform
      */
     void setModelTransform(const glm::mat4& transform){
+        setModelTransform(transform, glm::inverse(transform));
+    }
+
+    /**
+     * Set the model transform of the shader, with an already computed inverse
+     * @param transform Model transform
+     * @param inverse_transform Inverse of transform. Used for the normal matrix, so it can be cached between draws.
+     */
+    void setModelTransform(const glm::mat4& transform, const glm::mat4& inverse_transform){
         clip_matrix = camera_transform * transform;
-        normal_matrix = glm::mat3(glm::transpose(glm::inverse(transform)));
+        normal_matrix = glm::mat3(camera_transform) * glm::mat3(glm::transpose(inverse_transform)); //Camera is rigid, so its rotation works on normals as is
         //see https://learnopengl.com/Lighting/Basic-Lighting
     }
 
@@ -40,6 +59,36 @@ public:
         camera_projection = camera.getProjection();
     }
 
+    /**
+     * Set the lights that reach the current model
+     * @param view_lights View space lights of the frame
+     * @param mask Bit i is set if view_lights[i] reaches the model
+     * @param ambient_light Light reaching every vertex
+     */
+    void setLights(const Light* view_lights, uint32_t mask, const glm::vec3& ambient_light){
+        light_count = 0;
+        for (int i = 0; i < Light::MAX_LIGHTS; ++i) {
+            if(mask & (1u << i)) lights[light_count++] = view_lights[i];
+        }
+        ambient = ambient_light;
+    }
+
+    /**
+     * Light a vertex with Gouraud shading
+     * @param view_space View space vertex
+     * @return Light reaching the vertex, to be interpolated across triangles
+     */
+    [[nodiscard]] glm::vec3 shade(const Vertex& view_space) const {
+        glm::vec3 light = ambient;
+        float length = glm::length(view_space.norm);
+        if(length <= 0) return light; //No normal
+        glm::vec3 normal = view_space.norm / length;
+        for (int i = 0; i < light_count; ++i) {
+            light += lights[i].evaluate(view_space.pos, normal);
+        }
+        return light;
+    }
+
     /**
      * Transform a triangle from model space into view space
      * @param model_space Input triangle
@@ -56,6 +105,16 @@ public:
         return view_tri;
     }
 
+    /**
+     * Transform a vertex from model space into view space
+     * @param model_space Input vertex
+     * @return View space vertex. W is still implicitly 1 in view space.
+     * Make sure to set the camera and model matrix beforehand
+     */
+    [[nodiscard]] Vertex toViewSpace(const Vertex& model_space) const {
+        return Vertex{clip_matrix * glm::vec4(model_space.pos,1.0f), normal_matrix * model_space.norm, model_space.tex, model_space.lightmap_tex};
+    }
+
     /**
      * Transform a triangle from view space to clip space by projecting it
      * @param view_space View space triangle
@@ -70,29 +129,61 @@ public:
     }
 
     /**
-     * Transform a triangle from model space into view space and deform with bones
-     * @param model_space Skinned triangle
-     * @param bones Final Skeleton pose transforms
-     * @return View space triangle
-     * Make sure to set the camera and model matrix beforehand
-     * @details https://learnopengl.com/Guest-Articles/2020/Skeletal-Animation
+     * Deform skinned vertices with bones
+     * @param input Skinned model space vertices
+     * @param count Number of vertices
+     * @param bones Final Skeleton pose transforms. Must be meant for the mesh.
+     * @param output Deformed model space vertices. Must have space for count vertices.
+     * @details Blends the bone matrices of each vertex, and then transforms the position and normal with the result.
+     * Uses SSE for the matrix columns when available.
+     * @see https://learnopengl.com/Guest-Articles/2020/Skeletal-Animation
      */
-    [[nodiscard]] Triangle toViewSpaceSkinned(const SkinnedTriangle& model_space, const std::vector<glm::mat4>& bones) const {
-        //deform triangle
-        Triangle deformed_triangle = model_space.triangle;
-        for (int i = 0; i < 3; ++i) {
-            glm::vec4 vertex_position = {0,0,0,0};
+    static void skin(const SkinnedVertex* input, size_t count, const glm::mat4* bones, Vertex* output) {
+        for (size_t i = 0; i < count; ++i) {
+            const SkinnedVertex& skinned = input[i];
+#ifdef VERTEX_SHADER_SSE
+            //Start with the identity for whatever weight is not assigned to a bone
+            float remaining_weight = 1.0f;
+            for (int j = 0; j < MAX_BONES_PER_VERTEX; ++j) {
+                if(skinned.bone_ids[j] != -1) remaining_weight -= skinned.weights[j];
+            }
+            __m128 remaining = _mm_set1_ps(remaining_weight);
+            __m128 column_0 = _mm_mul_ps(remaining, _mm_setr_ps(1,0,0,0));
+            __m128 column_1 = _mm_mul_ps(remaining, _mm_setr_ps(0,1,0,0));
+            __m128 column_2 = _mm_mul_ps(remaining, _mm_setr_ps(0,0,1,0));
+            __m128 column_3 = _mm_mul_ps(remaining, _mm_setr_ps(0,0,0,1));
+            for (int j = 0; j < MAX_BONES_PER_VERTEX; ++j) {
+                int bone_id = skinned.bone_ids[j];
+                if(bone_id == -1) continue;
+                const float* bone = &bones[bone_id][0][0]; //Column major
+                __m128 weight = _mm_set1_ps(skinned.weights[j]);
+                column_0 = _mm_add_ps(column_0, _mm_mul_ps(weight, _mm_loadu_ps(bone + 0)));
+                column_1 = _mm_add_ps(column_1, _mm_mul_ps(weight, _mm_loadu_ps(bone + 4)));
+                column_2 = _mm_add_ps(column_2, _mm_mul_ps(weight, _mm_loadu_ps(bone + 8)));
+                column_3 = _mm_add_ps(column_3, _mm_mul_ps(weight, _mm_loadu_ps(bone + 12)));
+            }
+            const glm::vec3& position = skinned.vertex.pos;
+            const glm::vec3& normal = skinned.vertex.norm;
+            __m128 deformed_position = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column_0, _mm_set1_ps(position.x)), _mm_mul_ps(column_1, _mm_set1_ps(position.y))),
+                                                  _mm_add_ps(_mm_mul_ps(column_2, _mm_set1_ps(position.z)), column_3));
+            __m128 deformed_normal = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column_0, _mm_set1_ps(normal.x)), _mm_mul_ps(column_1, _mm_set1_ps(normal.y))),
+                                                _mm_mul_ps(column_2, _mm_set1_ps(normal.z)));
+            alignas(16) float result_position[4], result_normal[4];
+            _mm_store_ps(result_position, deformed_position);
+            _mm_store_ps(result_normal, deformed_normal);
+            output[i] = Vertex{{result_position[0],result_position[1],result_position[2]},{result_normal[0],result_normal[1],result_normal[2]},skinned.vertex.tex,skinned.vertex.lightmap_tex};
+#else
+            glm::mat4 blended = glm::mat4(0.0f);
             float remaining_weight = 1.0;
             for (int j = 0; j < MAX_BONES_PER_VERTEX; ++j) {
-                int bone_id =  model_space.bone_ids[i][j];
+                int bone_id = skinned.bone_ids[j];
                 if(bone_id == -1) continue;
-                vertex_position += (bones[bone_id] * deformed_triangle.pos[i]) * model_space.weights[i][j];
-                remaining_weight -= model_space.weights[i][j];
-                //todo support for normals
+                blended += bones[bone_id] * skinned.weights[j];
+                remaining_weight -= skinned.weights[j];
             }
-            vertex_position += deformed_triangle.pos[i] * remaining_weight;
-            deformed_triangle.pos[i] = vertex_position;
+            blended += glm::identity<glm::mat4>() * remaining_weight;
+            output[i] = Vertex{blended * glm::vec4(skinned.vertex.pos,1.0f), glm::mat3(blended) * skinned.vertex.norm, skinned.vertex.tex, skinned.vertex.lightmap_tex};
+#endif
         }
-        return toViewSpace(deformed_triangle); //do final projection
     }
 };
@@ -5,8 +5,9 @@
 #pragma once
 
 #include <vector>
-#include "Triangle.hpp"
+#include "Mesh.hpp"
 #include "../GameState/Pose.hpp"
+#include "../GameState/Animation.hpp"
 
 /**
  * Max number of bones that can influence a single vertex
@@ -14,19 +15,30 @@
 const int MAX_BONES_PER_VERTEX = 4;
 
 /**
- * Triangle with additional skinning information
+ * Vertex with additional skinning information
  */
-struct SkinnedTriangle {
-    Triangle triangle;
-    int bone_ids[3][MAX_BONES_PER_VERTEX]; //-1 means no bone
-    float weights[3][MAX_BONES_PER_VERTEX];
+struct SkinnedVertex {
+    Vertex vertex;
+    int bone_ids[MAX_BONES_PER_VERTEX]; //-1 means no bone
+    float weights[MAX_BONES_PER_VERTEX];
 };
 
 /**
  * A mesh that has skinning information for animations
+ * @details Indexed like Mesh, so each vertex only has to be deformed once per pose.
  */
 struct SkinnedMesh {
-    std::vector<SkinnedTriangle> tris;
+    std::vector<SkinnedVertex> vertices;
+    std::vector<uint32_t> indices; //Three per triangle, in winding order
     int num_bones;
-    std::vector<Pose> animations;
+    std::vector<Pose> animations; //Bone hierarchy for editing poses by hand
+    Skeleton skeleton; //Flattened bone hierarchy for the animation clips, empty if the mesh has no bones
+    std::vector<AnimationClip> clips; //Imported animations, sampled with sampleClip()
+
+    /**
+     * Get the number of triangles in the mesh
+     */
+    [[nodiscard]] size_t getTriangleCount() const {
+        return indices.size() / 3;
+    }
 };
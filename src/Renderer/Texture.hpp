@@ -7,89 +7,222 @@
 #include <cstdint>
 #include <vector>
 #include <cassert>
+#include <cmath>
+#include <algorithm>
 #include <iostream>
 
 /**
- * A simple 8-bit color texture
+ * A mipmapped 8-bit RGBA texture
+ * @details Each mip level is stored Morton ordered(Z-order) so that texels close in 2D are also close in memory.
+ * Dimensions are always a power of two, so wrapping is a bit mask rather than a modulo.
+ * Texels are packed in the same layout as the frame buffer, so they can be written out without conversion.
  */
 class Texture {
+public:
+    /**
+     * Alpha values below this are considered transparent
+     */
+    static const uint8_t ALPHA_CUTOFF = 100;
+
 private:
-    std::vector<uint8_t> pixels;
-    const int channels;
-    const int width,height;
+    /**
+     * A single mip level
+     */
+    struct MipLevel {
+        int width, height; //Power of two dimensions
+        int width_mask, height_mask; //Used for wrapping
+        size_t offset; //Start of level in texel array
+        std::vector<uint32_t> morton_x, morton_y; //Morton offset of each column and row. Bits do not overlap, so they can be combined with a bitwise or.
+    };
+
+    std::vector<uint32_t> texels; //All mip levels, packed rgba
+    std::vector<MipLevel> levels; //Level 0 is full resolution
+    int width{},height{};
+    bool transparent = false; //If any texel is below the alpha cutoff
+
+    /**
+     * Spread the bits of a number out such that there is a zero bit between each
+     * @see https://fgiesen.wordpress.com/2009/12/13/decoding-morton-codes/
+     */
+    static uint32_t spreadBits(uint32_t value) {
+        value &= 0x0000ffff;
+        value = (value ^ (value << 8)) & 0x00ff00ff;
+        value = (value ^ (value << 4)) & 0x0f0f0f0f;
+        value = (value ^ (value << 2)) & 0x33333333;
+        value = (value ^ (value << 1)) & 0x55555555;
+        return value;
+    }
+
+    /**
+     * Get the log2 of a power of two
+     */
+    static int log2PowerOfTwo(int value) {
+        int log = 0;
+        while ((1 << log) < value) log++;
+        return log;
+    }
+
+    /**
+     * Get the power of two closest to a value(in log space)
+     */
+    static int nearestPowerOfTwo(int value) {
+        return 1 << std::max(0,(int)std::lround(std::log2((double)value)));
+    }
+
+    /**
+     * Add a new empty mip level with morton lookup tables
+     * @param level_width,level_height Power of two dimensions
+     */
+    void addLevel(int level_width, int level_height) {
+        MipLevel level{level_width,level_height,level_width-1,level_height-1,texels.size(),{},{}};
+        int bits_x = log2PowerOfTwo(level_width);
+        int bits_y = log2PowerOfTwo(level_height);
+        int shared_bits = std::min(bits_x,bits_y);
+        uint32_t shared_mask = (1u << shared_bits) - 1;
+        //Interleave the shared low bits, then stack the remaining bits of the longer axis on top
+        level.morton_x.resize(level_width);
+        for (int x = 0; x < level_width; ++x) {
+            level.morton_x[x] = spreadBits(x & shared_mask) | (bits_x > bits_y ? ((uint32_t)x >> shared_bits) << (2 * shared_bits) : 0);
+        }
+        level.morton_y.resize(level_height);
+        for (int y = 0; y < level_height; ++y) {
+            level.morton_y[y] = (spreadBits(y & shared_mask) << 1) | (bits_y > bits_x ? ((uint32_t)y >> shared_bits) << (2 * shared_bits) : 0);
+        }
+        texels.resize(texels.size() + (size_t)level_width * level_height);
+        levels.push_back(std::move(level));
+    }
+
+    /**
+     * Get texel index in the texel array
+     * @param level Mip level
+     * @param x,y Coordinate. Must be in bounds of level.
+     */
+    [[nodiscard]] size_t texelIndex(const MipLevel& level, int x, int y) const {
+        return level.offset + (level.morton_x[x] | level.morton_y[y]);
+    }
+
+    /**
+     * Fill in mip levels below level 0 using a box filter
+     */
+    void generateMipMaps() {
+        while (levels.back().width > 1 || levels.back().height > 1) {
+            int last = (int)levels.size()-1;
+            addLevel(std::max(1,levels[last].width/2),std::max(1,levels[last].height/2));
+            const MipLevel& source = levels[last];
+            const MipLevel& destination = levels.back();
+            for (int y = 0; y < destination.height; ++y) {
+                for (int x = 0; x < destination.width; ++x) {
+                    uint32_t sum[4] = {0,0,0,0};
+                    for (int i = 0; i < 4; ++i) {
+                        int source_x = std::min(x*2 + (i & 1),source.width-1);
+                        int source_y = std::min(y*2 + (i >> 1),source.height-1);
+                        uint32_t texel = texels[texelIndex(source,source_x,source_y)];
+                        for (int channel = 0; channel < 4; ++channel) {
+                            sum[channel] += (texel >> (channel*8)) & 0xFF;
+                        }
+                    }
+                    texels[texelIndex(destination,x,y)] = packTexel((uint8_t)(sum[0]/4),(uint8_t)(sum[1]/4),(uint8_t)(sum[2]/4),(uint8_t)(sum[3]/4));
+                }
+            }
+        }
+    }
+
 public:
     /**
-     * Create an empty texture
-     * @param width Width in pixels
-     * @param height Height in pixels
-     * @param channels Channel count. At least 3(r,g,b).
+     * Pack a texel
+     * @param r,g,b,a Channels
+     * @return Packed rgba texel. Same layout as the frame buffer.
      */
-    Texture(int width,int height,int channels = 3) : pixels(channels*width*height), channels(channels), width(width), height(height){
-        assert(channels>=3);
+    static uint32_t packTexel(uint8_t r,uint8_t g,uint8_t b,uint8_t a) {
+        return (uint32_t)r | ((uint32_t)g << 8) | ((uint32_t)b << 16) | ((uint32_t)a << 24);
     }
 
+    /**
+     * Get the alpha of a packed texel
+     */
+    static uint8_t getAlpha(uint32_t texel) {
+        return (uint8_t)(texel >> 24);
+    }
 
     /**
-     * Check if a pixel is transparent
-     * @param x,y Coordinate. Must be in bounds.
-     * Will return false if no alpha channel
-     * @return True if transparent
+     * Create a texture from an 8-bit image
+     * @param source_width,source_height Dimensions of image in pixels. Will be resampled to the nearest power of two.
+     * @param source Row major image data.
+     * @param channels Channel count of image data. At least 3(r,g,b). Alpha is the fourth channel if present.
      */
-    [[nodiscard]] bool isTransparent(int x,int y) const {
-        assert(x >= 0 && x < width);
-        assert(y >= 0 && y < height);
-        if(channels < 4) return false;
-        int offset = (y*width+x)*channels;
-        return pixels[offset+3] < 100;
+    Texture(int source_width,int source_height, const uint8_t* source, int channels = 4) {
+        assert(channels>=3);
+        width = nearestPowerOfTwo(source_width);
+        height = nearestPowerOfTwo(source_height);
+        addLevel(width,height);
+        //Nearest neighbor resample into level 0
+        for (int y = 0; y < height; ++y) {
+            int source_y = (int)(((int64_t)y * source_height) / height);
+            for (int x = 0; x < width; ++x) {
+                int source_x = (int)(((int64_t)x * source_width) / width);
+                const uint8_t* pixel = source + ((size_t)source_y*source_width+source_x)*channels;
+                uint8_t alpha = channels > 3 ? pixel[3] : 255;
+                transparent |= alpha < ALPHA_CUTOFF;
+                texels[texelIndex(levels[0],x,y)] = packTexel(pixel[0],pixel[1],pixel[2],alpha);
+            }
+        }
+        generateMipMaps();
     }
 
     /**
-     * Set the transparency of a pixel
-     * @param alpha Transparency value. Less than 100 is considered transparent.
-     * @param x,y Coordinate. Must be in bounds.
-     * Must have more than 3 channels
+     * Check if any texel in the texture is transparent
      */
-    void setTransparent(uint8_t alpha, int x,int y){
-        assert(x >= 0 && x < width);
-        assert(y >= 0 && y < height);
-        assert(channels > 3);
-        int offset = (y*width+x)*channels;
-        pixels[offset+3]= alpha;
+    [[nodiscard]] bool hasTransparency() const {
+        return transparent;
     }
 
     /**
-     * Set r g b pixel
-     * @param r Red
-     * @param g Green
-     * @param b Blue
-     * @param x,y Coordinate. Must be in bounds.
+     * Select a mip level from screen space uv derivatives
+     * @param du_dx,dv_dx,du_dy,dv_dy Change in uv per pixel step in x and y.
+     * @return Mip level. May be past the last level, sample() will clamp it.
      */
-    void setPixel(uint8_t r,uint8_t g,uint8_t b, int x, int y){
-        assert(x >= 0 && x < width);
-        assert(y >= 0 && y < height);
-        int offset = (y*width+x)*channels;
-        pixels[offset + 0] = r;
-        pixels[offset + 1] = g;
-        pixels[offset + 2] = b;
+    [[nodiscard]] int selectLevel(float du_dx, float dv_dx, float du_dy, float dv_dy) const {
+        float scaled_u_x = du_dx * (float)width, scaled_v_x = dv_dx * (float)height;
+        float scaled_u_y = du_dy * (float)width, scaled_v_y = dv_dy * (float)height;
+        float footprint = std::max(scaled_u_x*scaled_u_x + scaled_v_x*scaled_v_x, scaled_u_y*scaled_u_y + scaled_v_y*scaled_v_y); //Squared texels per pixel
+        if (!(footprint > 1.0f)) return 0;
+        return std::ilogb(footprint) / 2; //floor(log2(sqrt(footprint)))
     }
 
     /**
-     * Simple 8-bit color struct
+     * Fetch a texel with repeat wrapping
+     * @param u,v Texture coordinates. Any value, will be wrapped.
+     * @param level Mip level. Clamped to the smallest level.
+     * @return Packed rgba texel
      */
-    struct Color {
-        uint8_t r,g,b;
-    };
+    [[nodiscard]] uint32_t sample(float u, float v, int level) const {
+        const MipLevel& mip = levels[std::min(level,(int)levels.size()-1)];
+        int x = (int)std::floor(u * (float)mip.width) & mip.width_mask;
+        int y = (int)std::floor(v * (float)mip.height) & mip.height_mask;
+        return texels[texelIndex(mip,x,y)];
+    }
 
     /**
-     * Get color of pixel
+     * Fetch a texel of the full resolution level, clamping instead of wrapping
+     * @param x,y Texel coordinates, uv times the size. Any value, will be clamped to the edge.
+     * @return Packed rgba texel
+     * @details Cheaper than sample(), there is no floor or level to pick. For atlases like lightmaps, whose uvs stay inside the texture.
+     */
+    [[nodiscard]] uint32_t fetchClamped(float x, float y) const {
+        int texel_x = std::clamp((int)x, 0, width - 1); //Truncation only differs from floor below 0, which clamps anyway
+        int texel_y = std::clamp((int)y, 0, height - 1);
+        return texels[texelIndex(levels[0],texel_x,texel_y)];
+    }
+
+    /**
+     * Get texel of full resolution level
      * @param x,y Coordinates. Must be in bounds.
-     * @return RGB color
+     * @return Packed rgba texel
      */
-    [[nodiscard]] Color getPixel(int x,int y) const {
+    [[nodiscard]] uint32_t getPixel(int x,int y) const {
         assert(x >= 0 && x < width);
         assert(y >= 0 && y < height);
-        int offset = (y*width+x)*channels;
-        return Color{ pixels[offset + 0], pixels[offset + 1], pixels[offset + 2]};
+        return texels[texelIndex(levels[0],x,y)];
     }
 
     /**
@@ -105,4 +238,11 @@ public:
     [[nodiscard]] int getHeight() const{
         return height;
     }
+
+    /**
+     * Get number of mip levels
+     */
+    [[nodiscard]] int getLevelCount() const {
+        return (int)levels.size();
+    }
 };
@@ -11,6 +11,7 @@
 #include <mutex>
 #include <unordered_set>
 #include "GameState/GameObject.hpp"
+#include "Physics/SphereBVArray.hpp"
 #include "Services/Services.hpp"
 #include "readwriterqueue/readerwriterqueue.h"
 #include "Networking/ConnectionManager.hpp"
@@ -57,6 +58,8 @@ private:
     std::unique_ptr<std::unordered_map<ObjectID,std::unique_ptr<GameObject>>> objects_buffer_network; //Game object buffer for network thread. (Read Network thread & Write Update thread)
     std::unique_ptr<std::unordered_map<ObjectID,std::unique_ptr<GameObject>>> objects_buffer_update; //Game object buffer to be written to by update thread.(Write Update thread)
     std::mutex swap_mutex;
+    uint64_t swap_count = 0; //Incremented on every swap, so the network thread knows when its buffer changed. (Read mutex Network thread & Write mutex Update thread)
+    PotentiallyVisibleSet map_visibility{}; //Copy of the map's precomputed visibility. Empty sees everything.(Read Network thread & Write mutex Update thread)
 
     /**
      * Swap network and update buffer pointers.
@@ -68,6 +71,7 @@ private:
         {
             std::lock_guard guard(swap_mutex);
             std::swap(objects_buffer_update,objects_buffer_network);
+            swap_count++;
         }
         //Copy data from current network buffer to update buffer to apply previous changes.
         //This is fine without a mutex, since it is just a multiple read of the network buffer. And only the update thread uses the update buffer, so it can write to it.
@@ -148,6 +152,9 @@ private:
      * Wait for incoming events and send out game state
      */
     void networkThread(){
+        SphereBVArray object_bounds{}; //Bounds of the network buffer objects in iteration order, shared by every client
+        uint64_t bounds_swap = UINT64_MAX; //Swap the bounds were gathered for
+        std::vector<uint8_t> object_visibility{}; //Frustum culling bitmask of the current client
         while(running){
             //Gather messages
             network.processIncoming([this](bool TCP, u_long client_id, const std::vector<uint8_t>& packet_data,ConnectionManager& manager){
@@ -168,16 +175,30 @@ private:
                 for (const ObjectID& object_id : client.associated_objects) {
                     if((*objects_buffer_network)[object_id]->updateCamera(new_position,new_look_at)){
                         client.camera.setPosition(new_position);
-                        client.camera.setPosition(new_look_at);
+                        client.camera.setLookAt(new_look_at);
                         break;
                     }
                 }
 
+                //Gather bounds once per swap, then cull them all at once for this client
+                if(bounds_swap != swap_count){
+                    object_bounds.clear();
+                    for (const auto & [object_id, game_object] : *objects_buffer_network) {
+                        object_bounds.push(game_object->getBounds());
+                    }
+                    bounds_swap = swap_count;
+                }
+                object_bounds.inFrustum(client.camera, object_visibility);
+
                 uint8_t buffer_location = 0;
+                size_t object_index = 0;
                 for (const auto & [object_id, game_object] : *objects_buffer_network) {
+                    size_t bounds_index = object_index++;
 
                     //not associated and not visible
-                    if(!game_object->getBounds().inFrustum(client.camera) && client.associated_objects.find(object_id) == client.associated_objects.end()) continue;
+                    if(client.associated_objects.find(object_id) == client.associated_objects.end()){
+                        if(!SphereBVArray::isVisible(object_visibility, bounds_index) || !map_visibility.isVisible(client.camera.getPosition(),object_bounds.get(bounds_index))) continue;
+                    }
 
                     std::vector<uint8_t> data;
                     if(client.cached_objects.find(object_id) == client.cached_objects.end()){
@@ -225,6 +246,10 @@ private:
             object_ptr->loadResourcesServer(resource_manager);
             object_ptr->registerServices(services);
         }
+        if(services.map_service.hasVisibility()){
+            std::lock_guard guard(swap_mutex);
+            map_visibility = *resource_manager.readVisibility(services.map_service.queryVisibility());
+        }
 
         auto last_update = std::chrono::steady_clock::now();
         while(running){
@@ -14,6 +14,8 @@ class MapService {
 private:
      uint16_t map;
      bool init = false;
+     uint16_t visibility;
+     bool has_visibility = false;
 public:
 
     void registerMap(  uint16_t collider){
@@ -25,6 +27,23 @@ public:
         //unusded
     }
 
+    /**
+     * Set the precomputed visibility of the map
+     * @param pvs Visibility resource id
+     */
+    void registerVisibility(uint16_t pvs){
+        visibility = pvs;
+        has_visibility = true;
+    }
+
+    [[nodiscard]]  uint16_t queryVisibility() const {
+        return visibility;
+    }
+
+    [[nodiscard]]  bool hasVisibility() const {
+        return has_visibility;
+    }
+
     [[nodiscard]]  uint16_t queryCollider() const {
         return map;
     }
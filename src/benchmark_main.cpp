@@ -0,0 +1,226 @@
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include "Renderer/Renderer.hpp"
+#include "Loaders/ResourceManager.hpp"
+#include "Loaders/SceneLoader.hpp"
+
+//Render a fixed set of scenes and report rasterizer performance as JSON
+//Usage: RendererBenchmark [options] [scene files...]
+//  --frames <count>   Measured frames per scene. Default is the frame count of each scene.
+//  --warmup <count>   Frames rendered before measuring. Default 5.
+//  --output <file>    Write the JSON there instead of to stdout
+//Only the JSON goes to stdout, progress and loader warnings go to stderr, so the output can be redirected to a file.
+//Without scene files the canned scenes in res/scenes are used, so run it from the res folder.
+
+/**
+ * Scenes measured when none are given
+ */
+const std::vector<std::string> DEFAULT_SCENES = {
+        "scenes/vehicle_map.scene",
+        "scenes/half_life_map.scene",
+        "scenes/half_life_map2.scene",
+        "scenes/sharks.scene",
+        "scenes/alpha_overdraw.scene",
+        "scenes/lit_vehicle_map.scene",
+        "scenes/baked_vehicle_map.scene",
+        "scenes/sdf_spheres.scene",
+        "scenes/blended_glass.scene",
+};
+
+/**
+ * Results of one scene
+ */
+struct BenchmarkResult {
+    std::string scene;
+    int width, height, frames;
+    std::vector<double> frame_times; //Milliseconds
+    RenderStats totals{}; //Summed over all measured frames
+};
+
+/**
+ * Render a scene and collect its stats
+ * @throws runtime_error Unable to load scene.
+ * @param scene_file Scene to render
+ * @param frame_override Frames to measure, or 0 to use the scene frame count
+ * @param warmup Frames to render before measuring, fills caches and lets the cpu clock up
+ */
+BenchmarkResult runScene(const std::string& scene_file, int frame_override, int warmup){
+    ResourceManager manager{};
+    Scene scene = loadScene(scene_file,manager);
+    BenchmarkResult result{scene_file,scene.width,scene.height,frame_override > 0 ? frame_override : scene.frames,{},{}};
+
+    Renderer renderer{scene.width,scene.height};
+    FrameBuffer frame_buffer{scene.width,scene.height,{0,0,0,0}};
+    for (int frame = 0; frame < warmup; ++frame) {
+        scene.queueDraws(renderer,manager,frame);
+        renderer.getResult(frame_buffer);
+    }
+    //Stage timing adds a little overhead, so frame times are measured in a separate pass
+    for (int frame = 0; frame < result.frames; ++frame) {
+        scene.queueDraws(renderer,manager,frame);
+        renderer.getResult(frame_buffer);
+        result.frame_times.push_back(renderer.getStats().frame_ms);
+    }
+    renderer.setStageTiming(true);
+    for (int frame = 0; frame < result.frames; ++frame) {
+        scene.queueDraws(renderer,manager,frame);
+        renderer.getResult(frame_buffer);
+        const RenderStats& stats = renderer.getStats();
+        result.totals.vertex_ms += stats.vertex_ms;
+        result.totals.clip_ms += stats.clip_ms;
+        result.totals.bin_ms += stats.bin_ms;
+        result.totals.raster_ms += stats.raster_ms;
+        result.totals.merge_ms += stats.merge_ms;
+        result.totals.sdf_ms += stats.sdf_ms;
+        result.totals.blend_ms += stats.blend_ms;
+        for (int i = 0; i < Renderer::MAX_THREADS; ++i) {
+            result.totals.thread_ms[i] += stats.thread_ms[i];
+        }
+        result.totals.draw_calls += stats.draw_calls;
+        result.totals.blended_draws += stats.blended_draws;
+        result.totals.instances += stats.instances;
+        result.totals.triangles += stats.triangles;
+        result.totals.triangles_cluster_pvs_culled += stats.triangles_cluster_pvs_culled;
+        result.totals.triangles_cluster_frustum_culled += stats.triangles_cluster_frustum_culled;
+        result.totals.triangles_cluster_cone_culled += stats.triangles_cluster_cone_culled;
+        result.totals.triangles_near_clipped += stats.triangles_near_clipped;
+        result.totals.triangles_frustum_culled += stats.triangles_frustum_culled;
+        result.totals.triangles_rasterized += stats.triangles_rasterized;
+        result.totals.triangles_backface_culled += stats.triangles_backface_culled;
+        result.totals.pixels_shaded += stats.pixels_shaded;
+        result.totals.pixels_written += stats.pixels_written;
+        result.totals.sdf_draws += stats.sdf_draws;
+        result.totals.sdf_rays += stats.sdf_rays;
+    }
+    return result;
+}
+
+/**
+ * Escape a string for use inside a JSON string literal
+ * @param text Raw text, like a scene path
+ * @return Text with quotes, backslashes, and control characters escaped
+ */
+std::string escapeJSON(const std::string& text){
+    std::string escaped;
+    for (char character : text) {
+        if(character == '"' || character == '\\'){
+            escaped += '\\';
+            escaped += character;
+        }else if((unsigned char)character < 0x20){
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", (unsigned char)character);
+            escaped += code;
+        }else{
+            escaped += character;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * Write the results of a scene as a JSON object
+ * @param out Stream to write to
+ * @param result Scene results
+ */
+void writeResult(std::ostream& out, const BenchmarkResult& result){
+    std::vector<double> sorted = result.frame_times;
+    std::sort(sorted.begin(),sorted.end());
+    double total_ms = 0;
+    for (double time : sorted) total_ms += time;
+    double frames = (double)result.frames;
+    double pixels = (double)result.width * result.height;
+    const RenderStats& totals = result.totals;
+
+    out << "    {\n";
+    out << "      \"scene\": \"" << escapeJSON(result.scene) << "\",\n";
+    out << "      \"resolution\": [" << result.width << ", " << result.height << "],\n";
+    out << "      \"frames\": " << result.frames << ",\n";
+    out << "      \"threads\": " << Renderer::MAX_THREADS << ",\n";
+    out << "      \"ms_per_frame\": {\"average\": " << total_ms / frames << ", \"min\": " << sorted.front() << ", \"median\": " << sorted[sorted.size()/2]
+        << ", \"p95\": " << sorted[std::min(sorted.size()-1,sorted.size()*95/100)] << ", \"max\": " << sorted.back() << "},\n";
+    out << "      \"draw_calls\": " << totals.draw_calls / result.frames << ",\n";
+    out << "      \"blended_draws\": " << totals.blended_draws / result.frames << ",\n";
+    out << "      \"instances\": " << totals.instances / result.frames << ",\n";
+    out << "      \"triangles\": " << totals.triangles / result.frames << ",\n";
+    out << "      \"triangles_culled\": {\"cluster_pvs\": " << totals.triangles_cluster_pvs_culled / result.frames << ", \"cluster_frustum\": " << totals.triangles_cluster_frustum_culled / result.frames
+        << ", \"cluster_cone\": " << totals.triangles_cluster_cone_culled / result.frames << ", \"near\": " << totals.triangles_near_clipped / result.frames
+        << ", \"frustum\": " << totals.triangles_frustum_culled / result.frames << ", \"backface\": " << totals.triangles_backface_culled / result.frames << "},\n";
+    out << "      \"triangles_rasterized\": " << totals.triangles_rasterized / result.frames << ",\n";
+    out << "      \"triangles_per_second\": " << (double)totals.triangles / frames / (total_ms / frames / 1000.0) << ",\n";
+    out << "      \"pixels_shaded\": " << totals.pixels_shaded / result.frames << ",\n";
+    out << "      \"pixels_written\": " << totals.pixels_written / result.frames << ",\n";
+    out << "      \"overdraw\": " << (double)totals.pixels_shaded / frames / pixels << ",\n";
+    out << "      \"sdf_draws\": " << totals.sdf_draws / result.frames << ",\n";
+    out << "      \"sdf_rays\": " << totals.sdf_rays / result.frames << ",\n";
+    //Vertex, clip, raster, and sdf are summed over the render threads
+    out << "      \"stages_ms\": {\"vertex\": " << totals.vertex_ms / frames << ", \"clip\": " << totals.clip_ms / frames << ", \"bin\": " << totals.bin_ms / frames
+        << ", \"raster\": " << totals.raster_ms / frames << ", \"merge\": " << totals.merge_ms / frames << ", \"sdf\": " << totals.sdf_ms / frames << ", \"blend\": " << totals.blend_ms / frames << "},\n";
+    out << "      \"thread_ms\": [";
+    for (int i = 0; i < Renderer::MAX_THREADS; ++i) {
+        out << (i > 0 ? ", " : "") << totals.thread_ms[i] / frames;
+    }
+    out << "]\n";
+    out << "    }";
+}
+
+int main(int argc, char* argv[]) {
+    int frame_override = 0, warmup = 5;
+    std::string output_file;
+    std::vector<std::string> scene_files;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if(option.rfind("--",0) != 0){
+            scene_files.push_back(option);
+            continue;
+        }
+        if(i + 1 >= argc){
+            std::cerr << "Missing value for " << option << "\n";
+            return 1;
+        }
+        std::string value = argv[++i];
+        if(option == "--frames") frame_override = std::stoi(value);
+        else if(option == "--warmup") warmup = std::stoi(value);
+        else if(option == "--output") output_file = value;
+        else {
+            std::cerr << "Usage: RendererBenchmark [--frames count] [--warmup count] [--output file.json] [scene files...]\n";
+            return 1;
+        }
+    }
+    if(scene_files.empty()) scene_files = DEFAULT_SCENES;
+
+    std::vector<BenchmarkResult> results;
+    try {
+        for (const std::string& scene_file : scene_files) {
+            std::cerr << "Benchmarking " << scene_file << "\n";
+            results.push_back(runScene(scene_file,frame_override,warmup));
+        }
+    } catch (const std::runtime_error& error){
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3);
+    json << "{\n  \"scenes\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        writeResult(json,results[i]);
+        json << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    json << "  ]\n}\n";
+
+    if(output_file.empty()){
+        std::cout << json.str();
+    } else {
+        std::ofstream output(output_file);
+        if(!output){
+            std::cerr << "Error saving results: " << output_file << "\n";
+            return 1;
+        }
+        output << json.str();
+    }
+    return 0;
+}
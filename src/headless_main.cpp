@@ -0,0 +1,151 @@
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include "Renderer/Camera.hpp"
+#include "Renderer/Renderer.hpp"
+#include "Loaders/ResourceManager.hpp" //Also includes stb image through the texture loader
+#include "Loaders/SceneLoader.hpp"
+#include "Loaders/ImageWriter.hpp"
+
+//Render a scene file without a window or a server, for performance measurement and image regression tests
+//Usage: HeadlessRender scene.txt [options]
+//  --image <file.png|file.ppm>  Save the last frame
+//  --dump <prefix>               Save every frame as <prefix><frame>.ppm
+//  --timings <file.csv>          Save the time of every frame
+//  --frames <count>              Override the frame count of the scene
+//  --golden <image>              Compare the last frame to a reference image(png or ppm), exit with 2 if it differs
+//  --tolerance <0-255>           Largest channel difference still considered equal. Default 0.
+//  --max-bad-pixels <count>      Pixels allowed to differ beyond the tolerance. Default 0.
+//  --temporal-reuse <0|1>        Only render the tiles that changed since the last frame, like the client. Default 0.
+//  --stats <file.csv>            Save the render stats of every frame
+//  --stats-overlay <0|1>         Draw the render stats over every frame. Default 0.
+
+/**
+ * Compare a frame buffer to a reference image
+ * @return Number of pixels with a channel differing by more than the tolerance, or -1 if the image could not be read or has a different size.
+ */
+long long compareToGolden(const FrameBuffer& frame_buffer, const std::string& golden_file, int tolerance){
+    int width,height,channels;
+    stbi_uc* golden = stbi_load(golden_file.c_str(),&width,&height,&channels,3);
+    if(golden == nullptr) return -1;
+    if(width != frame_buffer.getWidth() || height != frame_buffer.getHeight()){
+        stbi_image_free(golden);
+        return -1;
+    }
+    long long bad_pixels = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            glm::vec3 color = FrameBuffer::unpackColor(frame_buffer.getColor(x,y));
+            const stbi_uc* pixel = golden + ((size_t)y*width+x)*3;
+            for (int channel = 0; channel < 3; ++channel) {
+                if(std::abs((int)color[channel] - (int)pixel[channel]) > tolerance){
+                    bad_pixels++;
+                    break;
+                }
+            }
+        }
+    }
+    stbi_image_free(golden);
+    return bad_pixels;
+}
+
+int main(int argc, char* argv[]) {
+    if(argc < 2){
+        std::cerr << "Usage: HeadlessRender scene.txt [--image file] [--dump prefix] [--timings file.csv] [--frames count] [--golden image] [--tolerance value] [--max-bad-pixels count] [--temporal-reuse 0|1] [--stats file.csv] [--stats-overlay 0|1]\n";
+        return 1;
+    }
+    std::string scene_file = argv[1];
+    std::string image_file, dump_prefix, timings_file, golden_file, stats_file;
+    int frame_override = 0, tolerance = 0;
+    long long max_bad_pixels = 0;
+    bool temporal_reuse = false, stats_overlay = false;
+    for (int i = 2; i < argc; ++i) {
+        std::string option = argv[i];
+        if(i + 1 >= argc){
+            std::cerr << "Missing value for " << option << "\n";
+            return 1;
+        }
+        std::string value = argv[++i];
+        if(option == "--image") image_file = value;
+        else if(option == "--dump") dump_prefix = value;
+        else if(option == "--timings") timings_file = value;
+        else if(option == "--golden") golden_file = value;
+        else if(option == "--frames") frame_override = std::stoi(value);
+        else if(option == "--tolerance") tolerance = std::stoi(value);
+        else if(option == "--max-bad-pixels") max_bad_pixels = std::stoll(value);
+        else if(option == "--temporal-reuse") temporal_reuse = std::stoi(value) != 0;
+        else if(option == "--stats") stats_file = value;
+        else if(option == "--stats-overlay") stats_overlay = std::stoi(value) != 0;
+        else {
+            std::cerr << "Unknown option " << option << "\n";
+            return 1;
+        }
+    }
+
+    try {
+        ResourceManager manager{};
+        Scene scene = loadScene(scene_file,manager);
+        int frames = frame_override > 0 ? frame_override : scene.frames;
+
+        Renderer renderer{scene.width,scene.height};
+        renderer.setTemporalReuse(temporal_reuse);
+        renderer.setStatsOverlay(stats_overlay);
+        std::ofstream stats;
+        if(!stats_file.empty()){
+            stats.open(stats_file);
+            if(!stats) throw std::runtime_error("Error saving stats: " + stats_file);
+            stats << "frame," << RenderStats::getCSVHeader() << "\n";
+        }
+        FrameBuffer frame_buffer{scene.width,scene.height,{0,0,0,0}};
+        std::vector<double> frame_times;
+        frame_times.reserve(frames);
+        for (int frame = 0; frame < frames; ++frame) {
+            auto start = std::chrono::steady_clock::now();
+            scene.queueDraws(renderer,manager,frame);
+            renderer.getResult(frame_buffer);
+            frame_times.push_back(std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count());
+            if(stats.is_open()) stats << frame << "," << renderer.getStats().toCSV() << "\n";
+            if(!dump_prefix.empty()){
+                std::ostringstream name;
+                name << dump_prefix << std::setw(4) << std::setfill('0') << frame << ".ppm";
+                savePPM(name.str(),frame_buffer);
+            }
+        }
+
+        //Report timings
+        std::vector<double> sorted = frame_times;
+        std::sort(sorted.begin(),sorted.end());
+        double total = 0;
+        for (double time : frame_times) total += time;
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "Rendered " << frames << " frames at " << scene.width << "x" << scene.height << "\n";
+        std::cout << "Frame ms: average " << total / frames << ", min " << sorted.front() << ", median " << sorted[sorted.size()/2] << ", 95th percentile " << sorted[std::min(sorted.size()-1,sorted.size()*95/100)] << ", max " << sorted.back() << "\n";
+        if(!timings_file.empty()){
+            std::ofstream timings(timings_file);
+            if(!timings) throw std::runtime_error("Error saving timings: " + timings_file);
+            timings << "frame,milliseconds\n";
+            for (size_t i = 0; i < frame_times.size(); ++i) {
+                timings << i << "," << frame_times[i] << "\n";
+            }
+        }
+        if(!image_file.empty()){
+            saveImage(image_file,frame_buffer);
+        }
+        if(!golden_file.empty()){
+            long long bad_pixels = compareToGolden(frame_buffer,golden_file,tolerance);
+            if(bad_pixels < 0){
+                std::cerr << "Golden image " << golden_file << " could not be read or has a different resolution\n";
+                return 2;
+            }
+            std::cout << "Golden image: " << bad_pixels << " pixels differ\n";
+            if(bad_pixels > max_bad_pixels) return 2;
+        }
+    } catch (const std::runtime_error& error){
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
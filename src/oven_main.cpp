@@ -0,0 +1,84 @@
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Renderer/Camera.hpp"
+#include "Renderer/Triangle.hpp"
+#include "Loaders/ResourceManager.hpp"
+#include "Physics/LightmapBaker.hpp"
+
+//OVEN, bakes the lighting of a static map mesh into a lightmap
+//Usage: OVEN mesh.obj output.lightmap [options]
+//  --size <texels>                       Width and height of the lightmap, power of two. Default 512.
+//  --samples <count>                     Indirect paths per texel. Default 64.
+//  --bounces <count>                     Indirect bounces, 0 for direct light only. Default 2.
+//  --sky <r g b>                         Light from rays that escape the map. Default 0.3 0.3 0.35.
+//  --sun <r g b> <direction x y z>       Add a directional light
+//  --point <r g b> <x y z> <range>       Add a point light
+//Without any lights a default sun is used. Load the result with a lightmap scene command or ResourceManager::getLightmap().
+int main(int argc, char* argv[]) {
+    if(argc < 3){
+        std::cerr << "Usage: OVEN mesh.obj output.lightmap [--size texels] [--samples count] [--bounces count] [--sky r g b] [--sun r g b x y z] [--point r g b x y z range]\n";
+        return 1;
+    }
+    std::string mesh_file = argv[1];
+    std::string output_file = argv[2];
+    int size = 512, samples = 64, bounces = 2;
+    glm::vec3 sky{0.3f,0.3f,0.35f};
+    std::vector<Light> lights;
+
+    try {
+        for (int i = 3; i < argc; ++i) {
+            std::string option = argv[i];
+            auto next = [&](){
+                if(i + 1 >= argc) throw std::runtime_error("Missing value for " + option);
+                return std::stof(argv[++i]);
+            };
+            auto nextVector = [&](){
+                float x = next(), y = next(), z = next();
+                return glm::vec3{x,y,z};
+            };
+            if(option == "--size"){
+                size = (int)next();
+                if(size <= 0 || (size & (size - 1)) != 0) throw std::runtime_error("Lightmap size must be a power of two");
+            } else if(option == "--samples"){
+                samples = std::max(1,(int)next());
+            } else if(option == "--bounces"){
+                bounces = std::max(0,(int)next());
+            } else if(option == "--sky"){
+                sky = nextVector();
+            } else if(option == "--sun"){
+                glm::vec3 color = nextVector();
+                lights.push_back(Light::directional(nextVector(),color));
+            } else if(option == "--point"){
+                glm::vec3 color = nextVector();
+                glm::vec3 position = nextVector();
+                float range = next();
+                if(range <= 0) throw std::runtime_error("Point light range must be positive");
+                lights.push_back(Light::point(position,color,range));
+            } else {
+                throw std::runtime_error("Unknown option " + option);
+            }
+        }
+        if(lights.empty()){
+            lights.push_back(Light::directional({-1,0.5f,-1},{0.9f,0.85f,0.7f}));
+        }
+
+        ResourceManager manager{};
+        //Loaded the same way as at runtime, so triangles are in the same order
+        ResourceManager::ResourceID mesh = manager.getMesh(mesh_file, ResourceManager::OBJ, false);
+        ResourceManager::ResourceID physics_mesh = manager.getPhysicsMesh(mesh);
+
+        auto start = std::chrono::steady_clock::now();
+        Lightmap lightmap = bakeLightmap(*manager.readMesh(mesh), *manager.readPhysicsMesh(physics_mesh), lights, sky, size, samples, bounces);
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Baked " << size << "x" << size << " lightmap for " << manager.readMesh(mesh)->getTriangleCount() << " triangles in " << seconds << "s\n";
+
+        saveLightmap(output_file, lightmap);
+    } catch (const std::exception& error){ //Also catches bad numbers from stof
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
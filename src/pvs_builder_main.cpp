@@ -0,0 +1,45 @@
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <iostream>
+#include "Renderer/Camera.hpp"
+#include "Renderer/Triangle.hpp"
+#include "Loaders/ResourceManager.hpp"
+
+//Precompute the potentially visible set of a static map mesh
+//Usage: PVSBuilder mesh.obj output.pvs [cell size] [points per cell] [rays per point]
+int main(int argc, char* argv[]) {
+    if(argc < 3){
+        std::cerr << "Usage: PVSBuilder mesh.obj output.pvs [cell size] [points per cell] [rays per point]\n";
+        return 1;
+    }
+    std::string mesh_file = argv[1];
+    std::string output_file = argv[2];
+    float cell_size = argc > 3 ? std::stof(argv[3]) : 4.0f;
+    int samples = argc > 4 ? std::max(1,std::stoi(argv[4])) : 8;
+    int rays = argc > 5 ? std::max(1,std::stoi(argv[5])) : 512;
+
+    try {
+        ResourceManager manager{};
+        //Loaded the same way as at runtime, so meshlets match
+        ResourceManager::ResourceID mesh = manager.getMesh(mesh_file, ResourceManager::OBJ, false);
+        ResourceManager::ResourceID physics_mesh = manager.getPhysicsMesh(mesh);
+
+        auto start = std::chrono::steady_clock::now();
+        PotentiallyVisibleSet pvs(*manager.readMesh(mesh), *manager.readPhysicsMesh(physics_mesh), cell_size, samples, rays);
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        //Report how much is culled on average
+        size_t visible_meshlets = 0, visible_cells = 0;
+        for (uint64_t word : pvs.meshlet_bits) visible_meshlets += std::bitset<64>(word).count();
+        for (uint64_t word : pvs.cell_bits) visible_cells += std::bitset<64>(word).count();
+        std::cout << "Built " << pvs.dimensions.x << "x" << pvs.dimensions.y << "x" << pvs.dimensions.z << " cells over " << pvs.meshlet_count << " meshlets in " << seconds << "s\n";
+        std::cout << "Average visible meshlets: " << (double)visible_meshlets / pvs.getCellCount() << ", cells: " << (double)visible_cells / pvs.getCellCount() << "\n";
+
+        savePVS(output_file, pvs);
+    } catch (const std::runtime_error& error){
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+    return 0;
+}